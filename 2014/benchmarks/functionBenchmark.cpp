@@ -0,0 +1,339 @@
+//
+//  functionBenchmark.cpp
+//  capstone_functions
+//
+//  Times each function in projectFunctions.h on its own, so a change to one
+//  of them can be measured without the noise of the rest of the pipeline.
+//  Inputs come from syntheticTargets.h: whole frames at each frame width
+//  (4:3, like the camera's) for the frame-level functions, and single-target
+//  chips at each chip size for the ones the pipeline runs per candidate.
+//  Every function gets the same kind of input it gets in ProcessFrame, made
+//  by the functions before it. The functions that can use a BufferPool are
+//  timed with and without one.
+//
+//  Each case runs once to warm up, then until it has taken -t seconds and at
+//  least 3 samples. A table goes to stdout; the same numbers, in seconds per
+//  call, go to the output file as a JSON array of FunctionTiming records.
+//
+//  Build: g++ -O2 -std=c++11 -I.. functionBenchmark.cpp ../projectFunctions.cpp ../tiledDetection.cpp ../jpegRegions.cpp ../imageIngest.cpp ../bufferPool.cpp ../stageProfiler.cpp
+//         ../perfCounters.cpp ../syntheticTargets.cpp ../targetRecord.cpp ../json.cpp
+//         -o functionBenchmark -pthread `pkg-config --cflags --libs opencv tesseract`
+//
+//  Usage: functionBenchmark [results.json] [-c chipSizes] [-f frameWidths] [-t seconds] [-only function]
+//         defaults: functionBenchmark.json -c 64,128,256 -f 1000,2000,4000 -t 0.5
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "pipeline.h"
+#include "syntheticTargets.h"
+
+using namespace std;
+
+//One function on one input, in seconds per call
+struct FunctionTiming {
+    string function;
+    string input;
+    int width;
+    int height;
+    int calls;                  //calls per sample
+    int samples;
+    double min;
+    double p50;
+    double mean;
+    double max;
+
+    FunctionTiming () : width( 0 ), height( 0 ), calls( 1 ), samples( 0 ), min( 0 ), p50( 0 ), mean( 0 ), max( 0 ) {}
+
+    template < typename Visitor >
+    static void Describe ( Visitor &v ) {
+        v.Field( "function", &FunctionTiming::function );
+        v.Field( "input", &FunctionTiming::input );
+        v.Field( "width", &FunctionTiming::width );
+        v.Field( "height", &FunctionTiming::height );
+        v.Field( "calls", &FunctionTiming::calls );
+        v.Field( "samples", &FunctionTiming::samples );
+        v.Field( "min", &FunctionTiming::min );
+        v.Field( "p50", &FunctionTiming::p50 );
+        v.Field( "mean", &FunctionTiming::mean );
+        v.Field( "max", &FunctionTiming::max );
+    }
+};
+
+static double minSeconds = 0.5;
+static const char *only = NULL;
+static vector< FunctionTiming > timings;
+
+static double Seconds ( chrono::steady_clock::time_point start ) {
+    return chrono::duration< double >( chrono::steady_clock::now() - start ).count();
+}
+
+static vector< int > ParseSizes ( const char *list ) {
+    vector< int > sizes;
+    for ( const char *p = list; *p != '\0'; ) {
+        int size = atoi( p );
+        if ( size > 0 ) {
+            sizes.push_back( size );
+        }
+        const char *comma = strchr( p, ',' );
+        p = ( comma != NULL ) ? comma + 1 : p + strlen( p );
+    }
+    return sizes;
+}
+
+//The functions print as they go; keep that out of the table
+static int QuietStdout () {
+    fflush( stdout );
+    int saved = dup( STDOUT_FILENO ), devNull = open( "/dev/null", O_WRONLY );
+    dup2( devNull, STDOUT_FILENO );
+    close( devNull );
+    return saved;
+}
+
+static void RestoreStdout ( int saved ) {
+    fflush( stdout );
+    dup2( saved, STDOUT_FILENO );
+    close( saved );
+}
+
+//Times body, which makes calls calls to function, and records it
+static void Measure ( const char *function, const string &input, Size size, int calls, const std::function< void () > &body ) {
+    if ( only != NULL && strcmp( only, function ) != 0 ) {
+        return;
+    }
+
+    vector< double > samples;
+    int saved = QuietStdout();
+
+    body();
+    auto start = chrono::steady_clock::now();
+    while ( samples.size() < 3 || Seconds( start ) < minSeconds ) {
+        auto sampleStart = chrono::steady_clock::now();
+        body();
+        samples.push_back( Seconds( sampleStart ) / calls );
+    }
+
+    RestoreStdout( saved );
+
+    sort( samples.begin(), samples.end() );
+    FunctionTiming timing;
+    timing.function = function;
+    timing.input = input;
+    timing.width = size.width;
+    timing.height = size.height;
+    timing.calls = calls;
+    timing.samples = ( int )samples.size();
+    timing.min = samples.front();
+    timing.p50 = samples[samples.size() / 2];
+    timing.max = samples.back();
+    for ( size_t i = 0; i < samples.size(); i++ ) {
+        timing.mean += samples[i] / samples.size();
+    }
+    timings.push_back( timing );
+
+    printf( "%-22s %-20s %7d %10.3f %10.3f %10.3f %10.3f\n", function, input.c_str(), timing.samples, timing.min * 1e3, timing.p50 * 1e3,
+            timing.mean * 1e3, timing.max * 1e3 );
+}
+
+//k means labels and centers for a chip, prepared the way CreateClustersFromMat prepares them for GatherResults
+static void ClusterLabels ( const Mat &chip, Mat &labels, Mat &centers ) {
+    Mat reshaped32f;
+    chip.reshape( 1, chip.cols * chip.rows ).convertTo( reshaped32f, CV_32FC1, 1.0 / 255.0 );
+    kmeans( reshaped32f, CLUSTERS, labels, TermCriteria( CV_TERMCRIT_ITER, 1000, 1 ), 5, KMEANS_PP_CENTERS, centers );
+}
+
+static void BenchFrame ( int width, const map< String, bool > &colors ) {
+    SyntheticSettings settings;
+    settings.width = width;
+    settings.height = width * 3 / 4;
+    settings.minTargets = settings.maxTargets = 4;
+
+    TruthFrame truth;
+    Mat frame = RenderSyntheticFrame( settings, 0, truth );
+    Size size = frame.size();
+
+    ostringstream name;
+    name << "frame " << size.width << "x" << size.height;
+    string input = name.str(), pooledInput = input + " pooled";
+
+    BufferPool pool;
+    Mat reduced = RemoveColorsFromImage( frame, colors ).clone();
+    Mat binary = BinaryImage( reduced ).clone();
+
+    for ( int scale = 2; scale <= 4; scale *= 2 ) {
+        ostringstream scaled;
+        scaled << input << " /" << scale;
+        Measure( "ReduceImage", scaled.str(), size, 1, [&] () {
+            pool.NextFrame();
+            ReduceImage( frame, scale, &pool );
+        } );
+    }
+    Measure( "CreateThreshold", input, size, 1, [&] () {
+        CreateThreshold( frame, 35, 0, 0, 70, 255, 255, false );
+    } );
+    Measure( "RemoveColorsFromImage", input, size, 1, [&] () {
+        RemoveColorsFromImage( frame, colors );
+    } );
+    Measure( "RemoveColorsFromImage", pooledInput, size, 1, [&] () {
+        pool.NextFrame();
+        RemoveColorsFromImage( frame, colors, &pool );
+    } );
+    Measure( "BinaryImage", input, size, 1, [&] () {
+        BinaryImage( reduced );
+    } );
+    Measure( "BinaryImage", pooledInput, size, 1, [&] () {
+        pool.NextFrame();
+        BinaryImage( reduced, &pool );
+    } );
+    Measure( "FindCandidateTargets", input, size, 1, [&] () {
+        int counter = 0, x[XY_BUFFER] = {0}, y[XY_BUFFER] = {0};
+        FindCandidateTargets( frame, binary, MIN_AREA, MAX_AREA, WHITE, &counter, x, y );
+    } );
+
+    //The same stages in bands of rows, on every core (tiledDetection.h)
+    int threads = max( 1, ( int )thread::hardware_concurrency() );
+    ostringstream tiled;
+    tiled << input << " " << threads << " threads";
+    Measure( "TiledCandidateMask", tiled.str(), size, 1, [&] () {
+        pool.NextFrame();
+        TiledCandidateMask( frame, colors, &pool, threads );
+    } );
+    Measure( "FindCandidateTargets", tiled.str(), size, 1, [&] () {
+        int counter = 0, x[XY_BUFFER] = {0}, y[XY_BUFFER] = {0};
+        FindCandidateTargets( frame, binary, MIN_AREA, MAX_AREA, WHITE, &counter, x, y, 1, threads );
+    } );
+}
+
+static void BenchChip ( int chipSize, const map< String, bool > &colors ) {
+    //One target filling most of the chip, on the same terrain the frames have
+    SyntheticSettings settings;
+    settings.width = settings.height = chipSize;
+    settings.minTargets = settings.maxTargets = 1;
+    settings.minSize = settings.maxSize = max( 4, chipSize / 2 - 2 );
+
+    TruthFrame truth;
+    Mat chip = RenderSyntheticFrame( settings, 0, truth );
+    Size size = chip.size();
+
+    ostringstream name;
+    name << "chip " << size.width << "x" << size.height;
+    string input = name.str();
+
+    Mat labels, centers;
+    ClusterLabels( chip, labels, centers );
+    vector< Mat > clusters = CreateClustersFromMat( chip, CLUSTERS );
+    Mat clearTarget = RemoveColorsFromImage( chip, colors ).clone();
+    Mat cleanTargetThresh = BinaryImage( clearTarget ).clone();
+
+    Measure( "CreateClustersFromMat", input, size, 1, [&] () {
+        CreateClustersFromMat( chip, CLUSTERS );
+    } );
+    Measure( "GatherResults", input, size, 1, [&] () {
+        GatherResults( labels, centers, chip.rows, chip.cols );
+    } );
+    Measure( "Identify", input, size, ( int )clusters.size(), [&] () {
+        for ( size_t i = 0; i < clusters.size(); i++ ) {
+            Identify( Mat(), clusters[i] );
+        }
+    } );
+    Measure( "RemoveColorsFromImage", input, size, 1, [&] () {
+        RemoveColorsFromImage( chip, colors );
+    } );
+    Measure( "BinaryImage", input, size, 1, [&] () {
+        BinaryImage( clearTarget );
+    } );
+    //DetermineShape draws on and blurs its input, so every call gets a fresh copy (copyTo into
+    //a same-sized Mat doesn't allocate, and costs little next to the contour work)
+    Mat shapeInput;
+    Measure( "DetermineShape", input, size, 1, [&] () {
+        cleanTargetThresh.copyTo( shapeInput );
+        DetermineShape( shapeInput );
+    } );
+    Measure( "DetectTargetColor", input, size, 1, [&] () {
+        int b = 0, g = 0, r = 0;
+        DetectTargetColor( clearTarget, &b, &g, &r );
+    } );
+    Measure( "DetectCharacterColor", input, size, 1, [&] () {
+        int b = 0, g = 0, r = 0;
+        DetectCharacterColor( clearTarget, &b, &g, &r );
+    } );
+    Measure( "RotateImage", input, size, 1, [&] () {
+        Mat rotated;
+        RotateImage( chip, 30, rotated );
+    } );
+}
+
+//GetColorName is a per-pixel-color lookup, so it's timed over a batch of random colors
+static void BenchColorNames () {
+    static const int COLORS = 4096;
+    RNG rng( 2014 );
+    vector< Vec3b > colors( COLORS );
+    for ( int i = 0; i < COLORS; i++ ) {
+        colors[i] = Vec3b( ( uchar )rng.uniform( 0, 256 ), ( uchar )rng.uniform( 0, 256 ), ( uchar )rng.uniform( 0, 256 ) );
+    }
+
+    volatile size_t sink = 0;
+    Measure( "GetColorName", "4096 random colors", Size(), COLORS, [&] () {
+        for ( int i = 0; i < COLORS; i++ ) {
+            sink += ( size_t )GetColorName( colors[i][2], colors[i][1], colors[i][0] );
+        }
+    } );
+}
+
+int main ( int argc, char **argv ) {
+    const char *resultsOut = "functionBenchmark.json";
+    vector< int > chipSizes = ParseSizes( "64,128,256" ), frameWidths = ParseSizes( "1000,2000,4000" );
+
+    for ( int i = 1; i < argc; i++ ) {
+        if ( strcmp( argv[i], "-c" ) == 0 && i + 1 < argc ) {
+            chipSizes = ParseSizes( argv[++i] );
+        }
+        else if ( strcmp( argv[i], "-f" ) == 0 && i + 1 < argc ) {
+            frameWidths = ParseSizes( argv[++i] );
+        }
+        else if ( strcmp( argv[i], "-t" ) == 0 && i + 1 < argc ) {
+            minSeconds = atof( argv[++i] );
+        }
+        else if ( strcmp( argv[i], "-only" ) == 0 && i + 1 < argc ) {
+            only = argv[++i];
+        }
+        else if ( argv[i][0] != '-' ) {
+            resultsOut = argv[i];
+        }
+        else {
+            printf( "Usage: %s [results.json] [-c chipSizes] [-f frameWidths] [-t seconds] [-only function]\n", argv[0] );
+            return 1;
+        }
+    }
+
+    //The colors ProcessFrame takes out by default
+    map< String, bool > colors = PipelineSettings().colors;
+
+    printf( "%-22s %-20s %7s %10s %10s %10s %10s\n", "Function", "Input", "samples", "min ms", "p50 ms", "mean ms", "max ms" );
+    for ( size_t i = 0; i < frameWidths.size(); i++ ) {
+        BenchFrame( frameWidths[i], colors );
+    }
+    for ( size_t i = 0; i < chipSizes.size(); i++ ) {
+        BenchChip( chipSizes[i], colors );
+    }
+    BenchColorNames();
+
+    string text;
+    WriteRecordValue( text, timings );
+    FILE *file = fopen( resultsOut, "wb" );
+    if ( file == NULL || fwrite( text.data(), 1, text.size(), file ) != text.size() ) {
+        printf( "Could not write %s\n", resultsOut );
+        return 1;
+    }
+    fclose( file );
+    printf( "\n%zu timings written to %s\n", timings.size(), resultsOut );
+    return 0;
+}
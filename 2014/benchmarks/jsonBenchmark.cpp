@@ -0,0 +1,441 @@
+//
+//  jsonBenchmark.cpp
+//  capstone_functions
+//
+//  Throughput benchmarks for the JSON library on synthetic mission logs
+//  shaped like the output.json that main() writes.
+//
+//  Build: g++ -O2 -std=c++11 -I.. jsonBenchmark.cpp ../json.cpp ../targetRecord.cpp -o jsonBenchmark
+//
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include "json.h"
+#include "targetRecord.h"
+
+using namespace std;
+
+//Build a results array with the same layout main() produces: one object per frame
+//holding its timings and targets, followed by a trailing runtime object
+static json::Array BuildMission ( int frames, int targetsPerFrame ) {
+    static const char *letters[] = { "a", "b", "c", "d", "e", "f", "g", "h" };
+    static const char *colors[] = { "red", "orange", "yellow", "blue", "purple", "white" };
+    static const char *shapes[] = { "triangle", "4-gon", "pentagon", "hexagon", "circle" };
+    
+    json::Array mission;
+    
+    for ( int f = 0; f < frames; f++ ) {
+        json::Array targets;
+        
+        for ( int t = 0; t < targetsPerFrame; t++ ) {
+            int n = f * targetsPerFrame + t;
+            json::Object target;
+            target["letter"] = letters[n % 8];
+            target["letter_color"] = colors[n % 6];
+            target["shape"] = shapes[n % 5];
+            target["shape_color"] = colors[( n + 3 ) % 6];
+            target["x"] = ( n % 4000 ) * 7919 % 4000;
+            target["y"] = ( n % 3000 ) * 104729 % 3000;
+            target["target_time"] = "2";
+            targets.push_back( std::move( target ) );
+        }
+        
+        json::Object frame;
+        frame["candidate_time"] = "0";
+        frame["image_time"] = "4";
+        frame["targets"] = std::move( targets );
+        frame["covered_by"] = -1;
+        frame["quality"] = -1.0;
+        mission.push_back( std::move( frame ) );
+    }
+    
+    json::Object runtime;
+    runtime["runtime"] = 36.5;
+    mission.push_back( std::move( runtime ) );
+    
+    return mission;
+}
+
+//The serializer as it was before SerializeTo, kept here as the baseline to measure against:
+//every value returns its own string and callers concatenate temporaries
+static string LegacySerializeArray ( const json::Array& a );
+static string LegacySerialize ( const json::Value& v );
+
+static string LegacySerializeValue ( const json::Value& v ) {
+    string str;
+    static const int BUFF_SZ = 500;
+    char buff[BUFF_SZ];
+    
+    switch ( v.GetType() ) {
+        case json::IntVal: snprintf( buff, BUFF_SZ, "%d", v.ToInt() ); str = buff; break;
+        case json::FloatVal: snprintf( buff, BUFF_SZ, "%f", v.ToFloat() ); str = buff; break;
+        case json::DoubleVal: snprintf( buff, BUFF_SZ, "%f", v.ToDouble() ); str = buff; break;
+        case json::BoolVal: str = v.ToBool() ? "true" : "false"; break;
+        case json::NULLVal: str = "null"; break;
+        case json::ObjectVal: str = LegacySerialize( v ); break;
+        case json::ArrayVal: str = LegacySerializeArray( v.ToArray() ); break;
+        case json::StringVal: str = string( "\"" ) + v.ToString() + string( "\"" ); break;
+    }
+    
+    return str;
+}
+
+static string LegacySerializeArray ( const json::Array& a ) {
+    string str = "[";
+    
+    for ( size_t i = 0; i < a.size(); i++ ) {
+        if ( i != 0 ) {
+            str += string( "," );
+        }
+        str += LegacySerializeValue( a[i] );
+    }
+    
+    str += "]";
+    return str;
+}
+
+static string LegacySerialize ( const json::Value& v ) {
+    string str;
+    
+    if ( v.GetType() == json::ObjectVal ) {
+        str = "{";
+        json::Object obj = v.ToObject();
+        for ( json::Object::ValueMap::const_iterator it = obj.begin(); it != obj.end(); ++it ) {
+            if ( it != obj.begin() ) {
+                str += string( "," );
+            }
+            str += string( "\"" ) + it->first.str() + string( "\":" ) + LegacySerializeValue( it->second );
+        }
+        str += "}";
+    }
+    else if ( v.GetType() == json::ArrayVal ) {
+        str = LegacySerializeArray( v.ToArray() );
+    }
+    
+    return str;
+}
+
+static double Seconds ( chrono::steady_clock::time_point start ) {
+    return chrono::duration< double >( chrono::steady_clock::now() - start ).count();
+}
+
+static void BenchBuild ( int frames ) {
+    auto start = chrono::steady_clock::now();
+    json::Array mission = BuildMission( frames, 8 );
+    double built = Seconds( start );
+    
+    start = chrono::steady_clock::now();
+    mission.Clear();
+    double freed = Seconds( start );
+    
+    printf( "Build        %8d targets  %8.3f s build  %8.3f s free  (sizeof Value %zu, Object %zu)\n", frames * 8, built, freed, sizeof( json::Value ), sizeof( json::Object ) );
+}
+
+//Build and tear down the same document on the heap and in a json::Document arena
+static void BenchArena ( int targets ) {
+    int frames = targets / 8;
+    
+    auto start = chrono::steady_clock::now();
+    json::Value heap( BuildMission( frames, 8 ) );
+    double heapBuilt = Seconds( start );
+    
+    start = chrono::steady_clock::now();
+    heap.Clear();
+    heap = json::Value();
+    double heapFreed = Seconds( start );
+    
+    json::Document *doc = new json::Document;
+    start = chrono::steady_clock::now();
+    {
+        json::ArenaScope scope( *doc );
+        doc->Root() = BuildMission( frames, 8 );
+    }
+    double arenaBuilt = Seconds( start );
+    size_t used = doc->GetArena().BytesUsed(), reserved = doc->GetArena().BytesReserved();
+    
+    start = chrono::steady_clock::now();
+    delete doc;
+    double arenaFreed = Seconds( start );
+    
+    printf( "Arena        %8d targets  heap %.3f s build %.3f s free  arena %.3f s build %.3f s free  (%.1f/%.1f MB used/reserved)\n", frames * 8, heapBuilt, heapFreed, arenaBuilt, arenaFreed, used / ( 1024.0 * 1024.0 ), reserved / ( 1024.0 * 1024.0 ) );
+    
+    //Same again for a parsed document
+    string text = json::Serialize( BuildMission( frames, 8 ) );
+    
+    start = chrono::steady_clock::now();
+    json::Value parsed = json::Deserialize( text );
+    double heapParsed = Seconds( start );
+    
+    start = chrono::steady_clock::now();
+    parsed = json::Value();
+    heapFreed = Seconds( start );
+    
+    doc = new json::Document;
+    start = chrono::steady_clock::now();
+    doc->Parse( text.data(), text.size() );
+    double arenaParsed = Seconds( start );
+    
+    start = chrono::steady_clock::now();
+    delete doc;
+    arenaFreed = Seconds( start );
+    
+    printf( "Arena parse  %8d targets  heap %.3f s parse %.3f s free  arena %.3f s parse %.3f s free\n", frames * 8, heapParsed, heapFreed, arenaParsed, arenaFreed );
+}
+
+//Emit path as main() runs it: one frame at a time, either through a Value tree or
+//straight from the typed records, then read back through the record descriptors
+static void BenchRecords ( int frames ) {
+    static const char *letters[] = { "a", "b", "c", "d", "e", "f", "g", "h" };
+    static const char *colors[] = { "red", "orange", "yellow", "blue", "purple", "white" };
+    static const char *shapes[] = { "triangle", "4-gon", "pentagon", "hexagon", "circle" };
+    
+    auto start = chrono::steady_clock::now();
+    json::Array mission = BuildMission( frames, 8 );
+    string treeText = json::Serialize( mission );
+    double treeElapsed = Seconds( start );
+    
+    start = chrono::steady_clock::now();
+    MissionWriter writer;
+    FrameRecord frame;
+    for ( int f = 0; f < frames; f++ ) {
+        frame.targets.clear();
+        for ( int t = 0; t < 8; t++ ) {
+            int n = f * 8 + t;
+            TargetRecord target;
+            target.letter = letters[n % 8];
+            target.letter_color = colors[n % 6];
+            target.shape = shapes[n % 5];
+            target.shape_color = colors[( n + 3 ) % 6];
+            target.x = ( n % 4000 ) * 7919 % 4000;
+            target.y = ( n % 3000 ) * 104729 % 3000;
+            target.target_time = "2";
+            frame.targets.push_back( std::move( target ) );
+        }
+        frame.candidate_time = "0";
+        frame.image_time = "4";
+        writer.AddFrame( frame );
+    }
+    const string &recordText = writer.Finish( 36.5 );
+    double recordElapsed = Seconds( start );
+    
+    start = chrono::steady_clock::now();
+    vector< FrameRecord > parsed;
+    double runtime = 0;
+    bool ok = ReadMission( recordText.data(), recordText.size(), parsed, &runtime );
+    double readElapsed = Seconds( start );
+    
+    double mb = recordText.size() / ( 1024.0 * 1024.0 );
+    printf( "Records      %8.2f MB  build+write %.3f s  (Value tree %.3f s)  read %.3f s %.1f MB/s  %s\n", mb, recordElapsed, treeElapsed, readElapsed, mb / readElapsed, ( ok && recordText == treeText ) ? "identical" : "MISMATCH" );
+}
+
+static void BenchDeserialize ( int frames ) {
+    string text = json::Serialize( BuildMission( frames, 8 ) );
+    double mb = text.size() / ( 1024.0 * 1024.0 );
+    
+    auto start = chrono::steady_clock::now();
+    size_t errorOffset = 0;
+    json::Value parsed = json::Deserialize( text, &errorOffset );
+    double elapsed = Seconds( start );
+    
+    if ( parsed.GetType() != json::ArrayVal ) {
+        printf( "Deserialize failed at offset %zu\n", errorOffset );
+        return;
+    }
+    
+    printf( "Deserialize  %8.2f MB  %8.3f s  %8.1f MB/s\n", mb, elapsed, mb / elapsed );
+}
+
+static void BenchSerialize ( int frames ) {
+    json::Value mission( BuildMission( frames, 8 ) );
+    
+    auto start = chrono::steady_clock::now();
+    string legacy = LegacySerialize( mission );
+    double legacyElapsed = Seconds( start );
+    
+    start = chrono::steady_clock::now();
+    string text;
+    json::SerializeTo( mission, text );
+    double elapsed = Seconds( start );
+    
+    double mb = text.size() / ( 1024.0 * 1024.0 );
+    printf( "Serialize    %8.2f MB  %8.3f s  %8.1f MB/s  (legacy %.3f s, %.1f MB/s)\n", mb, elapsed, mb / elapsed, legacyElapsed, legacy.size() / ( 1024.0 * 1024.0 ) / legacyElapsed );
+}
+
+//Size and speed of the CBOR encoding next to JSON text for the same mission
+static void BenchCBOR ( int frames ) {
+    json::Value mission( BuildMission( frames, 8 ) );
+    string text, bytes;
+    json::SerializeTo( mission, text );
+    
+    auto start = chrono::steady_clock::now();
+    json::EncodeCBOR( mission, bytes );
+    double encodeElapsed = Seconds( start );
+    
+    start = chrono::steady_clock::now();
+    size_t errorOffset = 0;
+    json::Value decoded = json::DecodeCBOR( bytes, &errorOffset );
+    double decodeElapsed = Seconds( start );
+    
+    start = chrono::steady_clock::now();
+    json::Value parsed = json::Deserialize( text );
+    double parseElapsed = Seconds( start );
+    
+    double mb = text.size() / ( 1024.0 * 1024.0 );
+    printf( "CBOR         %8.2f MB  (JSON %.2f MB, %.0f%%)  encode %.3f s  decode %.3f s  (JSON parse %.3f s)  %s\n", bytes.size() / ( 1024.0 * 1024.0 ), mb, 100.0 * bytes.size() / text.size(), encodeElapsed, decodeElapsed, parseElapsed, ( errorOffset == string::npos && decoded == mission ) ? "identical" : "MISMATCH" );
+}
+
+static void BenchNumbers ( void ) {
+    const int count = 1000000;
+    static const int BUFF_SZ = 500;
+    char buff[BUFF_SZ];
+    string out;
+    
+    //Old path: snprintf into a stack buffer, then a temporary string per value
+    auto start = chrono::steady_clock::now();
+    for ( int i = 0; i < count; i++ ) {
+        snprintf( buff, BUFF_SZ, "%d", ( i % 100000 ) * 7919 );
+        out += string( buff );
+    }
+    double legacyInts = Seconds( start );
+    
+    out.clear();
+    start = chrono::steady_clock::now();
+    for ( int i = 0; i < count; i++ ) {
+        json::WriteInt( out, ( i % 100000 ) * 7919 );
+    }
+    double ints = Seconds( start );
+    
+    out.clear();
+    start = chrono::steady_clock::now();
+    for ( int i = 0; i < count; i++ ) {
+        snprintf( buff, BUFF_SZ, "%f", i / 7.0 );
+        out += string( buff );
+    }
+    double legacyDoubles = Seconds( start );
+    
+    out.clear();
+    start = chrono::steady_clock::now();
+    for ( int i = 0; i < count; i++ ) {
+        json::WriteDouble( out, i / 7.0 );
+    }
+    double doubles = Seconds( start );
+    
+    printf( "Ints         %8.1f M/s  (legacy %.1f M/s)\n", count / ints / 1e6, count / legacyInts / 1e6 );
+    printf( "Doubles      %8.1f M/s  (legacy %%f %.1f M/s, which truncates to 6 decimals)\n", count / doubles / 1e6, count / legacyDoubles / 1e6 );
+}
+
+static void BenchStrings ( size_t length ) {
+    //Mostly plain ASCII with the occasional quote, the kind of text Tesseract hands back
+    string payload;
+    for ( size_t i = 0; i < length; i++ ) {
+        payload.push_back( ( i % 97 == 96 ) ? '"' : ( char )( 'a' + i % 26 ) );
+    }
+    
+    const size_t totalBytes = 256 * 1024 * 1024;
+    size_t count = totalBytes / length;
+    string out;
+    out.reserve( ( length + 16 ) * 1024 );
+    
+    //Baseline: what unescaped output costs, quotes plus a memcpy
+    auto start = chrono::steady_clock::now();
+    for ( size_t i = 0; i < count; i++ ) {
+        if ( i % 1024 == 0 ) {
+            out.clear();
+        }
+        out += '"';
+        out.append( payload );
+        out += '"';
+    }
+    double copyElapsed = Seconds( start );
+    
+    start = chrono::steady_clock::now();
+    for ( size_t i = 0; i < count; i++ ) {
+        if ( i % 1024 == 0 ) {
+            out.clear();
+        }
+        json::WriteString( out, payload );
+    }
+    double escapeElapsed = Seconds( start );
+    
+    start = chrono::steady_clock::now();
+    size_t valid = 0;
+    for ( size_t i = 0; i < count; i++ ) {
+        valid += json::IsValidUTF8( payload );
+    }
+    double validateElapsed = Seconds( start );
+    
+    double mb = totalBytes / ( 1024.0 * 1024.0 );
+    printf( "String %5zu B  escape %7.0f MB/s  validate %7.0f MB/s  memcpy %7.0f MB/s  (%zu valid)\n", length, mb / escapeElapsed, mb / validateElapsed, mb / copyElapsed, valid );
+}
+
+static void BenchReader ( int frames ) {
+    const char *path = "jsonBenchmark.tmp.json";
+    string text = json::Serialize( BuildMission( frames, 8 ) );
+    double mb = text.size() / ( 1024.0 * 1024.0 );
+    
+    FILE *file = fopen( path, "wb" );
+    if ( file == NULL ) {
+        printf( "Could not write %s\n", path );
+        return;
+    }
+    fwrite( text.data(), 1, text.size(), file );
+    fclose( file );
+    
+    //Pull just the fields scoring needs out of every target, the way a scorer would
+    auto start = chrono::steady_clock::now();
+    json::Reader reader;
+    long targets = 0, checksum = 0;
+    
+    if ( reader.Open( path ) ) {
+        for ( json::ReaderEvent e = reader.Next(); e != json::EndOfDocumentEvent && e != json::ErrorEvent; e = reader.Next() ) {
+            if ( e != json::KeyEvent ) {
+                continue;
+            }
+            
+            //GetString() is reused by the next event, so classify the key before reading its value
+            const string &key = reader.GetString();
+            bool isLetter = ( key == "letter" );
+            if ( isLetter || key == "shape" ) {
+                if ( reader.Next() == json::StringEvent ) {
+                    checksum += reader.GetString().size();
+                    targets += isLetter;
+                }
+            }
+            else if ( key == "x" || key == "y" ) {
+                if ( reader.Next() == json::NumberEvent ) {
+                    checksum += reader.GetInt();
+                }
+            }
+        }
+    }
+    
+    double elapsed = Seconds( start );
+    remove( path );
+    
+    printf( "Reader scan  %8.2f MB  %8.3f s  %8.1f MB/s  (%ld targets, checksum %ld)\n", mb, elapsed, mb / elapsed, targets, checksum );
+}
+
+int main ( void ) {
+    //Roughly 1, 4 and 16 MB documents; throughput should stay flat as size grows
+    int frames[] = { 1000, 4000, 16000 };
+    
+    for ( size_t i = 0; i < sizeof( frames )/sizeof( *frames ); i++ ) {
+        BenchBuild( frames[i] );
+        BenchSerialize( frames[i] );
+        BenchDeserialize( frames[i] );
+        BenchRecords( frames[i] );
+        BenchCBOR( frames[i] );
+        BenchReader( frames[i] );
+    }
+    
+    BenchArena( 50000 );
+    BenchNumbers();
+    
+    size_t lengths[] = { 8, 64, 1024, 16384 };
+    for ( size_t i = 0; i < sizeof( lengths )/sizeof( *lengths ); i++ ) {
+        BenchStrings( lengths[i] );
+    }
+    
+    return 0;
+}
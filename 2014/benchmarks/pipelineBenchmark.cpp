@@ -0,0 +1,167 @@
+//
+//  pipelineBenchmark.cpp
+//  capstone_functions
+//
+//  End to end throughput of the detection pipeline on a synthetic corpus
+//  (syntheticTargets.h). The corpus is rendered into <corpusDir> the first
+//  time, along with its truth.json, and reused after that. Every frame is then
+//  decoded and run through ProcessFrame with 1, 2, 4, ... worker threads,
+//  each with its own BufferPool, pulling frames from a shared counter. For
+//  each thread count it reports frames/sec, candidates/sec and the p50, p90
+//  and p99 latency of every stage.
+//
+//  Build: g++ -O2 -std=c++11 -I.. pipelineBenchmark.cpp ../pipeline.cpp ../quickReject.cpp ../duplicateFilter.cpp ../frameRegistration.cpp ../frameQuality.cpp ../projectFunctions.cpp ../tiledDetection.cpp ../jpegRegions.cpp ../imageIngest.cpp ../bufferPool.cpp
+//         ../stageProfiler.cpp ../perfCounters.cpp ../syntheticTargets.cpp ../targetRecord.cpp ../json.cpp
+//         -o pipelineBenchmark -pthread `pkg-config --cflags --libs opencv tesseract`
+//
+//  Usage: pipelineBenchmark <corpusDir> [frames] [threads ...]
+//         defaults: 24 frames, threads 1 2 4 ... up to the number of cores
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "pipeline.h"
+#include "syntheticTargets.h"
+
+using namespace std;
+
+struct RunResult {
+    int threads;
+    double seconds;
+    long frames;
+    long candidates;
+    long targets;
+};
+
+//Renders the corpus unless one of the right length is already there
+static bool PrepareCorpus ( const string &dir, int frames ) {
+    vector< TruthFrame > truth;
+    if ( ReadTruth( dir + "/truth.json", truth ) && ( int )truth.size() == frames ) {
+        printf( "Using the corpus in %s\n", dir.c_str() );
+        return true;
+    }
+
+    printf( "Rendering %d frames into %s..\n", frames, dir.c_str() );
+    auto start = chrono::steady_clock::now();
+    if ( !GenerateSyntheticCorpus( dir, frames, SyntheticSettings() ) ) {
+        return false;
+    }
+    printf( "Rendered in %.1fs\n", chrono::duration< double >( chrono::steady_clock::now() - start ).count() );
+    return true;
+}
+
+static void Worker ( const string &dir, int frames, atomic< int > *next, atomic< long > *candidates, atomic< long > *targets ) {
+    PipelineSettings settings;
+    BufferPool pool;
+    FrameRecord frame;
+
+    for ( int i = next->fetch_add( 1 ); i < frames; i = next->fetch_add( 1 ) ) {
+        ostringstream path;
+        path << dir << "/" << i << ".jpg";
+
+        pool.NextFrame();
+        Mat original = CreateMatFromImage( path.str(), &pool );
+        candidates->fetch_add( ProcessFrame( original, settings, &pool, frame ) );
+        targets->fetch_add( ( long )frame.targets.size() );
+    }
+}
+
+static RunResult Run ( const string &dir, int frames, int threads ) {
+    atomic< int > next( 0 );
+    atomic< long > candidates( 0 ), targets( 0 );
+    vector< thread > workers;
+
+    ResetStageStats();
+
+    //The pipeline prints as it goes; keep that out of the report
+    fflush( stdout );
+    int savedStdout = dup( STDOUT_FILENO ), devNull = open( "/dev/null", O_WRONLY );
+    dup2( devNull, STDOUT_FILENO );
+
+    auto start = chrono::steady_clock::now();
+    for ( int i = 0; i < threads; i++ ) {
+        workers.push_back( thread( Worker, dir, frames, &next, &candidates, &targets ) );
+    }
+    for ( size_t i = 0; i < workers.size(); i++ ) {
+        workers[i].join();
+    }
+    double seconds = chrono::duration< double >( chrono::steady_clock::now() - start ).count();
+
+    fflush( stdout );
+    dup2( savedStdout, STDOUT_FILENO );
+    close( savedStdout );
+    close( devNull );
+
+    RunResult result;
+    result.threads = threads;
+    result.seconds = seconds;
+    result.frames = frames;
+    result.candidates = candidates.load();
+    result.targets = targets.load();
+    return result;
+}
+
+static void PrintRun ( const RunResult &run ) {
+    printf( "\n%d thread%s: %ld frames in %.2fs, %.2f frames/s, %.2f candidates/s, %.2f targets/s\n", run.threads, ( run.threads == 1 ) ? "" : "s",
+            run.frames, run.seconds, run.frames / run.seconds, run.candidates / run.seconds, run.targets / run.seconds );
+    printf( "  %-22s %8s %9s %9s %9s %9s\n", "Stage", "calls", "p50 ms", "p90 ms", "p99 ms", "max ms" );
+
+    for ( int i = 0; i < STAGE_COUNT; i++ ) {
+        const LatencyHistogram &timing = GetStageTiming( ( PipelineStage )i );
+        if ( timing.Count() == 0 ) {
+            continue;
+        }
+        printf( "  %-22s %8ld %9.3f %9.3f %9.3f %9.3f\n", StageName( ( PipelineStage )i ), timing.Count(),
+                timing.Percentile( 50 ) * 1e3, timing.Percentile( 90 ) * 1e3, timing.Percentile( 99 ) * 1e3, timing.MaxSeconds() * 1e3 );
+    }
+}
+
+int main ( int argc, char **argv ) {
+    if ( argc < 2 ) {
+        printf( "Usage: %s <corpusDir> [frames] [threads ...]\n", argv[0] );
+        return 1;
+    }
+
+    string dir = argv[1];
+    int frames = ( argc > 2 ) ? atoi( argv[2] ) : 24;
+
+    vector< int > threadCounts;
+    for ( int i = 3; i < argc; i++ ) {
+        threadCounts.push_back( max( 1, atoi( argv[i] ) ) );
+    }
+    if ( threadCounts.empty() ) {
+        int cores = max( 1, ( int )thread::hardware_concurrency() );
+        for ( int t = 1; t < cores; t *= 2 ) {
+            threadCounts.push_back( t );
+        }
+        threadCounts.push_back( cores );
+    }
+
+    if ( frames < 1 || !PrepareCorpus( dir, frames ) ) {
+        printf( "Could not prepare the corpus\n" );
+        return 1;
+    }
+
+    //One untimed pass so every run finds the files in the page cache
+    Run( dir, frames, threadCounts.back() );
+
+    vector< RunResult > runs;
+    for ( size_t i = 0; i < threadCounts.size(); i++ ) {
+        runs.push_back( Run( dir, frames, threadCounts[i] ) );
+        PrintRun( runs.back() );
+    }
+
+    printf( "\n%8s %10s %12s %14s %9s\n", "threads", "frames/s", "candidates/s", "targets/s", "speedup" );
+    for ( size_t i = 0; i < runs.size(); i++ ) {
+        printf( "%8d %10.2f %12.2f %14.2f %8.2fx\n", runs[i].threads, runs[i].frames / runs[i].seconds, runs[i].candidates / runs[i].seconds,
+                runs[i].targets / runs[i].seconds, runs[0].seconds / runs[i].seconds );
+    }
+
+    return 0;
+}
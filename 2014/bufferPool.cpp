@@ -0,0 +1,88 @@
+//
+//  bufferPool.cpp
+//  capstone_functions
+//
+
+#include "bufferPool.h"
+
+using namespace cv;
+
+BufferPool::BufferPool () : frame( 0 ) {
+}
+
+//A buffer is free when the pool holds the only reference to it
+bool BufferPool::IsFree ( const Mat &buffer ) {
+#if CV_MAJOR_VERSION >= 3
+    return buffer.u != NULL && buffer.u->refcount == 1;
+#else
+    return buffer.refcount != NULL && *buffer.refcount == 1;
+#endif
+}
+
+void BufferPool::CountAllocation ( const Mat &buffer ) {
+    size_t bytes = buffer.total() * buffer.elemSize();
+    frameStats.allocations++;
+    frameStats.bytesAllocated += bytes;
+    totalStats.allocations++;
+    totalStats.bytesAllocated += bytes;
+}
+
+Mat BufferPool::Acquire ( Size size, int type ) {
+    for ( size_t i = 0; i < entries.size(); i++ ) {
+        Mat &buffer = entries[i].buffer;
+        if ( buffer.rows == size.height && buffer.cols == size.width && buffer.type() == type && IsFree( buffer ) ) {
+            entries[i].lastUsed = frame;
+            frameStats.reuses++;
+            totalStats.reuses++;
+            return buffer;
+        }
+    }
+
+    Entry entry;
+    entry.buffer.create( size, type );
+    entry.lastUsed = frame;
+    entries.push_back( entry );
+    CountAllocation( entry.buffer );
+    return entry.buffer;
+}
+
+void BufferPool::Adopt ( const Mat &buffer ) {
+    if ( buffer.empty() ) {
+        return;
+    }
+
+    Entry entry;
+    entry.buffer = buffer;
+    entry.lastUsed = frame;
+    entries.push_back( entry );
+    CountAllocation( buffer );
+}
+
+void BufferPool::NextFrame () {
+    frame++;
+    frameStats = BufferPoolStats();
+
+    //Let go of buffers nobody has asked for in a while (after a change of frame size, say)
+    for ( size_t i = 0; i < entries.size(); ) {
+        if ( frame - entries[i].lastUsed > IDLE_FRAMES && IsFree( entries[i].buffer ) ) {
+            entries[i] = entries.back();
+            entries.pop_back();
+        }
+        else {
+            i++;
+        }
+    }
+}
+
+size_t BufferPool::GetPooledBytes () const {
+    size_t bytes = 0;
+    for ( size_t i = 0; i < entries.size(); i++ ) {
+        bytes += entries[i].buffer.total() * entries[i].buffer.elemSize();
+    }
+    return bytes;
+}
+
+void BufferPool::PrintFrameStats ( long frameNumber, FILE *out ) const {
+    fprintf( out, "Frame %ld buffers: %ld allocated (%.1f MB), %ld reused, %.1f MB pooled\n", frameNumber, frameStats.allocations,
+             frameStats.bytesAllocated / ( 1024.0 * 1024.0 ), frameStats.reuses, GetPooledBytes() / ( 1024.0 * 1024.0 ) );
+}
@@ -0,0 +1,71 @@
+//
+//  bufferPool.h
+//  capstone_functions
+//
+//  Recycles the full resolution Mats a frame goes through (the decoded
+//  image, HSV copy, masks, grayscale and binary images) so that once the
+//  first frame has been processed, later frames of the same size allocate
+//  nothing. A buffer is free again as soon as nothing but the pool refers
+//  to it, so it can even be reused later in the same frame.
+//
+//  Not thread safe: give each worker thread its own pool.
+//
+
+#ifndef __capstone_functions__bufferPool__
+#define __capstone_functions__bufferPool__
+
+#include <stdio.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+struct BufferPoolStats {
+    long allocations;       //buffers the pool had to allocate
+    long reuses;            //requests served from an existing buffer
+    size_t bytesAllocated;
+
+    BufferPoolStats () : allocations( 0 ), reuses( 0 ), bytesAllocated( 0 ) {}
+};
+
+class BufferPool {
+public:
+    //Buffers that go this many frames without being asked for are let go
+    static const int IDLE_FRAMES = 8;
+
+    BufferPool ();
+
+    //Returns a Mat of the given size and type, reusing a free buffer if one matches. Contents are undefined.
+    cv::Mat Acquire ( cv::Size size, int type );
+
+    //Takes over a buffer something else allocated (e.g. a decoder that couldn't use the one it was given),
+    //counting it as an allocation
+    void Adopt ( const cv::Mat &buffer );
+
+    //Call at the start of every frame: resets the frame counters and lets go of idle buffers
+    void NextFrame ();
+
+    //Size of the last full frame, so the decoder can be handed a buffer before it knows the size itself
+    cv::Size GetFrameSize () const { return frameSize; }
+    void SetFrameSize ( cv::Size size ) { frameSize = size; }
+
+    const BufferPoolStats &GetFrameStats () const { return frameStats; }
+    const BufferPoolStats &GetTotalStats () const { return totalStats; }
+    size_t GetPooledBytes () const;
+    void PrintFrameStats ( long frame, FILE *out = stdout ) const;
+
+private:
+    struct Entry {
+        cv::Mat buffer;
+        long lastUsed;
+    };
+
+    static bool IsFree ( const cv::Mat &buffer );
+    void CountAllocation ( const cv::Mat &buffer );
+
+    std::vector< Entry > entries;
+    cv::Size frameSize;
+    long frame;
+    BufferPoolStats frameStats;
+    BufferPoolStats totalStats;
+};
+
+#endif /* defined(__capstone_functions__bufferPool__) */
@@ -0,0 +1,376 @@
+//
+//  chipArchive.cpp
+//  capstone_functions
+//
+
+#include "chipArchive.h"
+#include <string.h>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/*
+ On disk, everything little endian:
+   .pack  "CHIPPAK1", then encoded images
+   .idx   "CHIPIDX1", u32 entry size, u32 reserved, then CHIP_ENTRY_SZ byte entries:
+          u32 frame, u32 candidate, i32 x, y, width, height, u64 offset,
+          u32 length, u8 kind, u8 format, label (CHIP_LABEL_SZ bytes, zero padded)
+ */
+static const char PACK_MAGIC[] = "CHIPPAK1";
+static const char INDEX_MAGIC[] = "CHIPIDX1";
+static const size_t MAGIC_SZ = 8;
+static const size_t PACK_HEADER_SZ = MAGIC_SZ;
+static const size_t INDEX_HEADER_SZ = MAGIC_SZ + 8;
+static const size_t CHIP_ENTRY_SZ = 38 + CHIP_LABEL_SZ;
+
+static void Put32 ( unsigned char *p, uint32_t v ) {
+    for ( int i = 0; i < 4; i++ ) {
+        p[i] = ( unsigned char )( v >> ( 8 * i ) );
+    }
+}
+
+static void Put64 ( unsigned char *p, uint64_t v ) {
+    for ( int i = 0; i < 8; i++ ) {
+        p[i] = ( unsigned char )( v >> ( 8 * i ) );
+    }
+}
+
+static uint32_t Get32 ( const unsigned char *p ) {
+    return ( uint32_t )p[0] | ( ( uint32_t )p[1] << 8 ) | ( ( uint32_t )p[2] << 16 ) | ( ( uint32_t )p[3] << 24 );
+}
+
+static uint64_t Get64 ( const unsigned char *p ) {
+    return ( uint64_t )Get32( p ) | ( ( uint64_t )Get32( p + 4 ) << 32 );
+}
+
+static void EncodeEntry ( const ChipEntry &entry, unsigned char *p ) {
+    Put32( p, entry.frame );
+    Put32( p + 4, entry.candidate );
+    Put32( p + 8, ( uint32_t )entry.x );
+    Put32( p + 12, ( uint32_t )entry.y );
+    Put32( p + 16, ( uint32_t )entry.width );
+    Put32( p + 20, ( uint32_t )entry.height );
+    Put64( p + 24, entry.offset );
+    Put32( p + 32, entry.length );
+    p[36] = entry.kind;
+    p[37] = entry.format;
+    memset( p + 38, 0, CHIP_LABEL_SZ );
+    memcpy( p + 38, entry.label, strnlen( entry.label, CHIP_LABEL_SZ ) );
+}
+
+static ChipEntry DecodeEntry ( const unsigned char *p ) {
+    ChipEntry entry;
+    entry.frame = Get32( p );
+    entry.candidate = Get32( p + 4 );
+    entry.x = ( int32_t )Get32( p + 8 );
+    entry.y = ( int32_t )Get32( p + 12 );
+    entry.width = ( int32_t )Get32( p + 16 );
+    entry.height = ( int32_t )Get32( p + 20 );
+    entry.offset = Get64( p + 24 );
+    entry.length = Get32( p + 32 );
+    entry.kind = p[36];
+    entry.format = p[37];
+    memcpy( entry.label, p + 38, CHIP_LABEL_SZ );
+    entry.label[CHIP_LABEL_SZ] = '\0';
+    return entry;
+}
+
+void ChipEntry::SetLabel ( const string &text ) {
+    size_t length = min( text.size(), ( size_t )CHIP_LABEL_SZ );
+    memcpy( label, text.data(), length );
+    label[length] = '\0';
+}
+
+void ChipEntry::SetBoundingBox ( const cv::Mat &chip ) {
+    cv::Size wholeSize;
+    cv::Point ofs;
+    chip.locateROI( wholeSize, ofs );
+    x = ofs.x;
+    y = ofs.y;
+    width = chip.cols;
+    height = chip.rows;
+}
+
+/*
+ Writer
+ */
+ChipArchiveWriter::ChipArchiveWriter () : pack( NULL ), index( NULL ), packSize( 0 ) {
+}
+
+ChipArchiveWriter::~ChipArchiveWriter () {
+    Close();
+}
+
+//Size of the file at path, or -1 if it doesn't exist
+static long long FileSize ( const string &path ) {
+    FILE *file = fopen( path.c_str(), "rb" );
+    if ( file == NULL ) {
+        return -1;
+    }
+    fseek( file, 0, SEEK_END );
+    long long size = ftell( file );
+    fclose( file );
+    return size;
+}
+
+static bool HasMagic ( const string &path, const char *magic ) {
+    char header[MAGIC_SZ];
+    FILE *file = fopen( path.c_str(), "rb" );
+    if ( file == NULL ) {
+        return false;
+    }
+    bool ok = fread( header, 1, MAGIC_SZ, file ) == MAGIC_SZ && memcmp( header, magic, MAGIC_SZ ) == 0;
+    fclose( file );
+    return ok;
+}
+
+bool ChipArchiveWriter::Open ( const string &base ) {
+    Close();
+
+    string packPath = base + ".pack", indexPath = base + ".idx";
+    long long existingPack = FileSize( packPath ), existingIndex = FileSize( indexPath );
+
+    if ( existingPack > 0 || existingIndex > 0 ) {
+        //Appending to an earlier run's archive
+        if ( !HasMagic( packPath, PACK_MAGIC ) || !HasMagic( indexPath, INDEX_MAGIC ) ) {
+            printf( "%s is not a chip archive, not appending to it\n", base.c_str() );
+            return false;
+        }
+
+        //Drop a half written index entry left by a run that died, so new entries line up
+        long long partial = ( existingIndex - INDEX_HEADER_SZ ) % CHIP_ENTRY_SZ;
+        if ( partial != 0 ) {
+#ifndef WIN32
+            if ( truncate( indexPath.c_str(), existingIndex - partial ) != 0 ) {
+                return false;
+            }
+#else
+            return false;
+#endif
+        }
+    }
+
+    pack = fopen( packPath.c_str(), "ab" );
+    index = fopen( indexPath.c_str(), "ab" );
+    if ( pack == NULL || index == NULL ) {
+        Close();
+        return false;
+    }
+
+    //Without its header a file is rejected as not an archive, taking every chip in it along. So if
+    //a header can't be written nothing is archived, and the new files are emptied again so the next
+    //run starts them over instead of refusing them.
+    bool newPack = existingPack <= 0, newIndex = existingIndex <= 0, written = true;
+    if ( newPack ) {
+        written = fwrite( PACK_MAGIC, 1, MAGIC_SZ, pack ) == MAGIC_SZ && fflush( pack ) == 0;
+        existingPack = PACK_HEADER_SZ;
+    }
+    if ( written && newIndex ) {
+        unsigned char header[INDEX_HEADER_SZ];
+        memcpy( header, INDEX_MAGIC, MAGIC_SZ );
+        Put32( header + MAGIC_SZ, ( uint32_t )CHIP_ENTRY_SZ );
+        Put32( header + MAGIC_SZ + 4, 0 );
+        written = fwrite( header, 1, INDEX_HEADER_SZ, index ) == INDEX_HEADER_SZ && fflush( index ) == 0;
+    }
+    if ( !written ) {
+        CloseFiles();
+#ifndef WIN32
+        if ( ( newPack && truncate( packPath.c_str(), 0 ) != 0 ) || ( newIndex && truncate( indexPath.c_str(), 0 ) != 0 ) ) {
+            printf( "Could not empty %s again after failing to write its headers\n", base.c_str() );
+        }
+#endif
+        return false;
+    }
+
+    packSize = ( uint64_t )existingPack;
+    return true;
+}
+
+void ChipArchiveWriter::Close () {
+    lock_guard< mutex > guard( lock );
+    CloseFiles();
+}
+
+void ChipArchiveWriter::CloseFiles () {
+    if ( pack != NULL ) {
+        fclose( pack );
+        pack = NULL;
+    }
+    if ( index != NULL ) {
+        fclose( index );
+        index = NULL;
+    }
+}
+
+bool ChipArchiveWriter::Append ( ChipEntry entry, const unsigned char *data, size_t length ) {
+    lock_guard< mutex > guard( lock );
+    if ( pack == NULL ) {
+        return false;
+    }
+
+    //Image first: an entry is only ever written for bytes that are already in the pack
+    if ( fwrite( data, 1, length, pack ) != length || fflush( pack ) != 0 ) {
+        //Part of it may have landed anyway, so the next offset comes from where the file actually ends
+        long long end = ftell( pack );
+        if ( end < 0 ) {
+            CloseFiles();
+        }
+        else {
+            packSize = ( uint64_t )end;
+        }
+        return false;
+    }
+
+    entry.offset = packSize;
+    entry.length = ( uint32_t )length;
+    packSize += length;
+
+    unsigned char encoded[CHIP_ENTRY_SZ];
+    EncodeEntry( entry, encoded );
+    if ( fwrite( encoded, 1, CHIP_ENTRY_SZ, index ) != CHIP_ENTRY_SZ || fflush( index ) != 0 ) {
+        //A partial entry would shift every entry after it, so the archive stops here. The next Open drops it.
+        CloseFiles();
+        return false;
+    }
+    return true;
+}
+
+bool ChipArchiveWriter::Append ( const ChipEntry &entry, const cv::Mat &image, const vector< int > &params ) {
+    vector< uchar > encoded;
+    if ( image.empty() || !cv::imencode( entry.Extension(), image, encoded, params ) ) {
+        return false;
+    }
+    return Append( entry, encoded.empty() ? NULL : &encoded[0], encoded.size() );
+}
+
+/*
+ Reader
+ */
+ChipArchiveReader::ChipArchiveReader () : entryCount( 0 ) {
+}
+
+ChipArchiveReader::~ChipArchiveReader () {
+    Close();
+}
+
+bool ChipArchiveReader::Map ( const string &path, Mapping &mapping ) {
+#ifndef WIN32
+    int fd = open( path.c_str(), O_RDONLY );
+    if ( fd < 0 ) {
+        return false;
+    }
+
+    struct stat info;
+    if ( fstat( fd, &info ) != 0 || info.st_size == 0 ) {
+        close( fd );
+        return false;
+    }
+
+    void *mapped = mmap( NULL, ( size_t )info.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( mapped == MAP_FAILED ) {
+        return false;
+    }
+
+    //Chips are pulled out one at a time in no particular order
+    madvise( mapped, ( size_t )info.st_size, MADV_RANDOM );
+
+    mapping.mapped = mapped;
+    mapping.data = ( const unsigned char * )mapped;
+    mapping.length = ( size_t )info.st_size;
+    return true;
+#else
+    FILE *file = fopen( path.c_str(), "rb" );
+    if ( file == NULL ) {
+        return false;
+    }
+    fseek( file, 0, SEEK_END );
+    long size = ftell( file );
+    fseek( file, 0, SEEK_SET );
+    mapping.buffer.resize( size > 0 ? size : 0 );
+    bool ok = size > 0 && fread( &mapping.buffer[0], 1, size, file ) == ( size_t )size;
+    fclose( file );
+    mapping.data = ok ? &mapping.buffer[0] : NULL;
+    mapping.length = ok ? ( size_t )size : 0;
+    return ok;
+#endif
+}
+
+void ChipArchiveReader::Unmap ( Mapping &mapping ) {
+#ifndef WIN32
+    if ( mapping.mapped != NULL ) {
+        munmap( mapping.mapped, mapping.length );
+    }
+#endif
+    mapping.mapped = NULL;
+    mapping.data = NULL;
+    mapping.length = 0;
+    mapping.buffer.clear();
+}
+
+bool ChipArchiveReader::Open ( const string &base ) {
+    Close();
+
+    if ( !Map( base + ".pack", pack ) || !Map( base + ".idx", index ) ) {
+        Close();
+        return false;
+    }
+
+    if ( pack.length < PACK_HEADER_SZ || memcmp( pack.data, PACK_MAGIC, MAGIC_SZ ) != 0 ||
+         index.length < INDEX_HEADER_SZ || memcmp( index.data, INDEX_MAGIC, MAGIC_SZ ) != 0 ||
+         Get32( index.data + MAGIC_SZ ) != CHIP_ENTRY_SZ ) {
+        printf( "%s is not a chip archive\n", base.c_str() );
+        Close();
+        return false;
+    }
+
+    //Trust the index only as far as both files were completely written
+    entryCount = ( index.length - INDEX_HEADER_SZ ) / CHIP_ENTRY_SZ;
+    while ( entryCount > 0 ) {
+        ChipEntry last = GetEntry( entryCount - 1 );
+        if ( last.offset + last.length <= pack.length ) {
+            break;
+        }
+        entryCount--;
+    }
+
+    return true;
+}
+
+void ChipArchiveReader::Close () {
+    Unmap( pack );
+    Unmap( index );
+    entryCount = 0;
+}
+
+ChipEntry ChipArchiveReader::GetEntry ( size_t i ) const {
+    return DecodeEntry( index.data + INDEX_HEADER_SZ + i * CHIP_ENTRY_SZ );
+}
+
+const unsigned char *ChipArchiveReader::GetData ( size_t i, size_t *length ) const {
+    ChipEntry entry = GetEntry( i );
+    if ( entry.offset < PACK_HEADER_SZ || entry.offset + entry.length > pack.length ) {
+        *length = 0;
+        return NULL;
+    }
+    *length = entry.length;
+    return pack.data + entry.offset;
+}
+
+cv::Mat ChipArchiveReader::Decode ( size_t i, int flags ) const {
+    size_t length = 0;
+    const unsigned char *data = GetData( i, &length );
+    if ( data == NULL || length == 0 ) {
+        return cv::Mat();
+    }
+
+    //Decode straight out of the mapping, no copy
+    cv::Mat encoded( 1, ( int )length, CV_8UC1, ( void * )data );
+    return cv::imdecode( encoded, flags );
+}
@@ -0,0 +1,133 @@
+//
+//  chipArchive.h
+//  capstone_functions
+//
+//  Append-only archive of encoded chip images (candidates and targets).
+//  Rather than one small file per chip, a mission writes two files:
+//
+//    <name>.pack   the encoded images back to back
+//    <name>.idx    one fixed size entry per image: frame, candidate, kind,
+//                  bounding box in the frame, offset and length in the pack
+//
+//  Both files are only ever appended to, with the image written before its
+//  index entry, so a run that dies part way leaves an archive that's valid
+//  up to the last complete entry. The reader memory maps both files, so any
+//  chip can be pulled out without reading the rest. tools/chipExtract.cpp
+//  lists and extracts archives.
+//
+
+#ifndef __capstone_functions__chipArchive__
+#define __capstone_functions__chipArchive__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+
+enum ChipKind {
+    CHIP_CANDIDATE = 0,     //every blob FindCandidateTargets cut out
+    CHIP_TARGET = 1         //candidates that passed OCR
+};
+
+enum ChipFormat {
+    CHIP_JPEG = 0,
+    CHIP_PNG = 1
+};
+
+//Longest label kept in the index, the rest is cut off
+#define CHIP_LABEL_SZ 10
+
+struct ChipEntry {
+    uint32_t frame;
+    uint32_t candidate;
+    int32_t x, y, width, height;    //bounding box in the frame
+    uint64_t offset;                //position of the encoded image in the pack
+    uint32_t length;
+    uint8_t kind;                   //ChipKind
+    uint8_t format;                 //ChipFormat
+    char label[CHIP_LABEL_SZ + 1];  //e.g. the OCR result for targets, null terminated
+
+    ChipEntry () : frame( 0 ), candidate( 0 ), x( 0 ), y( 0 ), width( 0 ), height( 0 ), offset( 0 ), length( 0 ), kind( CHIP_CANDIDATE ), format( CHIP_JPEG ) { label[0] = '\0'; }
+
+    void SetLabel ( const std::string &text );
+
+    //Where chip (a view into frame, as FindCandidateTargets returns them) sits in its frame
+    void SetBoundingBox ( const cv::Mat &chip );
+
+    //File extension for format, including the dot
+    const char *Extension () const { return ( format == CHIP_PNG ) ? ".png" : ".jpg"; }
+};
+
+class ChipArchiveWriter {
+public:
+    ChipArchiveWriter ();
+    ~ChipArchiveWriter ();
+
+    //Opens (or creates) base + ".pack" and base + ".idx" for appending. Returns false if either can't be opened,
+    //isn't an archive, or is new and its header can't be written.
+    bool Open ( const std::string &base );
+    void Close ();
+    bool IsOpen () const { return pack != NULL; }
+
+    //Appends an already encoded image; entry's offset and length are filled in. Safe to call from any thread.
+    //If the index entry can't be written the archive is closed, since entries after a partial one wouldn't line up.
+    bool Append ( ChipEntry entry, const unsigned char *data, size_t length );
+
+    //Encodes image in entry.format with the given imencode params and appends it
+    bool Append ( const ChipEntry &entry, const cv::Mat &image, const std::vector< int > &params = std::vector< int >() );
+
+private:
+    ChipArchiveWriter ( const ChipArchiveWriter & );
+    ChipArchiveWriter &operator= ( const ChipArchiveWriter & );
+
+    //Close without taking the lock, for Append
+    void CloseFiles ();
+
+    FILE *pack;
+    FILE *index;
+    uint64_t packSize;
+    std::mutex lock;
+};
+
+class ChipArchiveReader {
+public:
+    ChipArchiveReader ();
+    ~ChipArchiveReader ();
+
+    //Maps base + ".pack" and base + ".idx". Index entries past the end of either file (a run cut short) are ignored.
+    bool Open ( const std::string &base );
+    void Close ();
+
+    size_t size () const { return entryCount; }
+    ChipEntry GetEntry ( size_t i ) const;
+
+    //The encoded bytes of entry i, straight out of the mapping
+    const unsigned char *GetData ( size_t i, size_t *length ) const;
+
+    //Decodes entry i (imread flags); returns an empty Mat if it can't be decoded
+    cv::Mat Decode ( size_t i, int flags = 1 ) const;
+
+private:
+    ChipArchiveReader ( const ChipArchiveReader & );
+    ChipArchiveReader &operator= ( const ChipArchiveReader & );
+
+    struct Mapping {
+        const unsigned char *data;
+        size_t length;
+        std::vector< unsigned char > buffer;    //used where mmap isn't available
+        void *mapped;
+
+        Mapping () : data( NULL ), length( 0 ), mapped( NULL ) {}
+    };
+
+    static bool Map ( const std::string &path, Mapping &mapping );
+    static void Unmap ( Mapping &mapping );
+
+    Mapping pack;
+    Mapping index;
+    size_t entryCount;
+};
+
+#endif /* defined(__capstone_functions__chipArchive__) */
@@ -0,0 +1,97 @@
+//
+//  duplicateFilter.cpp
+//  capstone_functions
+//
+
+#include "duplicateFilter.h"
+#include "stageProfiler.h"
+#include <chrono>
+
+using namespace std;
+using namespace cv;
+
+uint64_t DifferenceHash ( const Mat &image ) {
+    //Shrinking the color image first means only 72 pixels are converted to gray
+    Mat small, gray;
+    resize( image, small, Size( 9, 8 ), 0, 0, INTER_AREA );
+    if ( small.channels() == 3 ) {
+        cvtColor( small, gray, CV_BGR2GRAY );
+    }
+    else {
+        gray = small;
+    }
+
+    uint64_t hash = 0;
+    for ( int y = 0; y < 8; y++ ) {
+        const uchar *row = gray.ptr( y );
+        for ( int x = 0; x < 8; x++ ) {
+            hash = ( hash << 1 ) | ( row[x] > row[x + 1] ? 1 : 0 );
+        }
+    }
+    return hash;
+}
+
+int HashDistance ( uint64_t a, uint64_t b ) {
+    uint64_t bits = a ^ b;
+    int count = 0;
+    for ( ; bits != 0; bits &= bits - 1 ) {
+        count++;
+    }
+    return count;
+}
+
+DuplicateFilter::DuplicateFilter ( const DuplicateFilterSettings &filterSettings ) : settings( filterSettings ), frame( 0 ), pending( 0 ), hasPending( false ) {
+    if ( settings.maxGap < 1 ) {
+        settings.maxGap = 1;
+    }
+}
+
+void DuplicateFilter::NextFrame ( long frameNumber ) {
+    frame = frameNumber;
+    hasPending = false;
+}
+
+long DuplicateFilter::Check ( const Mat &image ) {
+    StageScope stage( STAGE_DUPLICATES );
+
+    auto start = chrono::steady_clock::now();
+    uint64_t hash = DifferenceHash( image );
+    stats.frames++;
+
+    //Frames too far back can't cover this one or any later one
+    while ( !recent.empty() && frame - recent.front().first > settings.maxGap ) {
+        recent.pop_front();
+    }
+
+    //The closest recent frame within maxDistance covers this one
+    long cover = -1;
+    int closest = settings.maxDistance + 1;
+    for ( size_t i = 0; i < recent.size(); i++ ) {
+        int distance = HashDistance( hash, recent[i].second );
+        if ( distance < closest ) {
+            closest = distance;
+            cover = recent[i].first;
+        }
+    }
+
+    if ( cover >= 0 ) {
+        stats.duplicates++;
+    }
+    pending = hash;
+    hasPending = cover < 0;
+
+    stats.seconds += chrono::duration< double >( chrono::steady_clock::now() - start ).count();
+    return cover;
+}
+
+void DuplicateFilter::Commit () {
+    if ( hasPending ) {
+        recent.push_back( make_pair( frame, pending ) );
+        hasPending = false;
+    }
+}
+
+void DuplicateFilter::PrintStats ( FILE *out ) const {
+    fprintf( out, "Duplicate filter: %ld frames, %ld covered by an earlier frame%s, %.2lfs hashing\n",
+             stats.frames, stats.duplicates, SkipsDuplicates() ? " and skipped" : "", stats.seconds );
+}
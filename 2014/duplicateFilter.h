@@ -0,0 +1,92 @@
+//
+//  duplicateFilter.h
+//  capstone_functions
+//
+//  Spots frames that are near copies of one just processed. At slow ground
+//  speed consecutive frames overlap almost completely, and every one of them
+//  finds the same targets again.
+//
+//  Each decoded frame gets a 64 bit difference hash (dHash). The frame is
+//  shrunk to 9x8 gray, and each bit says whether a pixel is brighter than
+//  the one to its right. Shifts of a few percent of the frame, exposure
+//  changes and JPEG noise barely move it. A frame whose hash is within
+//  maxDistance bits of a frame kept at most maxGap frames earlier is covered
+//  by that frame. Duplicates aren't added to the history, so a slow drift
+//  can't creep away from the frame that was actually processed.
+//
+//  The hash sees the frame at 9x8, so a target a few dozen pixels across
+//  doesn't change it. Over uniform grass two frames from different places
+//  can hash alike too. That's why kept frames age out by frame number
+//  rather than by count: at least one frame in every maxGap + 1 is kept, so
+//  one old frame can't go on covering ground it never saw. The default
+//  distance is small for the same reason.
+//
+
+#ifndef __capstone_functions__duplicateFilter__
+#define __capstone_functions__duplicateFilter__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <deque>
+#include <utility>
+#include <opencv2/opencv.hpp>
+
+//What happens to a frame another one covers
+enum DuplicatePolicy {
+    DUPLICATES_KEEP,        //process it anyway, just record which frame covers it
+    DUPLICATES_SKIP         //skip the pipeline and record it with no targets
+};
+
+struct DuplicateFilterSettings {
+    DuplicatePolicy policy;
+    int maxGap;             //frames back a covering frame may be
+    int maxDistance;        //bits out of 64 a near duplicate may differ by
+
+    DuplicateFilterSettings () : policy( DUPLICATES_KEEP ), maxGap( 2 ), maxDistance( 4 ) {}
+};
+
+struct DuplicateFilterStats {
+    long frames;            //frames checked
+    long duplicates;        //frames found covered by an earlier one
+    double seconds;
+
+    DuplicateFilterStats () : frames( 0 ), duplicates( 0 ), seconds( 0 ) {}
+};
+
+//64 bit difference hash of a BGR or gray image of any size
+uint64_t DifferenceHash ( const cv::Mat &image );
+
+//Bits in which two hashes differ
+int HashDistance ( uint64_t a, uint64_t b );
+
+class DuplicateFilter {
+public:
+    DuplicateFilter ( const DuplicateFilterSettings &filterSettings = DuplicateFilterSettings() );
+
+    //Call at the start of every frame with its number in the run, which is what Check reports covering frames by
+    void NextFrame ( long frameNumber );
+
+    //Hashes this frame's image (it can be a reduced copy) and returns the number of the frame that
+    //covers it, or -1 if none does
+    long Check ( const cv::Mat &image );
+
+    //Adds the frame just checked to the history if nothing covered it. Call once the frame has really
+    //been processed, so one skipped for another reason (a blurred one, say) can't cover the frames after it.
+    void Commit ();
+
+    //Whether frames Check found covered should skip the pipeline
+    bool SkipsDuplicates () const { return settings.policy == DUPLICATES_SKIP; }
+
+    const DuplicateFilterStats &GetStats () const { return stats; }
+    void PrintStats ( FILE *out = stdout ) const;
+
+private:
+    DuplicateFilterSettings settings;
+    std::deque< std::pair< long, uint64_t > > recent;      //frame number and hash of the frames kept, oldest first
+    long frame;
+    uint64_t pending;                                       //hash of the frame checked, until it's committed
+    bool hasPending;
+    DuplicateFilterStats stats;
+};
+
+#endif /* defined(__capstone_functions__duplicateFilter__) */
@@ -0,0 +1,48 @@
+//
+//  frameQuality.cpp
+//  capstone_functions
+//
+
+#include "frameQuality.h"
+#include "stageProfiler.h"
+
+using namespace std;
+using namespace cv;
+
+FrameQuality MeasureFrameQuality ( const Mat &image, const QualitySettings &settings ) {
+    StageScope stage( STAGE_QUALITY );
+
+    FrameQuality quality;
+    if ( image.empty() ) {
+        return quality;
+    }
+
+    //Color first, so only the shrunk copy is converted to gray
+    Mat small, gray;
+    if ( image.cols > settings.width ) {
+        resize( image, small, Size( settings.width, max( 1, image.rows * settings.width / image.cols ) ), 0, 0, INTER_AREA );
+    }
+    else {
+        small = image;
+    }
+    if ( small.channels() == 3 ) {
+        cvtColor( small, gray, CV_BGR2GRAY );
+    }
+    else {
+        gray = small;
+    }
+
+    Mat laplacian;
+    Scalar mean, deviation;
+    Laplacian( gray, laplacian, CV_16S );
+    meanStdDev( laplacian, mean, deviation );
+    quality.sharpness = deviation[0] * deviation[0];
+
+    double pixels = ( double )gray.total();
+    quality.dark = countNonZero( gray <= 16 ) / pixels;
+    quality.bright = countNonZero( gray >= 240 ) / pixels;
+
+    double sharp = ( settings.sharpVariance > 0 ) ? min( 1.0, quality.sharpness / settings.sharpVariance ) : 1.0;
+    quality.score = sharp * max( 0.0, 1 - quality.dark - quality.bright );
+    return quality;
+}
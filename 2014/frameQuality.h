@@ -0,0 +1,52 @@
+//
+//  frameQuality.h
+//  capstone_functions
+//
+//  A quick score of how usable a frame is, taken before the expensive stages.
+//  Frames shot mid turn or with motion blur turn up junk candidates, and each
+//  of those costs k means and up to five OCR runs.
+//
+//  The frame is shrunk to a few hundred pixels across and scored on two things:
+//  - sharpness, the variance of its Laplacian. Blur flattens edges, so the
+//    variance drops.
+//  - exposure, the share of pixels crushed to black or blown out to white.
+//  The score is the sharpness over a reference value (capped at 1), times the
+//  share of pixels that are neither. So 1 is a sharp, well exposed frame and
+//  0 is a useless one.
+//
+
+#ifndef __capstone_functions__frameQuality__
+#define __capstone_functions__frameQuality__
+
+#include <opencv2/opencv.hpp>
+
+//What happens to a frame scoring under minScore
+enum QualityPolicy {
+    QUALITY_REPORT,         //nothing, the score is only recorded
+    QUALITY_RAISE_BAR,      //its candidates need lowQualityConfidence from OCR to count
+    QUALITY_SKIP            //skip the rest of the pipeline and record it with no targets
+};
+
+struct QualitySettings {
+    QualityPolicy policy;
+    double minScore;                //frames under this are low quality
+    double sharpVariance;           //Laplacian variance that counts as fully sharp
+    int width;                      //frames are shrunk to this many pixels across to be scored
+    float lowQualityConfidence;     //OCR confidence bar for low quality frames' candidates
+
+    QualitySettings () : policy( QUALITY_REPORT ), minScore( 0.3 ), sharpVariance( 100 ), width( 640 ), lowQualityConfidence( 85 ) {}
+};
+
+struct FrameQuality {
+    double sharpness;       //variance of the Laplacian
+    double dark;            //share of pixels at 16 or under
+    double bright;          //share of pixels at 240 or over
+    double score;           //0 to 1
+
+    FrameQuality () : sharpness( 0 ), dark( 0 ), bright( 0 ), score( 0 ) {}
+};
+
+//Scores image (BGR or gray, any size; the reduced detection image does fine)
+FrameQuality MeasureFrameQuality ( const cv::Mat &image, const QualitySettings &settings );
+
+#endif /* defined(__capstone_functions__frameQuality__) */
@@ -0,0 +1,171 @@
+//
+//  frameRegistration.cpp
+//  capstone_functions
+//
+
+#include "frameRegistration.h"
+#include <chrono>
+
+using namespace std;
+using namespace cv;
+
+FrameRegistration::FrameRegistration ( const RegistrationSettings &registrationSettings ) : settings( registrationSettings ), imageScale( 1 ), matchScale( 1 ), registered( false ) {
+}
+
+bool FrameRegistration::Register ( const Mat &image, int scale ) {
+    StageScope stage( STAGE_REGISTER );
+
+    auto start = chrono::steady_clock::now();
+    stats.frames++;
+
+    imageSize = image.size();
+    imageScale = max( 1, scale );
+    registered = false;
+    exposedRegion = Rect( 0, 0, imageSize.width, imageSize.height );
+
+    //Features are found on a small gray copy; their positions are kept in full resolution pixels
+    Mat small, gray;
+    if ( image.cols > settings.width ) {
+        resize( image, small, Size( settings.width, max( 1, image.rows * settings.width / image.cols ) ), 0, 0, INTER_AREA );
+    }
+    else {
+        small = image;
+    }
+    if ( small.channels() == 3 ) {
+        cvtColor( small, gray, CV_BGR2GRAY );
+    }
+    else {
+        gray = small;
+    }
+    double scaleNow = ( double )image.cols * imageScale / gray.cols;
+
+    vector< KeyPoint > keyPoints;
+    Mat descriptors;
+#if CV_MAJOR_VERSION >= 3
+    Ptr< ORB > orb = ORB::create( settings.features );
+    orb->detectAndCompute( gray, noArray(), keyPoints, descriptors );
+#else
+    ORB orb( settings.features );
+    orb( gray, Mat(), keyPoints, descriptors );
+#endif
+
+    vector< Point2f > points( keyPoints.size() );
+    for ( size_t i = 0; i < keyPoints.size(); i++ ) {
+        points[i] = keyPoints[i].pt * ( float )scaleNow;
+    }
+
+    if ( !lastDescriptors.empty() && !descriptors.empty() ) {
+        //Cross checked, so each match is the best either way round
+        BFMatcher matcher( NORM_HAMMING, true );
+        vector< DMatch > matches;
+        matcher.match( lastDescriptors, descriptors, matches );
+
+        if ( ( int )matches.size() >= settings.minInliers ) {
+            vector< Point2f > from, to;
+            for ( size_t i = 0; i < matches.size(); i++ ) {
+                from.push_back( lastPoints[matches[i].queryIdx] );
+                to.push_back( points[matches[i].trainIdx] );
+            }
+
+            vector< uchar > inliers;
+            Mat found = findHomography( from, to, RANSAC, 3 * scaleNow, inliers );
+            registered = !found.empty() && countNonZero( inliers ) >= settings.minInliers;
+            if ( registered ) {
+                homography = found;
+            }
+        }
+    }
+
+    if ( registered ) {
+        //The last frame's outline, warped into this frame at matching size and pulled in by the margin
+        Mat toMatch = Mat::eye( 3, 3, CV_64F ), fromMatch = Mat::eye( 3, 3, CV_64F );
+        toMatch.at< double >( 0, 0 ) = toMatch.at< double >( 1, 1 ) = 1 / scaleNow;
+        fromMatch.at< double >( 0, 0 ) = fromMatch.at< double >( 1, 1 ) = matchScale;
+
+        Mat outline( lastMatchSize, CV_8UC1, Scalar::all( 255 ) );
+        warpPerspective( outline, overlap, toMatch * homography * fromMatch, gray.size(), INTER_NEAREST, BORDER_CONSTANT, Scalar::all( 0 ) );
+
+        int pull = ( int )ceil( settings.margin / scaleNow );
+        if ( pull > 0 ) {
+            erode( overlap, overlap, getStructuringElement( MORPH_RECT, Size( 2 * pull + 1, 2 * pull + 1 ) ) );
+        }
+
+        Mat exposed = ( overlap == 0 );
+        double fraction = countNonZero( exposed ) / ( double )exposed.total();
+        stats.registered++;
+        stats.exposed += fraction;
+
+        if ( fraction == 0 ) {
+            exposedRegion = Rect();
+        }
+        else if ( fraction > settings.maxExposed ) {
+            stats.wholeFrames++;
+        }
+        else {
+            //From matching pixels to the detection image's, rounded outwards
+            vector< Point > exposedPoints;
+            findNonZero( exposed, exposedPoints );
+            Rect box = boundingRect( exposedPoints );
+            double ratio = scaleNow / imageScale;
+            int left = ( int )floor( box.x * ratio ), top = ( int )floor( box.y * ratio );
+            int right = ( int )ceil( ( box.x + box.width ) * ratio ), bottom = ( int )ceil( ( box.y + box.height ) * ratio );
+            exposedRegion &= Rect( left, top, right - left, bottom - top );
+        }
+    }
+
+    lastPoints.swap( points );
+    lastDescriptors = descriptors;
+    lastMatchSize = gray.size();
+    matchScale = scaleNow;
+
+    stats.seconds += chrono::duration< double >( chrono::steady_clock::now() - start ).count();
+    return registered;
+}
+
+bool FrameRegistration::InOverlap ( Point point ) const {
+    if ( !registered ) {
+        return false;
+    }
+
+    Point at( ( int )( point.x / matchScale ), ( int )( point.y / matchScale ) );
+    return at.x >= 0 && at.y >= 0 && at.x < overlap.cols && at.y < overlap.rows && overlap.at< uchar >( at ) != 0;
+}
+
+vector< CandidateRegion > FrameRegistration::CarryForward () {
+    vector< CandidateRegion > carried;
+    if ( !registered || lastRegions.empty() ) {
+        return carried;
+    }
+
+    vector< Point2f > centers( lastRegions.size() ), moved;
+    for ( size_t i = 0; i < lastRegions.size(); i++ ) {
+        centers[i] = Point2f( lastRegions[i].center );
+    }
+    perspectiveTransform( centers, moved, homography );
+
+    for ( size_t i = 0; i < moved.size(); i++ ) {
+        CandidateRegion region;
+        region.center = Point( ( int )moved[i].x, ( int )moved[i].y );
+        if ( !InOverlap( region.center ) ) {
+            continue;
+        }
+
+        //The same size box, centered where the candidate is now
+        region.box = lastRegions[i].box;
+        region.box.x = std::max( 0, region.center.x - region.box.width / 2 );
+        region.box.y = std::max( 0, region.center.y - region.box.height / 2 );
+        carried.push_back( region );
+    }
+
+    stats.carried += carried.size();
+    return carried;
+}
+
+void FrameRegistration::Keep ( const vector< CandidateRegion > &regions ) {
+    lastRegions = regions;
+}
+
+void FrameRegistration::PrintStats ( FILE *out ) const {
+    fprintf( out, "Registration: %ld frames, %ld registered (%.0f%% exposed on average), %ld detected whole, %ld candidates carried forward, %.2lfs matching\n",
+             stats.frames, stats.registered, stats.registered > 0 ? 100 * stats.exposed / stats.registered : 100.0, stats.wholeFrames, stats.carried, stats.seconds );
+}
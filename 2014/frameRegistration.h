@@ -0,0 +1,99 @@
+//
+//  frameRegistration.h
+//  capstone_functions
+//
+//  Works out where the last frame lands in this one, so detection only has
+//  to look at what's new. Consecutive frames overlap heavily, and without
+//  this most of the ground is run through color removal and blob detection
+//  two or three times.
+//
+//  ORB features are matched between the two frames, shrunk to a few hundred
+//  pixels across, and a RANSAC homography is fit to the matches. The last
+//  frame's outline, pulled in by a margin, is warped into this frame. What
+//  falls inside is the overlap. Everything else is exposed, including a
+//  strip along the last frame's edge, where a target could have been cut
+//  off. Detection runs on the bounding box of the exposed part and keeps only
+//  blobs centered outside the overlap. The last frame's candidates that land
+//  inside the overlap are carried forward to where the homography puts them,
+//  and detected again in a small window there. Their positions come from the
+//  new frame, so homography error doesn't build up from frame to frame, and
+//  one that isn't found again is dropped. Only candidates found in this frame
+//  are kept for the next, so none is carried on without being seen again.
+//
+//  When the frames can't be registered (too few matches, a turn, the first
+//  frame), the whole frame is detected as usual.
+//
+
+#ifndef __capstone_functions__frameRegistration__
+#define __capstone_functions__frameRegistration__
+
+#include <stdio.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "projectFunctions.h"
+
+struct RegistrationSettings {
+    int width;              //frames are shrunk to this many pixels across for matching
+    int features;           //ORB features per frame
+    int minInliers;         //matches the homography has to agree with to be trusted
+    int margin;             //full resolution pixels along the last frame's edge still treated as exposed
+    double maxExposed;      //above this fraction of the frame exposed, detect on the whole frame
+
+    //The margin is about twice the side of a MAX_AREA target
+    RegistrationSettings () : width( 640 ), features( 500 ), minInliers( 30 ), margin( 300 ), maxExposed( 0.7 ) {}
+};
+
+struct RegistrationStats {
+    long frames;            //frames registered or tried
+    long registered;        //frames matched to the one before
+    long wholeFrames;       //registered frames that still needed detection everywhere
+    long carried;           //candidates carried forward from the frame before
+    double exposed;         //sum of the fraction of each registered frame that was exposed
+    double seconds;
+
+    RegistrationStats () : frames( 0 ), registered( 0 ), wholeFrames( 0 ), carried( 0 ), exposed( 0 ), seconds( 0 ) {}
+};
+
+class FrameRegistration {
+public:
+    FrameRegistration ( const RegistrationSettings &registrationSettings = RegistrationSettings() );
+
+    //Matches this frame against the last one given. image is the frame shrunk by scale (the
+    //detection image); positions everywhere else are in full resolution pixels. False if there
+    //was no last frame or it couldn't be matched, in which case everything counts as exposed.
+    bool Register ( const cv::Mat &image, int scale );
+
+    //Bounding box of the exposed part of the frame, in the pixels of the image given to Register.
+    //The whole image if it wasn't registered or too much is exposed; empty if nothing is.
+    cv::Rect ExposedRegion () const { return exposedRegion; }
+
+    //Whether a point in this frame was seen inside the last one, away from its edge
+    bool InOverlap ( cv::Point point ) const;
+
+    //The last frame's candidates that landed in the overlap, moved to where the homography puts them
+    //in this frame. Each is only a prediction until it's detected there again.
+    std::vector< CandidateRegion > CarryForward ();
+
+    //The candidates detected in this frame, fresh or found again, to be carried forward into the next
+    void Keep ( const std::vector< CandidateRegion > &regions );
+
+    const RegistrationStats &GetStats () const { return stats; }
+    void PrintStats ( FILE *out = stdout ) const;
+
+private:
+    RegistrationSettings settings;
+    cv::Size imageSize;                         //size of the image given to Register
+    int imageScale;
+    double matchScale;                          //full resolution pixels per pixel of the matching image
+    std::vector< cv::Point2f > lastPoints;      //the last frame's features, in full resolution pixels
+    cv::Mat lastDescriptors;
+    cv::Size lastMatchSize;
+    std::vector< CandidateRegion > lastRegions;
+    bool registered;
+    cv::Mat homography;                         //last frame to this one, full resolution pixels
+    cv::Mat overlap;                            //255 where this frame overlaps the last, at matching size
+    cv::Rect exposedRegion;
+    RegistrationStats stats;
+};
+
+#endif /* defined(__capstone_functions__frameRegistration__) */
@@ -0,0 +1,238 @@
+//
+//  imageIngest.cpp
+//  capstone_functions
+//
+
+#include "imageIngest.h"
+#include <algorithm>
+#include <chrono>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static double Seconds ( chrono::steady_clock::time_point start ) {
+    return chrono::duration< double >( chrono::steady_clock::now() - start ).count();
+}
+
+#ifndef WIN32
+
+//Maps path read only, returning NULL if it can't be opened or is empty
+static void *MapWholeFile ( const string &path, size_t &length ) {
+    length = 0;
+    int fd = open( path.c_str(), O_RDONLY );
+    if ( fd < 0 ) {
+        return NULL;
+    }
+
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 || st.st_size == 0 ) {
+        close( fd );
+        return NULL;
+    }
+
+    void *mapping = mmap( NULL, ( size_t )st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( mapping == MAP_FAILED ) {
+        return NULL;
+    }
+
+    length = ( size_t )st.st_size;
+    return mapping;
+}
+
+#endif
+
+//Reads all of path into bytes
+static bool ReadWholeFile ( const string &path, vector< uchar > &bytes ) {
+    FILE *file = fopen( path.c_str(), "rb" );
+    if ( file == NULL ) {
+        return false;
+    }
+
+    bytes.clear();
+    uchar buffer[64 * 1024];
+    size_t count;
+    while ( ( count = fread( buffer, 1, sizeof( buffer ), file ) ) > 0 ) {
+        bytes.insert( bytes.end(), buffer, buffer + count );
+    }
+
+    fclose( file );
+    return !bytes.empty();
+}
+
+MappedFile::MappedFile () : data( NULL ), length( 0 ), mapping( NULL ) {
+}
+
+MappedFile::~MappedFile () {
+    Close();
+}
+
+bool MappedFile::Open ( const string &path ) {
+    Close();
+
+#ifndef WIN32
+    mapping = MapWholeFile( path, length );
+    if ( mapping != NULL ) {
+        //Decoders read the file front to back
+        madvise( mapping, length, MADV_SEQUENTIAL );
+        data = ( const uchar * )mapping;
+        return true;
+    }
+#endif
+
+    if ( !ReadWholeFile( path, fileBuffer ) ) {
+        return false;
+    }
+    data = &fileBuffer[0];
+    length = fileBuffer.size();
+    return true;
+}
+
+void MappedFile::Close () {
+#ifndef WIN32
+    if ( mapping != NULL ) {
+        munmap( mapping, length );
+    }
+#endif
+
+    mapping = NULL;
+    data = NULL;
+    length = 0;
+    fileBuffer.clear();
+}
+
+cv::Mat MappedFile::AsMat () const {
+    if ( data == NULL ) {
+        return cv::Mat();
+    }
+    //imdecode only reads its input, so the const can go
+    return cv::Mat( 1, ( int )length, CV_8UC1, ( void * )data );
+}
+
+FramePrefetcher::FramePrefetcher () : stopping( false ) {
+    worker = thread( &FramePrefetcher::Run, this );
+}
+
+FramePrefetcher::~FramePrefetcher () {
+    Stop();
+}
+
+void FramePrefetcher::Prefetch ( const string &path ) {
+    {
+        lock_guard< mutex > guard( lock );
+        stats.requested++;
+        if ( stopping ) {
+            return;
+        }
+        queue.push_back( path );
+    }
+    workReady.notify_one();
+}
+
+void FramePrefetcher::Claim ( const string &path ) {
+    lock_guard< mutex > guard( lock );
+    stats.claimed++;
+
+    if ( path == warming ) {
+        stats.late++;
+        return;
+    }
+
+    deque< string >::iterator queued = find( queue.begin(), queue.end(), path );
+    if ( queued != queue.end() ) {
+        queue.erase( queued );
+        stats.late++;
+    }
+}
+
+void FramePrefetcher::Stop () {
+    {
+        lock_guard< mutex > guard( lock );
+        if ( stopping ) {
+            return;
+        }
+        stopping = true;
+        queue.clear();
+    }
+
+    workReady.notify_one();
+    if ( worker.joinable() ) {
+        worker.join();
+    }
+}
+
+void FramePrefetcher::Run () {
+    unique_lock< mutex > guard( lock );
+
+    for ( ;; ) {
+        while ( queue.empty() && !stopping ) {
+            workReady.wait( guard );
+        }
+        if ( stopping ) {
+            break;
+        }
+
+        warming = queue.front();
+        queue.pop_front();
+
+        //Read with the lock released so Claim never waits on the disk
+        string path = warming;
+        guard.unlock();
+        auto start = chrono::steady_clock::now();
+        bool ok = Warm( path );
+        double elapsed = Seconds( start );
+        guard.lock();
+
+        warming.clear();
+        stats.warmSeconds += elapsed;
+        if ( ok ) {
+            stats.warmed++;
+        }
+        else {
+            stats.failed++;
+        }
+    }
+}
+
+bool FramePrefetcher::Warm ( const string &path ) {
+#ifndef WIN32
+    size_t length;
+    void *mapping = MapWholeFile( path, length );
+    if ( mapping == NULL ) {
+        return false;
+    }
+
+    //WILLNEED starts the reads; touching every page waits for them, so a warmed file really is in memory
+    madvise( mapping, length, MADV_WILLNEED );
+    long page = sysconf( _SC_PAGESIZE );
+    volatile const uchar *bytes = ( const uchar * )mapping;
+    uchar sum = 0;
+    for ( size_t offset = 0; offset < length; offset += ( size_t )page ) {
+        sum ^= bytes[offset];
+    }
+    ( void )sum;
+
+    munmap( mapping, length );
+    return true;
+#else
+    vector< uchar > bytes;
+    return ReadWholeFile( path, bytes );
+#endif
+}
+
+PrefetchStats FramePrefetcher::GetStats () const {
+    lock_guard< mutex > guard( lock );
+    return stats;
+}
+
+void FramePrefetcher::PrintStats ( FILE *out ) const {
+    PrefetchStats s = GetStats();
+    fprintf( out, "Prefetcher: %ld requested, %ld warmed, %ld failed, %ld claimed, %ld late, %.2lfs reading\n",
+             s.requested, s.warmed, s.failed, s.claimed, s.late, s.warmSeconds );
+}
@@ -0,0 +1,101 @@
+//
+//  imageIngest.h
+//  capstone_functions
+//
+//  Getting frame files off the disk and into the decoder.
+//
+//  MappedFile maps a frame file read only, so the decoder reads it straight
+//  out of the page cache through a Mat header that doesn't own the bytes.
+//  Nothing is copied into a buffer of our own first.
+//
+//  FramePrefetcher reads files into the page cache on a helper thread
+//  ahead of the frame loop, so by the time a frame is decoded its file is
+//  already in memory. The loop asks for the next few frames to be
+//  prefetched, and claims each frame just before decoding it. A claim on a
+//  file the helper hasn't got to yet counts as late, meaning decode had to
+//  wait on the disk.
+//
+
+#ifndef __capstone_functions__imageIngest__
+#define __capstone_functions__imageIngest__
+
+#include <stdio.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/opencv.hpp>
+
+class MappedFile {
+public:
+    MappedFile ();
+    ~MappedFile ();
+
+    //Maps the whole file (reads it, where there's no mmap). False if it can't be opened or is empty.
+    bool Open ( const std::string &path );
+    void Close ();
+
+    const uchar *Data () const { return data; }
+    size_t Length () const { return length; }
+
+    //The file's bytes as a 1 x Length() CV_8UC1 Mat for imdecode, valid until Close
+    cv::Mat AsMat () const;
+
+private:
+    MappedFile ( const MappedFile & );
+    MappedFile &operator= ( const MappedFile & );
+
+    const uchar *data;
+    size_t length;
+    void *mapping;
+    std::vector< uchar > fileBuffer;    //used instead of a mapping where mmap isn't available
+};
+
+struct PrefetchStats {
+    long requested;         //calls to Prefetch
+    long warmed;            //files read into the page cache
+    long failed;            //files that couldn't be opened
+    long claimed;           //calls to Claim
+    long late;              //claims on files that hadn't been prefetched yet
+    double warmSeconds;     //time the helper thread spent reading
+
+    PrefetchStats () : requested( 0 ), warmed( 0 ), failed( 0 ), claimed( 0 ), late( 0 ), warmSeconds( 0 ) {}
+};
+
+class FramePrefetcher {
+public:
+    FramePrefetcher ();
+    ~FramePrefetcher ();
+
+    //Queues path to be read into the page cache
+    void Prefetch ( const std::string &path );
+
+    //Call just before decoding path. If it's still waiting its turn it's taken off the queue,
+    //since the decoder is about to read it anyway.
+    void Claim ( const std::string &path );
+
+    //Stops the helper thread; files still queued aren't read
+    void Stop ();
+
+    PrefetchStats GetStats () const;
+    void PrintStats ( FILE *out = stdout ) const;
+
+private:
+    FramePrefetcher ( const FramePrefetcher & );
+    FramePrefetcher &operator= ( const FramePrefetcher & );
+
+    void Run ();
+    static bool Warm ( const std::string &path );
+
+    std::deque< std::string > queue;
+    std::string warming;                //the file the helper is reading right now
+    mutable std::mutex lock;
+    std::condition_variable workReady;
+    PrefetchStats stats;
+    bool stopping;
+    std::thread worker;
+};
+
+#endif /* defined(__capstone_functions__imageIngest__) */
@@ -0,0 +1,174 @@
+//
+//  imageWriter.cpp
+//  capstone_functions
+//
+
+#include "imageWriter.h"
+#include <chrono>
+
+using namespace std;
+
+static double Seconds ( chrono::steady_clock::time_point start ) {
+    return chrono::duration< double >( chrono::steady_clock::now() - start ).count();
+}
+
+ImageWriter::ImageWriter ( const ImageWriterSettings &writerSettings ) : settings( writerSettings ), overflowCount( 0 ), busy( false ), stopping( false ) {
+    if ( settings.queueLength == 0 ) {
+        settings.queueLength = 1;
+    }
+    if ( settings.sampleEvery < 1 ) {
+        settings.sampleEvery = 1;
+    }
+
+    //Each encoder only looks at its own parameters, so both can always be passed
+    encodeParams.push_back( CV_IMWRITE_JPEG_QUALITY );
+    encodeParams.push_back( settings.jpegQuality );
+    encodeParams.push_back( CV_IMWRITE_PNG_COMPRESSION );
+    encodeParams.push_back( settings.pngCompression );
+
+    worker = thread( &ImageWriter::Run, this );
+}
+
+ImageWriter::~ImageWriter () {
+    Finish();
+}
+
+bool ImageWriter::Submit ( const string &path, const cv::Mat &image ) {
+    Job job;
+    job.path = path;
+    job.image = image;
+    return Enqueue( job );
+}
+
+bool ImageWriter::SubmitChip ( ChipArchiveWriter &archive, const ChipEntry &entry, const cv::Mat &image ) {
+    Job job;
+    job.image = image;
+    job.archive = &archive;
+    job.entry = entry;
+    return Enqueue( job );
+}
+
+bool ImageWriter::Enqueue ( Job &job ) {
+    unique_lock< mutex > guard( lock );
+    stats.submitted++;
+
+    if ( !stopping && queue.size() >= settings.queueLength ) {
+        bool wait = ( settings.policy == WRITER_BLOCK ) || ( settings.policy == WRITER_SAMPLE && ( overflowCount++ % settings.sampleEvery ) == 0 );
+
+        if ( !wait ) {
+            stats.dropped++;
+            return false;
+        }
+
+        auto start = chrono::steady_clock::now();
+        stats.blocked++;
+        while ( queue.size() >= settings.queueLength && !stopping ) {
+            roomReady.wait( guard );
+        }
+        stats.blockedSeconds += Seconds( start );
+    }
+
+    //Nothing left to hand the image to
+    if ( stopping ) {
+        guard.unlock();
+        return Write( job );
+    }
+
+    queue.push_back( Job() );
+    swap( queue.back(), job );
+    stats.maxQueueDepth = max( stats.maxQueueDepth, queue.size() );
+
+    guard.unlock();
+    workReady.notify_one();
+    return true;
+}
+
+void ImageWriter::Flush () {
+    unique_lock< mutex > guard( lock );
+    while ( !queue.empty() || busy ) {
+        roomReady.wait( guard );
+    }
+}
+
+void ImageWriter::Finish () {
+    {
+        lock_guard< mutex > guard( lock );
+        if ( stopping ) {
+            return;
+        }
+        stopping = true;
+    }
+
+    //The worker drains the queue before it exits
+    workReady.notify_one();
+    if ( worker.joinable() ) {
+        worker.join();
+    }
+}
+
+void ImageWriter::Run () {
+    unique_lock< mutex > guard( lock );
+
+    for ( ;; ) {
+        while ( queue.empty() && !stopping ) {
+            workReady.wait( guard );
+        }
+        if ( queue.empty() ) {
+            break;
+        }
+
+        Job job;
+        swap( job, queue.front() );
+        queue.pop_front();
+        busy = true;
+
+        //Encode with the lock released so Submit never waits on the disk
+        guard.unlock();
+        roomReady.notify_all();
+        Write( job );
+        guard.lock();
+
+        busy = false;
+        roomReady.notify_all();
+    }
+}
+
+bool ImageWriter::Write ( const Job &job ) {
+    auto start = chrono::steady_clock::now();
+    bool ok;
+
+    try {
+        if ( job.archive != NULL ) {
+            ok = job.archive->Append( job.entry, job.image, encodeParams );
+        }
+        else {
+            ok = cv::imwrite( job.path, job.image, encodeParams );
+        }
+    }
+    catch ( ... ) {
+        ok = false;
+    }
+
+    double elapsed = Seconds( start );
+
+    lock_guard< mutex > guard( lock );
+    stats.encodeSeconds += elapsed;
+    if ( ok ) {
+        stats.written++;
+    }
+    else {
+        stats.failed++;
+    }
+    return ok;
+}
+
+ImageWriterStats ImageWriter::GetStats () const {
+    lock_guard< mutex > guard( lock );
+    return stats;
+}
+
+void ImageWriter::PrintStats ( FILE *out ) const {
+    ImageWriterStats s = GetStats();
+    fprintf( out, "Image writer: %ld submitted, %ld written, %ld failed, %ld dropped, %ld blocked (%.2lfs waiting), %.2lfs encoding, max queue %zu\n",
+             s.submitted, s.written, s.failed, s.dropped, s.blocked, s.blockedSeconds, s.encodeSeconds, s.maxQueueDepth );
+}
@@ -0,0 +1,110 @@
+//
+//  imageWriter.h
+//  capstone_functions
+//
+//  Writes debug images (candidates, final targets) on a background thread
+//  so JPEG/PNG encoding and disk writes stay off the detection path. Images
+//  go either to their own files or into a chip archive (chipArchive.h).
+//  They wait in a bounded queue; what happens when it fills up is set by
+//  the policy.
+//
+
+#ifndef __capstone_functions__imageWriter__
+#define __capstone_functions__imageWriter__
+
+#include <stdio.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/opencv.hpp>
+#include "chipArchive.h"
+
+//What Submit() does when the queue is full
+enum WriterPolicy {
+    WRITER_DROP,        //throw the new image away
+    WRITER_BLOCK,       //wait for room, so nothing is lost but detection slows down
+    WRITER_SAMPLE       //wait for 1 in every sampleEvery overflowing images, drop the rest
+};
+
+struct ImageWriterSettings {
+    size_t queueLength;     //images allowed to wait before the policy applies
+    WriterPolicy policy;
+    int sampleEvery;        //for WRITER_SAMPLE
+    int jpegQuality;        //0-100
+    int pngCompression;     //0-9, higher is smaller and slower
+
+    ImageWriterSettings () : queueLength( 64 ), policy( WRITER_DROP ), sampleEvery( 10 ), jpegQuality( 95 ), pngCompression( 3 ) {}
+};
+
+struct ImageWriterStats {
+    long submitted;         //calls to Submit
+    long written;
+    long failed;            //imwrite errors
+    long dropped;           //thrown away because the queue was full
+    long blocked;           //Submit calls that had to wait for room
+    double blockedSeconds;  //time detection spent waiting on the writer
+    double encodeSeconds;   //time the writer thread spent in imwrite
+    size_t maxQueueDepth;
+
+    ImageWriterStats () : submitted( 0 ), written( 0 ), failed( 0 ), dropped( 0 ), blocked( 0 ), blockedSeconds( 0 ), encodeSeconds( 0 ), maxQueueDepth( 0 ) {}
+};
+
+class ImageWriter {
+public:
+    ImageWriter ( const ImageWriterSettings &settings = ImageWriterSettings() );
+    ~ImageWriter ();
+
+    /*
+     Queues image to be written to path, with the format picked from the
+     extension like imwrite does. The writer keeps a reference to the
+     pixels rather than a copy, so don't write into them afterwards.
+     Returns false if the image was dropped.
+     */
+    bool Submit ( const std::string &path, const cv::Mat &image );
+
+    //Same, but the image is encoded in entry.format and appended to archive
+    bool SubmitChip ( ChipArchiveWriter &archive, const ChipEntry &entry, const cv::Mat &image );
+
+    //Waits until everything queued so far is on disk
+    void Flush ();
+
+    //Flushes and stops the writer thread; Submit after this writes synchronously
+    void Finish ();
+
+    ImageWriterStats GetStats () const;
+    void PrintStats ( FILE *out = stdout ) const;
+
+private:
+    struct Job {
+        std::string path;
+        cv::Mat image;
+        ChipArchiveWriter *archive;     //archive to append to instead of writing path
+        ChipEntry entry;
+
+        Job () : archive( NULL ) {}
+    };
+
+    ImageWriter ( const ImageWriter & );
+    ImageWriter &operator= ( const ImageWriter & );
+
+    void Run ();
+    bool Enqueue ( Job &job );
+    bool Write ( const Job &job );
+
+    ImageWriterSettings settings;
+    std::vector< int > encodeParams;
+    std::deque< Job > queue;
+    mutable std::mutex lock;
+    std::condition_variable workReady;
+    std::condition_variable roomReady;
+    ImageWriterStats stats;
+    long overflowCount;
+    bool busy;
+    bool stopping;
+    std::thread worker;
+};
+
+#endif /* defined(__capstone_functions__imageWriter__) */
@@ -0,0 +1,136 @@
+//
+//  jpegRegions.cpp
+//  capstone_functions
+//
+
+#include "jpegRegions.h"
+#include "quickReject.h"
+
+using namespace std;
+using namespace cv;
+
+//Whatever can't be cropped gets decoded in full
+static bool DecodeWhole ( const Mat &bytes, Mat &frame ) {
+    if ( bytes.empty() ) {
+        return false;
+    }
+    imdecode( bytes, CV_LOAD_IMAGE_COLOR, &frame );
+    return !frame.empty();
+}
+
+#ifdef JPEG_REGIONS
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <jpeglib.h>
+
+//libjpeg reports errors by calling error_exit, which mustn't return
+struct JumpingErrorManager {
+    jpeg_error_mgr manager;
+    jmp_buf jump;
+};
+
+static void JumpOnError ( j_common_ptr cinfo ) {
+    longjmp( ( ( JumpingErrorManager * )cinfo->err )->jump, 1 );
+}
+
+//Rows read per jpeg_read_scanlines call
+static const int ROW_BATCH = 16;
+
+static bool DecodeCropped ( const Mat &bytes, const vector< Rect > &regions, Mat &frame ) {
+    //Anything with a destructor has to exist before the setjmp, so an error jumping back skips nothing
+    vector< char > needed;
+    jpeg_decompress_struct cinfo;
+    JumpingErrorManager errors;
+    cinfo.err = jpeg_std_error( &errors.manager );
+    errors.manager.error_exit = JumpOnError;
+
+    if ( setjmp( errors.jump ) ) {
+        jpeg_destroy_decompress( &cinfo );
+        return false;
+    }
+
+    jpeg_create_decompress( &cinfo );
+    jpeg_mem_src( &cinfo, ( unsigned char * )bytes.data, ( unsigned long )bytes.total() );
+    jpeg_read_header( &cinfo, TRUE );
+    cinfo.out_color_space = JCS_EXT_BGR;
+    jpeg_start_decompress( &cinfo );
+
+    int width = ( int )cinfo.output_width, height = ( int )cinfo.output_height;
+    frame.create( height, width, CV_8UC3 );
+
+    //The columns every region spans between them, and which rows any of them cover
+    Rect image( 0, 0, width, height ), span;
+    needed.assign( height, 0 );
+    for ( size_t i = 0; i < regions.size(); i++ ) {
+        Rect region = regions[i] & image;
+        if ( region.area() == 0 ) {
+            continue;
+        }
+        span = ( span.area() == 0 ) ? region : ( span | region );
+        fill( needed.begin() + region.y, needed.begin() + region.y + region.height, 1 );
+    }
+
+    if ( span.area() == 0 ) {
+        jpeg_abort_decompress( &cinfo );
+        jpeg_destroy_decompress( &cinfo );
+        return true;
+    }
+
+    //Widened to whole MCUs by the library
+    JDIMENSION xoffset = ( JDIMENSION )span.x, cropWidth = ( JDIMENSION )span.width;
+    jpeg_crop_scanline( &cinfo, &xoffset, &cropWidth );
+
+    int last = span.y + span.height;
+    JSAMPROW rows[ROW_BATCH];
+
+    while ( ( int )cinfo.output_scanline < last ) {
+        int y = ( int )cinfo.output_scanline;
+
+        int run = 0;
+        while ( y + run < last && needed[y + run] == needed[y] ) {
+            run++;
+        }
+
+        if ( !needed[y] ) {
+            jpeg_skip_scanlines( &cinfo, ( JDIMENSION )run );
+            continue;
+        }
+
+        int batch = min( run, ROW_BATCH );
+        for ( int r = 0; r < batch; r++ ) {
+            rows[r] = frame.ptr( y + r ) + xoffset * 3;
+        }
+        jpeg_read_scanlines( &cinfo, rows, ( JDIMENSION )batch );
+    }
+
+    //Nothing below the last region is wanted, so don't decode the rest of the file
+    if ( ( int )cinfo.output_scanline < height ) {
+        jpeg_abort_decompress( &cinfo );
+    }
+    else {
+        jpeg_finish_decompress( &cinfo );
+    }
+    jpeg_destroy_decompress( &cinfo );
+    return true;
+}
+
+bool DecodeJpegRegions ( const Mat &bytes, const vector< Rect > &regions, Mat &frame ) {
+    //Anything but a JPEG (or one libjpeg gives up on) goes through OpenCV. So does a JPEG stored
+    //turned: imdecode turns it upright by its EXIF orientation, as it did for detection, and the
+    //regions are in that frame. libjpeg would decode it as stored.
+    JpegHeaders headers;
+    bool upright = ReadJpegHeaders( bytes.data, bytes.total(), headers ) && headers.orientation == 1;
+    if ( upright && DecodeCropped( bytes, regions, frame ) ) {
+        return true;
+    }
+    return DecodeWhole( bytes, frame );
+}
+
+#else
+
+bool DecodeJpegRegions ( const Mat &bytes, const vector< Rect > &regions, Mat &frame ) {
+    return DecodeWhole( bytes, frame );
+}
+
+#endif
@@ -0,0 +1,34 @@
+//
+//  jpegRegions.h
+//  capstone_functions
+//
+//  Decodes only the parts of a JPEG that are needed at full resolution.
+//  Once detection has run on a reduced decode, classification only looks at
+//  a few small candidate regions, so there's no need to decode the rest.
+//  libjpeg-turbo can crop each scanline to a range of MCU columns and skip
+//  whole scanlines without running their IDCT. Everything from the top row
+//  of the regions to the bottom one still has to be entropy decoded, but
+//  rows and columns outside the regions don't need their IDCT or color
+//  conversion.
+//
+//  Built in with -DJPEG_REGIONS, linking libjpeg-turbo 1.5 or later (-ljpeg).
+//  Without it, or for anything that isn't a baseline/progressive JPEG the
+//  library can crop, the whole image is decoded with imdecode. So is a JPEG
+//  whose EXIF orientation says it's stored turned, since imdecode turns it
+//  upright and libjpeg doesn't. Callers get the pixels they asked for, in
+//  the same orientation as any other imdecode, either way.
+//
+
+#ifndef __capstone_functions__jpegRegions__
+#define __capstone_functions__jpegRegions__
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+//Decodes the encoded image in bytes (a 1 x N CV_8UC1 Mat, which can be a header over a mapped file)
+//into frame, which is made the image's size (BGR, 8 bits a channel). The pixels under regions are
+//filled in; the rest of frame may be left as it was. Regions may hang off the image. Returns false
+//if bytes can't be decoded.
+bool DecodeJpegRegions ( const cv::Mat &bytes, const std::vector< cv::Rect > &regions, cv::Mat &frame );
+
+#endif /* defined(__capstone_functions__jpegRegions__) */
@@ -2,70 +2,203 @@
 #include <stdlib.h>
 #include <string>
 #include <algorithm>
+#include <cmath>
 #include <cstdlib>
 #include <cstdio>
 #include <climits>
+#include <limits>
+#include <stdint.h>
 #include <string.h>
-#include <functional>
 #include <cctype>
-#include <stack>
 #include <cerrno>
+#include <mutex>
+#include <tuple>
 
-#ifndef WIN32
-#define _stricmp strcasecmp
+#ifdef _MSC_VER
+#define snprintf sprintf_s
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define JSON_USE_SSE2
 #ifdef _MSC_VER
-#define snprintf sprintf_s
+#include <intrin.h>
+#endif
+#endif
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 using namespace json;
 
-namespace json
+// Arrays/objects nested deeper than this are rejected by Deserialize so that hostile input can't exhaust the stack
+static const int MAX_DEPTH = 512;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Blocks start small so a tiny document doesn't reserve much, then double up to the max size
+static const size_t ARENA_FIRST_BLOCK_SZ = 64 * 1024;
+static const size_t ARENA_MAX_BLOCK_SZ = 1024 * 1024;
+
+static thread_local Arena* current_arena = nullptr;
+
+Arena::Arena() : mBlocks(nullptr), mCursor(nullptr), mLimit(nullptr), mNextBlockSize(ARENA_FIRST_BLOCK_SZ), mBytesUsed(0),
+	mBytesReserved(0)
+{
+	memset(mFreeLists, 0, sizeof(mFreeLists));
+}
+
+Arena::~Arena()
 {
-	enum StackDepthType
+	Release();
+}
+
+Arena* Arena::Current()
+{
+	return current_arena;
+}
+
+void* Arena::Allocate(size_t bytes, size_t alignment)
+{
+	// Sizes are rounded up to whole granules so a buffer freed by one container type fits the next one of similar size
+	bytes = (bytes + GRANULE_SZ - 1) & ~(GRANULE_SZ - 1);
+
+	if ((bytes <= RECYCLE_LIMIT) && (alignment <= GRANULE_SZ) && (mFreeLists[bytes / GRANULE_SZ] != nullptr))
 	{
-		InObject,
-		InArray
-	};
+		void* recycled = mFreeLists[bytes / GRANULE_SZ];
+		mFreeLists[bytes / GRANULE_SZ] = *(void**)recycled;
+		return recycled;
+	}
+
+	char* p = (char*)(((size_t)mCursor + (alignment - 1)) & ~(alignment - 1));
+
+	if ((mCursor == nullptr) || (bytes > (size_t)(mLimit - p)))
+		return AllocateBlock(bytes, alignment);
+
+	mCursor = p + bytes;
+	mBytesUsed += bytes;
+
+	return p;
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Helper functions
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-static std::string Trim(const std::string& str)
+void* Arena::AllocateBlock(size_t bytes, size_t alignment)
 {
-	std::string s = str;
-	
-	// remove white space in front
-	s.erase(s.begin(), std::find_if(s.begin(), s.end(), std::not1(std::ptr_fun<int, int>(std::isspace))));
-	
-	// remove trailing white space
-	s.erase(std::find_if(s.rbegin(), s.rend(), std::not1(std::ptr_fun<int, int>(std::isspace))).base(), s.end());
-	
-	return s;
+	// Oversized requests get a block of their own so they don't waste the rest of the current one
+	size_t header = (sizeof(Block) + alignment - 1) & ~(alignment - 1);
+	bool dedicated = (bytes > mNextBlockSize / 4);
+	size_t size = dedicated ? (header + bytes) : mNextBlockSize;
+
+	Block* block = (Block*)::operator new(size);
+	block->next = mBlocks;
+	block->size = size;
+	mBlocks = block;
+	mBytesReserved += size;
+	mBytesUsed += bytes;
+
+	char* p = (char*)block + header;
+
+	if (!dedicated)
+	{
+		mCursor = p + bytes;
+		mLimit = (char*)block + size;
+
+		if (mNextBlockSize < ARENA_MAX_BLOCK_SZ)
+			mNextBlockSize *= 2;
+	}
+
+	return p;
 }
 
-// Finds the position of the first " character that is NOT preceeded immediately by a \ character.
-// In JSON, \" is valid and has a different meaning than the escaped " character.
-static size_t GetQuotePos(const std::string& str, size_t start_pos = 0)
+void Arena::Deallocate(void* p, size_t bytes)
 {
-	bool found_slash = false;
-	for (size_t i = start_pos; i < str.length(); i++)
+	bytes = (bytes + GRANULE_SZ - 1) & ~(GRANULE_SZ - 1);
+
+	if ((p == nullptr) || (bytes > RECYCLE_LIMIT))
+		return;
+
+	*(void**)p = mFreeLists[bytes / GRANULE_SZ];
+	mFreeLists[bytes / GRANULE_SZ] = p;
+}
+
+void Arena::Release()
+{
+	memset(mFreeLists, 0, sizeof(mFreeLists));
+
+	while (mBlocks != nullptr)
 	{
-		char c = str[i];
-		if ((c == '\\') && !found_slash)
-		{
-			found_slash = true;
-			continue;
-		}
-		else if ((c == '\"') && !found_slash)
-			return i;
-		
-		found_slash = false;
+		Block* next = mBlocks->next;
+		::operator delete(mBlocks);
+		mBlocks = next;
 	}
-	
-	return std::string::npos;
+
+	mCursor = nullptr;
+	mLimit = nullptr;
+	mNextBlockSize = ARENA_FIRST_BLOCK_SZ;
+	mBytesUsed = 0;
+	mBytesReserved = 0;
+}
+
+ArenaScope::ArenaScope(Arena& arena) : mPrevious(current_arena)
+{
+	current_arena = &arena;
+}
+
+ArenaScope::ArenaScope(Document& doc) : mPrevious(current_arena)
+{
+	current_arena = &doc.GetArena();
+}
+
+ArenaScope::~ArenaScope()
+{
+	current_arena = mPrevious;
+}
+
+bool Document::Parse(const char* data, size_t length, size_t* error_offset)
+{
+	Clear();
+
+	ArenaScope scope(mArena);
+	mRoot = Deserialize(data, length, error_offset);
+
+	return mRoot.GetType() != NULLVal;
+}
+
+void Document::Clear()
+{
+	mRoot = Value();
+	mArena.Release();
+}
+
+// Leaves no arena current until the scope ends, so anything allocated inside it comes from the heap
+class HeapScope
+{
+	public:
+
+		HeapScope() : mPrevious(current_arena)	{current_arena = nullptr;}
+		~HeapScope()							{current_arena = mPrevious;}
+
+	protected:
+
+		Arena*	mPrevious;
+};
+
+// Copy constructed rather than assigned: a Value's containers keep the allocator they were constructed with
+static Value CopyToHeap(const Value& v)
+{
+	HeapScope scope;
+	return v;
+}
+
+Value Document::TakeRoot()
+{
+	Value root = CopyToHeap(mRoot);
+	Clear();
+
+	return root;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -107,6 +240,31 @@ Value& Value::operator =(const Value& v)
 	return *this;
 }
 
+Value::Value(Value&& v) noexcept : mValueType(v.mValueType), mIntVal(v.mIntVal), mFloatVal(v.mFloatVal), mDoubleVal(v.mDoubleVal),
+	mStringVal(std::move(v.mStringVal)), mObjectVal(std::move(v.mObjectVal)), mArrayVal(std::move(v.mArrayVal)), mBoolVal(v.mBoolVal)
+{
+	v.mValueType = NULLVal;
+}
+
+Value& Value::operator =(Value&& v) noexcept
+{
+	if (&v == this)
+		return *this;
+
+	mValueType = v.mValueType;
+	mIntVal = v.mIntVal;
+	mFloatVal = v.mFloatVal;
+	mDoubleVal = v.mDoubleVal;
+	mStringVal = std::move(v.mStringVal);
+	mObjectVal = std::move(v.mObjectVal);
+	mArrayVal = std::move(v.mArrayVal);
+	mBoolVal = v.mBoolVal;
+
+	v.mValueType = NULLVal;
+
+	return *this;
+}
+
 Value& Value::operator [](size_t idx)
 {
 	if (mValueType != ArrayVal)
@@ -232,7 +390,7 @@ const std::string& Value::ToString() const
 	return mStringVal;
 }
 
-Object Value::ToObject() const	
+const Object& Value::ToObject() const
 {
 	if (mValueType != ObjectVal)
 		throw std::runtime_error("json mValueType==ObjectVal required");
@@ -240,7 +398,7 @@ Object Value::ToObject() const
 	return mObjectVal;
 }
 
-Array Value::ToArray() const		
+const Array& Value::ToArray() const
 {
 	if (mValueType != ArrayVal)
 		throw std::runtime_error("json mValueType==ArrayVal required");
@@ -314,6 +472,10 @@ Array::Array(const Array& a) : mValues(a.mValues)
 {
 }
 
+Array::Array(Array&& a) noexcept : mValues(std::move(a.mValues))
+{
+}
+
 Array& Array::operator =(const Array& a)
 {
 	if (&a == this)
@@ -325,6 +487,16 @@ Array& Array::operator =(const Array& a)
 	return *this;
 }
 
+Array& Array::operator =(Array&& a) noexcept
+{
+	if (&a == this)
+		return *this;
+
+	mValues = std::move(a.mValues);
+
+	return *this;
+}
+
 Value& Array::operator [](size_t i)
 {
 	return mValues[i];
@@ -361,11 +533,21 @@ void Array::push_back(const Value& v)
 	mValues.push_back(v);
 }
 
+void Array::push_back(Value&& v)
+{
+	mValues.push_back(std::move(v));
+}
+
 void Array::insert(size_t index, const Value& v)
 {
 	mValues.insert(mValues.begin() + index, v);
 }
 
+void Array::insert(size_t index, Value&& v)
+{
+	mValues.insert(mValues.begin() + index, std::move(v));
+}
+
 size_t Array::size() const
 {
 	return mValues.size();
@@ -391,6 +573,127 @@ bool Array::HasValue(const Value& v) const
 	return find(v) != end();
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Both are leaked on purpose, so Keys in static objects can still let go of their entries during shutdown
+static std::mutex& KeyTableMutex()
+{
+	static std::mutex* mutex = new std::mutex();
+	return *mutex;
+}
+
+// Node based, so the entries never move once inserted
+static std::unordered_map<std::string, std::atomic<long> >& KeyTable()
+{
+	static std::unordered_map<std::string, std::atomic<long> >* table = new std::unordered_map<std::string, std::atomic<long> >();
+	return *table;
+}
+
+static inline void Retain(Key::Entry* entry)
+{
+	entry->second.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Dropping the last reference erases the entry. That has to happen under the lock, so Intern can't hand the entry out again
+// in between; every other release is a lock free decrement.
+static void Release(Key::Entry* entry)
+{
+	long refs = entry->second.load(std::memory_order_relaxed);
+	while (refs > 1)
+	{
+		if (entry->second.compare_exchange_weak(refs, refs - 1, std::memory_order_release, std::memory_order_relaxed))
+			return;
+	}
+
+	std::lock_guard<std::mutex> lock(KeyTableMutex());
+	if (entry->second.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		KeyTable().erase(KeyTable().find(entry->first));
+}
+
+// Documents repeat the same handful of keys over and over, so each thread remembers the last few it interned and only falls
+// back to the locked, hashed table on a miss. The cache holds a reference to each entry in it, so a hit never finds one that
+// is being erased.
+struct KeyCache
+{
+	static const int CACHE_SZ = 16;
+
+	Key::Entry*	entries[CACHE_SZ];
+	int			next_slot;
+
+	KeyCache() : next_slot(0)
+	{
+		memset(entries, 0, sizeof(entries));
+	}
+
+	~KeyCache()
+	{
+		for (int i = 0; i < CACHE_SZ; i++)
+			if (entries[i] != nullptr)
+				Release(entries[i]);
+	}
+};
+
+static thread_local KeyCache key_cache;
+
+static Key::Entry* Intern(const char* key, size_t length)
+{
+	KeyCache& cache = key_cache;
+
+	for (int i = 0; i < KeyCache::CACHE_SZ; i++)
+	{
+		Key::Entry* cached = cache.entries[i];
+		if ((cached != nullptr) && (cached->first.length() == length) && (memcmp(cached->first.data(), key, length) == 0))
+		{
+			Retain(cached);
+			return cached;
+		}
+	}
+
+	Key::Entry* interned;
+	{
+		std::lock_guard<std::mutex> lock(KeyTableMutex());
+		interned = &*KeyTable().emplace(std::piecewise_construct, std::forward_as_tuple(key, length), std::forward_as_tuple(0)).first;
+
+		// one reference for the new Key, one for the cache
+		interned->second.fetch_add(2, std::memory_order_relaxed);
+	}
+
+	if (cache.entries[cache.next_slot] != nullptr)
+		Release(cache.entries[cache.next_slot]);
+
+	cache.entries[cache.next_slot] = interned;
+	cache.next_slot = (cache.next_slot + 1) % KeyCache::CACHE_SZ;
+
+	return interned;
+}
+
+Key::Key(const std::string& key) : mEntry(Intern(key.data(), key.length()))
+{
+}
+
+Key::Key(const char* key) : mEntry(Intern(key, strlen(key)))
+{
+}
+
+Key::Key(const Key& key) noexcept : mEntry(key.mEntry)
+{
+	Retain(mEntry);
+}
+
+Key& Key::operator =(const Key& key) noexcept
+{
+	Retain(key.mEntry);
+	Release(mEntry);
+	mEntry = key.mEntry;
+
+	return *this;
+}
+
+Key::~Key()
+{
+	Release(mEntry);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 Object::Object()
@@ -399,7 +702,12 @@ Object::Object()
 
 Object::Object(const Object& obj) : mValues(obj.mValues)
 {
+	if (obj.mIndex)
+		mIndex.reset(new IndexMap(*obj.mIndex));
+}
 
+Object::Object(Object&& obj) noexcept : mValues(std::move(obj.mValues)), mIndex(std::move(obj.mIndex))
+{
 }
 
 Object& Object::operator =(const Object& obj)
@@ -409,30 +717,84 @@ Object& Object::operator =(const Object& obj)
 
 	Clear();
 	mValues = obj.mValues;
+	if (obj.mIndex)
+		mIndex.reset(new IndexMap(*obj.mIndex));
+
+	return *this;
+}
+
+Object& Object::operator =(Object&& obj) noexcept
+{
+	if (&obj == this)
+		return *this;
+
+	mValues = std::move(obj.mValues);
+	mIndex = std::move(obj.mIndex);
 
 	return *this;
 }
 
+size_t Object::IndexOf(const std::string& key) const
+{
+	if (!mIndex)
+	{
+		// small object: compare the text directly, which is cheaper than hashing the key to find its interned copy
+		for (size_t i = 0; i < mValues.size(); i++)
+		{
+			const std::string& k = mValues[i].first.str();
+			if ((k.length() == key.length()) && (k == key))
+				return i;
+		}
+
+		return mValues.size();
+	}
+
+	IndexMap::const_iterator it = mIndex->find(&key);
+	return (it == mIndex->end()) ? mValues.size() : it->second;
+}
+
+void Object::BuildIndex()
+{
+	mIndex.reset(new IndexMap());
+	mIndex->reserve(mValues.size() * 2);
+
+	for (size_t i = 0; i < mValues.size(); i++)
+		(*mIndex)[&mValues[i].first.str()] = i;
+}
+
 Value& Object::operator [](const std::string& key)
 {
-	return mValues[key];
+	size_t i = IndexOf(key);
+	if (i != mValues.size())
+		return mValues[i].second;
+
+	mValues.push_back(Member(Key(key), Value()));
+
+	if (mIndex)
+		(*mIndex)[&mValues.back().first.str()] = i;
+	else if (mValues.size() > LINEAR_SEARCH_LIMIT)
+		BuildIndex();
+
+	return mValues.back().second;
 }
 
 const Value& Object::operator [](const std::string& key) const
 {
-	ValueMap::const_iterator it = mValues.find(key);
-	return it->second;
+	size_t i = IndexOf(key);
+	if (i == mValues.size())
+		throw std::runtime_error("json key not found");
+
+	return mValues[i].second;
 }
 
 Value& Object::operator [](const char* key)
 {
-	return mValues[key];
+	return operator[](std::string(key));
 }
 
 const Value& Object::operator [](const char* key) const
 {
-	ValueMap::const_iterator it = mValues.find(key);
-	return it->second;
+	return operator[](std::string(key));
 }
 
 Object::ValueMap::const_iterator Object::begin() const
@@ -457,12 +819,12 @@ Object::ValueMap::iterator Object::end()
 
 Object::ValueMap::iterator Object::find(const std::string& key)
 {
-	return mValues.find(key);
+	return mValues.begin() + IndexOf(key);
 }
 
 Object::ValueMap::const_iterator Object::find(const std::string& key) const
 {
-	return mValues.find(key);
+	return mValues.begin() + IndexOf(key);
 }
 
 bool Object::HasKey(const std::string& key) const
@@ -493,551 +855,1949 @@ int Object::HasKeys(const char** keys, int key_count) const
 void Object::Clear()
 {
 	mValues.clear();
+	mIndex.reset();
+}
+
+static bool MemberKeyLess(const Object::Member* lhs, const Object::Member* rhs)
+{
+	return lhs->first < rhs->first;
 }
 
+// Members sorted by key, which is the order a std::map would have held them in
+static std::vector<const Object::Member*> SortedMembers(const Object& obj)
+{
+	std::vector<const Object::Member*> members;
+	members.reserve(obj.size());
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-std::string SerializeArray(const Array& a);
+	for (Object::ValueMap::const_iterator it = obj.begin(); it != obj.end(); ++it)
+		members.push_back(&*it);
+
+	std::sort(members.begin(), members.end(), MemberKeyLess);
+	return members;
+}
 
-std::string SerializeValue(const Value& v)
+bool json::operator ==(const Object& lhs, const Object& rhs)
 {
-	std::string str;
+	if (lhs.size() != rhs.size())
+		return false;
 
-	static const int BUFF_SZ = 500;
-	char buff[BUFF_SZ];
-	switch (v.GetType())
+	for (Object::ValueMap::const_iterator it = lhs.begin(); it != lhs.end(); ++it)
 	{
-		case IntVal			: snprintf(buff, BUFF_SZ, "%d", (int)v); str = buff; break;
-		case FloatVal		: snprintf(buff, BUFF_SZ, "%f", (float)v); str = buff; break;
-		case DoubleVal		: snprintf(buff, BUFF_SZ, "%f", (double)v); str = buff; break;
-		case BoolVal		: str = v ? "true" : "false"; break;
-		case NULLVal		: str = "null"; break;
-		case ObjectVal		: str = Serialize(v); break;
-		case ArrayVal		: str = SerializeArray(v); break;
-		case StringVal		: str = std::string("\"") + (std::string)v + std::string("\""); break;
+		Object::ValueMap::const_iterator other = rhs.find(it->first);
+		if ((other == rhs.end()) || (other->second != it->second))
+			return false;
 	}
 
-	return str;
+	return true;
 }
 
-std::string SerializeArray(const Array& a)
+bool json::operator <(const Object& lhs, const Object& rhs)
 {
-	std::string str = "[";
+	std::vector<const Object::Member*> l = SortedMembers(lhs);
+	std::vector<const Object::Member*> r = SortedMembers(rhs);
 
-	bool first = true;
-	for (size_t i = 0; i < a.size(); i++)
+	for (size_t i = 0; (i < l.size()) && (i < r.size()); i++)
 	{
-		const Value& v = a[i];
-		if (!first)
-			str += std::string(",");
+		if (l[i]->first != r[i]->first)
+			return l[i]->first < r[i]->first;
+
+		if (l[i]->second < r[i]->second)
+			return true;
+		else if (r[i]->second < l[i]->second)
+			return false;
+	}
+
+	return l.size() < r.size();
+}
 
-		str += SerializeValue(v);
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static const char DIGIT_PAIRS[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+void json::WriteInt(std::string& out, int v)
+{
+	// written back to front two digits at a time, unsigned so INT_MIN can be negated
+	char buff[12];
+	char* p = buff + sizeof(buff);
+	unsigned int u = (v < 0) ? 0u - (unsigned int)v : (unsigned int)v;
+
+	while (u >= 100)
+	{
+		unsigned int pair = (u % 100) * 2;
+		u /= 100;
+		*--p = DIGIT_PAIRS[pair + 1];
+		*--p = DIGIT_PAIRS[pair];
+	}
 
-		first = false;
+	if (u >= 10)
+	{
+		*--p = DIGIT_PAIRS[u * 2 + 1];
+		*--p = DIGIT_PAIRS[u * 2];
 	}
+	else
+		*--p = (char)('0' + u);
 
-	str += "]";
-	return str;
+	if (v < 0)
+		*--p = '-';
+
+	out.append(p, buff + sizeof(buff) - p);
 }
 
-std::string json::Serialize(const Value& v)
+// Shortest round trip formatting of doubles and floats with Grisu2 (Florian Loitsch, "Printing Floating-Point Numbers
+// Quickly and Accurately with Integers", 2010). v and the boundaries halfway to its neighbours are scaled by a cached power
+// of ten into 64 bit integers, and digits are generated until the number lies between the scaled boundaries, so it reads
+// back as exactly v. The result is the shortest such number in all but a tiny fraction of cases, and never longer than 17
+// (9 for floats) digits. This avoids the printf/strtod round trips, which cost more than the rest of serialization.
+struct DiyFp
 {
-	std::string str;
+	uint64_t f;
+	int e;
 
-	bool first = true;
-	
-	if (v.GetType() == ObjectVal)
-	{
-		str = "{";
-		Object obj = v.ToObject();
-		for (Object::ValueMap::const_iterator it = obj.begin(); it != obj.end(); ++it)
-		{
-			if (!first)
-				str += std::string(",");
+	DiyFp(uint64_t f_, int e_) : f(f_), e(e_) {}
+};
 
-			str += std::string("\"") + it->first + std::string("\":") + SerializeValue(it->second);
-			first = false;
-		}
+static inline DiyFp Subtract(const DiyFp& x, const DiyFp& y)
+{
+	return DiyFp(x.f - y.f, x.e);
+}
 
-		str += "}";
-	}
-	else if (v.GetType() == ArrayVal)
+// The upper 64 bits of the 128 bit product, rounded
+static inline DiyFp Multiply(const DiyFp& x, const DiyFp& y)
+{
+	const uint64_t x_lo = x.f & 0xFFFFFFFFu;
+	const uint64_t x_hi = x.f >> 32;
+	const uint64_t y_lo = y.f & 0xFFFFFFFFu;
+	const uint64_t y_hi = y.f >> 32;
+
+	const uint64_t p0 = x_lo * y_lo;
+	const uint64_t p1 = x_lo * y_hi;
+	const uint64_t p2 = x_hi * y_lo;
+	const uint64_t p3 = x_hi * y_hi;
+
+	uint64_t mid = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu);
+	mid += (uint64_t)1 << 31;
+
+	return DiyFp(p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32), x.e + y.e + 64);
+}
+
+static inline DiyFp Normalize(DiyFp x)
+{
+	while ((x.f >> 63) == 0)
 	{
-		str = "[";
-		Array a = v.ToArray();
-		for (Array::ValueVector::const_iterator it = a.begin(); it != a.end(); ++it)
-		{
-			if (!first)
-				str += std::string(",");
-			
-			str += SerializeValue(*it);
-			first = false;
-		}
-		
-		str += "]";
-			
+		x.f <<= 1;
+		x.e--;
 	}
-	// else it's not valid JSON, as a JSON data structure must be an array or an object. We'll return an empty string.
-		
-	
-	return str;
-}
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-static Value DeserializeArray(std::string& str, std::stack<StackDepthType>& depth_stack);
-static Value DeserializeObj(const std::string& _str, std::stack<StackDepthType>& depth_stack);
+	return x;
+}
 
-static Value DeserializeInternal(const std::string& _str, std::stack<StackDepthType>& depth_stack)
+// v, and the boundaries m- and m+ halfway to the neighbouring values of T, with m- and m+ normalized to the same exponent
+template <typename T>
+static void ComputeBoundaries(T value, DiyFp& v, DiyFp& m_minus, DiyFp& m_plus)
 {
-	Value v;
-	
-	std::string str = Trim(_str);
-	if (str[0] == '{')
-	{
-		// Error: Began with a { but doesn't end with one
-		if (str[str.length() - 1] != '}')
-			return Value();
-		
-		depth_stack.push(InObject);
-		v = DeserializeObj(str, depth_stack);
-		if ((v.GetType() == NULLVal) || (depth_stack.top() != InObject))
-			return v;
-		
-		depth_stack.pop();
-	}
-	else if (str[0] == '[')
-	{
-		// Error: Began with a [ but doesn't end with one
-		if (str[str.length() - 1] != ']')
-			return Value();
-		
-		depth_stack.push(InArray);
-		v = DeserializeArray(str, depth_stack);
-		if ((v.GetType() == NULLVal) || (depth_stack.top() != InArray))
-			return v;
-		
-		depth_stack.pop();
+	static const int PRECISION = std::numeric_limits<T>::digits;
+	static const int BIAS = std::numeric_limits<T>::max_exponent - 1 + (PRECISION - 1);
+	static const uint64_t HIDDEN_BIT = (uint64_t)1 << (PRECISION - 1);
+
+	uint64_t bits;
+	if (sizeof(T) == sizeof(uint64_t))
+	{
+		uint64_t raw;
+		memcpy(&raw, &value, sizeof(raw));
+		bits = raw;
 	}
 	else
 	{
-		// Will never get here unless _str is not valid JSON
-		return Value();
+		uint32_t raw;
+		memcpy(&raw, &value, sizeof(raw));
+		bits = raw;
 	}
-	
-	return v;
-}
 
-static size_t GetEndOfArrayOrObj(const std::string& str, std::stack<StackDepthType>& depth_stack)
-{
-	size_t i = 1;
-	bool in_quote = false;
-	size_t original_count = depth_stack.size();
-	
-	for (; i < str.length(); i++)
+	const uint64_t biased_exponent = bits >> (PRECISION - 1);
+	const uint64_t fraction = bits & (HIDDEN_BIT - 1);
+
+	DiyFp raw_v = (biased_exponent == 0) ? DiyFp(fraction, 1 - BIAS) : DiyFp(fraction + HIDDEN_BIT, (int)biased_exponent - BIAS);
+
+	// at a power of two the next value down is half as far away as the next value up
+	const bool lower_is_closer = (fraction == 0) && (biased_exponent > 1);
+
+	m_plus = Normalize(DiyFp((raw_v.f << 1) + 1, raw_v.e - 1));
+	DiyFp lower = lower_is_closer ? DiyFp((raw_v.f << 2) - 1, raw_v.e - 2) : DiyFp((raw_v.f << 1) - 1, raw_v.e - 1);
+	m_minus = DiyFp(lower.f << (lower.e - m_plus.e), m_plus.e);
+	v = Normalize(raw_v);
+}
+
+struct CachedPower
+{
+	uint64_t f;
+	int e;
+	int k;
+};
+
+// 10^k for k = -300, -292, ..., 324, as normalized 64 bit significands and binary exponents
+static const CachedPower CACHED_POWERS[] =
+{
+	{ 0xAB70FE17C79AC6CA, -1060, -300 },
+	{ 0xFF77B1FCBEBCDC4F, -1034, -292 },
+	{ 0xBE5691EF416BD60C, -1007, -284 },
+	{ 0x8DD01FAD907FFC3C,  -980, -276 },
+	{ 0xD3515C2831559A83,  -954, -268 },
+	{ 0x9D71AC8FADA6C9B5,  -927, -260 },
+	{ 0xEA9C227723EE8BCB,  -901, -252 },
+	{ 0xAECC49914078536D,  -874, -244 },
+	{ 0x823C12795DB6CE57,  -847, -236 },
+	{ 0xC21094364DFB5637,  -821, -228 },
+	{ 0x9096EA6F3848984F,  -794, -220 },
+	{ 0xD77485CB25823AC7,  -768, -212 },
+	{ 0xA086CFCD97BF97F4,  -741, -204 },
+	{ 0xEF340A98172AACE5,  -715, -196 },
+	{ 0xB23867FB2A35B28E,  -688, -188 },
+	{ 0x84C8D4DFD2C63F3B,  -661, -180 },
+	{ 0xC5DD44271AD3CDBA,  -635, -172 },
+	{ 0x936B9FCEBB25C996,  -608, -164 },
+	{ 0xDBAC6C247D62A584,  -582, -156 },
+	{ 0xA3AB66580D5FDAF6,  -555, -148 },
+	{ 0xF3E2F893DEC3F126,  -529, -140 },
+	{ 0xB5B5ADA8AAFF80B8,  -502, -132 },
+	{ 0x87625F056C7C4A8B,  -475, -124 },
+	{ 0xC9BCFF6034C13053,  -449, -116 },
+	{ 0x964E858C91BA2655,  -422, -108 },
+	{ 0xDFF9772470297EBD,  -396, -100 },
+	{ 0xA6DFBD9FB8E5B88F,  -369,  -92 },
+	{ 0xF8A95FCF88747D94,  -343,  -84 },
+	{ 0xB94470938FA89BCF,  -316,  -76 },
+	{ 0x8A08F0F8BF0F156B,  -289,  -68 },
+	{ 0xCDB02555653131B6,  -263,  -60 },
+	{ 0x993FE2C6D07B7FAC,  -236,  -52 },
+	{ 0xE45C10C42A2B3B06,  -210,  -44 },
+	{ 0xAA242499697392D3,  -183,  -36 },
+	{ 0xFD87B5F28300CA0E,  -157,  -28 },
+	{ 0xBCE5086492111AEB,  -130,  -20 },
+	{ 0x8CBCCC096F5088CC,  -103,  -12 },
+	{ 0xD1B71758E219652C,   -77,   -4 },
+	{ 0x9C40000000000000,   -50,    4 },
+	{ 0xE8D4A51000000000,   -24,   12 },
+	{ 0xAD78EBC5AC620000,     3,   20 },
+	{ 0x813F3978F8940984,    30,   28 },
+	{ 0xC097CE7BC90715B3,    56,   36 },
+	{ 0x8F7E32CE7BEA5C70,    83,   44 },
+	{ 0xD5D238A4ABE98068,   109,   52 },
+	{ 0x9F4F2726179A2245,   136,   60 },
+	{ 0xED63A231D4C4FB27,   162,   68 },
+	{ 0xB0DE65388CC8ADA8,   189,   76 },
+	{ 0x83C7088E1AAB65DB,   216,   84 },
+	{ 0xC45D1DF942711D9A,   242,   92 },
+	{ 0x924D692CA61BE758,   269,  100 },
+	{ 0xDA01EE641A708DEA,   295,  108 },
+	{ 0xA26DA3999AEF774A,   322,  116 },
+	{ 0xF209787BB47D6B85,   348,  124 },
+	{ 0xB454E4A179DD1877,   375,  132 },
+	{ 0x865B86925B9BC5C2,   402,  140 },
+	{ 0xC83553C5C8965D3D,   428,  148 },
+	{ 0x952AB45CFA97A0B3,   455,  156 },
+	{ 0xDE469FBD99A05FE3,   481,  164 },
+	{ 0xA59BC234DB398C25,   508,  172 },
+	{ 0xF6C69A72A3989F5C,   534,  180 },
+	{ 0xB7DCBF5354E9BECE,   561,  188 },
+	{ 0x88FCF317F22241E2,   588,  196 },
+	{ 0xCC20CE9BD35C78A5,   614,  204 },
+	{ 0x98165AF37B2153DF,   641,  212 },
+	{ 0xE2A0B5DC971F303A,   667,  220 },
+	{ 0xA8D9D1535CE3B396,   694,  228 },
+	{ 0xFB9B7CD9A4A7443C,   720,  236 },
+	{ 0xBB764C4CA7A44410,   747,  244 },
+	{ 0x8BAB8EEFB6409C1A,   774,  252 },
+	{ 0xD01FEF10A657842C,   800,  260 },
+	{ 0x9B10A4E5E9913129,   827,  268 },
+	{ 0xE7109BFBA19C0C9D,   853,  276 },
+	{ 0xAC2820D9623BF429,   880,  284 },
+	{ 0x80444B5E7AA7CF85,   907,  292 },
+	{ 0xBF21E44003ACDD2D,   933,  300 },
+	{ 0x8E679C2F5E44FF8F,   960,  308 },
+	{ 0xD433179D9C8CB841,   986,  316 },
+	{ 0x9E19DB92B4E31BA9,  1013,  324 },
+};
+
+static const int CACHED_POWERS_MIN_DEC_EXP = -300;
+static const int CACHED_POWERS_DEC_STEP = 8;
+
+// The scaled numbers' exponents are kept in [ALPHA, GAMMA], so the integral part of M+ fits in 32 bits
+static const int GRISU_ALPHA = -60;
+static const int GRISU_GAMMA = -32;
+
+// The cached power c = 10^-k that brings a number with binary exponent e into [ALPHA, GAMMA]
+static const CachedPower& CachedPowerForBinaryExponent(int e)
+{
+	// k = ceil((ALPHA - e - 1) * log10(2)), 78913 / 2^18 being just over log10(2)
+	const int f = GRISU_ALPHA - e - 1;
+	const int k = (f * 78913) / (1 << 18) + (f > 0 ? 1 : 0);
+	const int index = (-CACHED_POWERS_MIN_DEC_EXP + k + (CACHED_POWERS_DEC_STEP - 1)) / CACHED_POWERS_DEC_STEP;
+
+	return CACHED_POWERS[index];
+}
+
+// Number of decimal digits in n, and the largest power of ten no greater than n
+static inline int FindLargestPow10(uint32_t n, uint32_t& pow10)
+{
+	static const uint32_t POWERS[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+	int digits = 10;
+	while ((digits > 1) && (n < POWERS[digits - 1]))
+		digits--;
+
+	pow10 = POWERS[digits - 1];
+	return digits;
+}
+
+// Moves the last digit down towards w while the result stays above M- and gets closer to w
+static inline void GrisuRound(char* buff, int length, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t ten_k)
+{
+	while ((rest < dist) && (delta - rest >= ten_k) && ((rest + ten_k < dist) || (dist - rest > rest + ten_k - dist)))
+	{
+		buff[length - 1]--;
+		rest += ten_k;
+	}
+}
+
+// Generates the digits of M+ until what's left is within delta = M+ - M-, so the number lies in (M-, M+)
+static void GrisuDigitGen(char* buff, int& length, int& decimal_exponent, const DiyFp& m_minus, const DiyFp& w, const DiyFp& m_plus)
+{
+	uint64_t delta = Subtract(m_plus, m_minus).f;
+	uint64_t dist = Subtract(m_plus, w).f;
+
+	const int shift = -m_plus.e;
+	const uint64_t one = (uint64_t)1 << shift;
+
+	uint32_t integral = (uint32_t)(m_plus.f >> shift);
+	uint64_t fractional = m_plus.f & (one - 1);
+
+	uint32_t pow10;
+	int n = FindLargestPow10(integral, pow10);
+
+	while (n > 0)
+	{
+		buff[length++] = (char)('0' + integral / pow10);
+		integral %= pow10;
+		n--;
+
+		const uint64_t rest = ((uint64_t)integral << shift) + fractional;
+		if (rest <= delta)
+		{
+			decimal_exponent += n;
+			GrisuRound(buff, length, dist, delta, rest, (uint64_t)pow10 << shift);
+			return;
+		}
+
+		pow10 /= 10;
+	}
+
+	int m = 0;
+	for (;;)
+	{
+		fractional *= 10;
+		buff[length++] = (char)('0' + (fractional >> shift));
+		fractional &= one - 1;
+		m++;
+
+		delta *= 10;
+		dist *= 10;
+		if (fractional <= delta)
+			break;
+	}
+
+	decimal_exponent -= m;
+	GrisuRound(buff, length, dist, delta, fractional, one);
+}
+
+// Digits of a positive, finite v in buff, and the power of ten to multiply them by
+template <typename T>
+static void Grisu2(char* buff, int& length, int& decimal_exponent, T value)
+{
+	DiyFp v(0, 0), m_minus(0, 0), m_plus(0, 0);
+	ComputeBoundaries(value, v, m_minus, m_plus);
+
+	const CachedPower& cached = CachedPowerForBinaryExponent(m_plus.e);
+	const DiyFp c_minus_k(cached.f, cached.e);
+
+	const DiyFp w = Multiply(v, c_minus_k);
+	const DiyFp w_minus = Multiply(m_minus, c_minus_k);
+	const DiyFp w_plus = Multiply(m_plus, c_minus_k);
+
+	// the products are off by up to one unit either way, so the interval is narrowed to stay safe
+	length = 0;
+	decimal_exponent = -cached.k;
+	GrisuDigitGen(buff, length, decimal_exponent, DiyFp(w_minus.f + 1, w_minus.e), w, DiyFp(w_plus.f - 1, w_plus.e));
+}
+
+// Writes digits * 10^decimal_exponent the way %g would, switching to an exponent outside 1e-4 to 10^max_exp.
+// Integral results get a ".0" so the number reads back as a floating point type rather than an int.
+static void WriteDigits(std::string& out, char* digits, int length, int decimal_exponent, int max_exp)
+{
+	const int point = length + decimal_exponent;
+
+	if ((length <= point) && (point <= max_exp))
+	{
+		// digits[000].0
+		out.append(digits, length);
+		out.append(point - length, '0');
+		out += ".0";
+	}
+	else if ((0 < point) && (point <= max_exp))
+	{
+		// dig.its
+		out.append(digits, point);
+		out += '.';
+		out.append(digits + point, length - point);
+	}
+	else if ((-4 < point) && (point <= 0))
+	{
+		// 0.[000]digits
+		out += "0.";
+		out.append(-point, '0');
+		out.append(digits, length);
+	}
+	else
+	{
+		// d.igitse+123
+		out += digits[0];
+		if (length > 1)
+		{
+			out += '.';
+			out.append(digits + 1, length - 1);
+		}
+
+		int exponent = point - 1;
+		out += 'e';
+		out += (exponent < 0) ? '-' : '+';
+		if (exponent < 0)
+			exponent = -exponent;
+
+		if (exponent < 10)
+			out += '0';
+		WriteInt(out, exponent);
+	}
+}
+
+// Writes v with the fewest significant digits that read back as exactly v, keeping the sign of zero
+template <typename T>
+static void WriteShortestFloatingPoint(std::string& out, T v, int max_exp)
+{
+	// JSON has no representation for nan/infinity
+	if ((v != v) || (v - v != v - v))
+	{
+		out += "null";
+		return;
+	}
+
+	if (std::signbit(v))
+	{
+		out += '-';
+		v = -v;
+	}
+
+	if (v == 0)
+	{
+		out += "0.0";
+		return;
+	}
+
+	char digits[32];
+	int length, decimal_exponent;
+	Grisu2(digits, length, decimal_exponent, v);
+	WriteDigits(out, digits, length, decimal_exponent, max_exp);
+}
+
+void json::WriteDouble(std::string& out, double v)
+{
+	WriteShortestFloatingPoint(out, v, 17);
+}
+
+void json::WriteFloat(std::string& out, float v)
+{
+	WriteShortestFloatingPoint(out, v, 9);
+}
+
+#ifdef JSON_USE_SSE2
+static inline int CountTrailingZeros(int bits)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, (unsigned long)bits);
+	return (int)index;
+#else
+	return __builtin_ctz((unsigned int)bits);
+#endif
+}
+#endif
+
+// Returns the first byte in [p, end) that can't be copied through verbatim: '"', '\', a control character or a non-ASCII byte
+// (which still has to be checked for valid UTF-8). Scans 16 bytes at a time where SSE2 is available.
+static inline const char* FindSpecialCharacter(const char* p, const char* end)
+{
+#ifdef JSON_USE_SSE2
+	const __m128i quote = _mm_set1_epi8('\"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i last_control = _mm_set1_epi8(0x1F);
+
+	for (; end - p >= 16; p += 16)
+	{
+		__m128i chunk = _mm_loadu_si128((const __m128i*)p);
+		__m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+
+		// unsigned c <= 0x1F is the same as min(c, 0x1F) == c
+		special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(chunk, last_control), chunk));
+
+		// movemask of the raw bytes picks up the high bit of anything non-ASCII
+		int bits = _mm_movemask_epi8(special) | _mm_movemask_epi8(chunk);
+		if (bits != 0)
+			return p + CountTrailingZeros(bits);
+	}
+#endif
+
+	for (; p < end; ++p)
+	{
+		unsigned char c = (unsigned char)*p;
+		if ((c < 0x20) || (c == '\"') || (c == '\\') || (c >= 0x80))
+			return p;
+	}
+
+	return end;
+}
+
+// Length of the well formed UTF-8 sequence starting at p, or 0 if it's truncated, overlong, a surrogate or beyond U+10FFFF
+static size_t UTF8SequenceLength(const unsigned char* p, const unsigned char* end)
+{
+	unsigned char c = p[0];
+	size_t length;
+
+	if (c < 0x80)
+		return 1;
+	else if (c < 0xC2)
+		return 0;
+	else if (c < 0xE0)
+		length = 2;
+	else if (c < 0xF0)
+		length = 3;
+	else if (c < 0xF5)
+		length = 4;
+	else
+		return 0;
+
+	if ((size_t)(end - p) < length)
+		return 0;
+
+	for (size_t i = 1; i < length; i++)
+		if ((p[i] & 0xC0) != 0x80)
+			return 0;
+
+	// the second byte range is narrower for these leads, which rules out overlong forms, surrogates and > U+10FFFF
+	if (((c == 0xE0) && (p[1] < 0xA0)) || ((c == 0xED) && (p[1] >= 0xA0)) || ((c == 0xF0) && (p[1] < 0x90)) || ((c == 0xF4) && (p[1] >= 0x90)))
+		return 0;
+
+	return length;
+}
+
+bool json::IsValidUTF8(const char* str, size_t length)
+{
+	const char* p = str;
+	const char* end = str + length;
+
+	while (p < end)
+	{
+#ifdef JSON_USE_SSE2
+		// skip over pure ASCII 16 bytes at a time
+		while ((end - p >= 16) && (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p)) == 0))
+			p += 16;
+
+		if (p >= end)
+			break;
+#endif
+
+		size_t sequence = UTF8SequenceLength((const unsigned char*)p, (const unsigned char*)end);
+		if (sequence == 0)
+			return false;
+
+		p += sequence;
+	}
+
+	return true;
+}
+
+bool json::IsValidUTF8(const std::string& str)
+{
+	return IsValidUTF8(str.data(), str.length());
+}
+
+void json::WriteString(std::string& out, const char* str, size_t length)
+{
+	static const char HEX[] = "0123456789abcdef";
+	const char* p = str;
+	const char* end = str + length;
+
+	out += '\"';
+
+	for (;;)
+	{
+		// copy the clean run in one go, then deal with the character that stopped it
+		const char* special = FindSpecialCharacter(p, end);
+		out.append(p, special - p);
+		p = special;
+
+		if (p >= end)
+			break;
+
+		unsigned char c = (unsigned char)*p;
+		switch (c)
+		{
+			case '\"'	: out += "\\\""; break;
+			case '\\'	: out += "\\\\"; break;
+			case '\b'	: out += "\\b"; break;
+			case '\f'	: out += "\\f"; break;
+			case '\n'	: out += "\\n"; break;
+			case '\r'	: out += "\\r"; break;
+			case '\t'	: out += "\\t"; break;
+
+			default		:
+				if (c < 0x20)
+				{
+					char escaped[6] = {'\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xF]};
+					out.append(escaped, 6);
+				}
+				else
+				{
+					// Non-ASCII. OCR output isn't guaranteed to be valid UTF-8, so anything malformed becomes U+FFFD
+					// (the replacement character) rather than producing a document other parsers would reject.
+					size_t sequence = UTF8SequenceLength((const unsigned char*)p, (const unsigned char*)end);
+					if (sequence == 0)
+						out += "\xEF\xBF\xBD";
+					else
+					{
+						out.append(p, sequence);
+						p += sequence - 1;
+					}
+				}
+				break;
+		}
+
+		++p;
+	}
+
+	out += '\"';
+}
+
+void json::WriteString(std::string& out, const std::string& str)
+{
+	WriteString(out, str.data(), str.length());
+}
+
+static void SerializeObject(const Object& obj, std::string& out);
+static void SerializeArray(const Array& a, std::string& out);
+
+static void SerializeValue(const Value& v, std::string& out)
+{
+	switch (v.GetType())
+	{
+		case IntVal			: WriteInt(out, v.ToInt()); break;
+		case FloatVal		: WriteFloat(out, v.ToFloat()); break;
+		case DoubleVal		: WriteDouble(out, v.ToDouble()); break;
+		case BoolVal		: out += v.ToBool() ? "true" : "false"; break;
+		case NULLVal		: out += "null"; break;
+		case ObjectVal		: SerializeObject(v.ToObject(), out); break;
+		case ArrayVal		: SerializeArray(v.ToArray(), out); break;
+		case StringVal		: WriteString(out, v.ToString()); break;
+	}
+}
+
+static void SerializeArray(const Array& a, std::string& out)
+{
+	out += '[';
+
+	for (Array::ValueVector::const_iterator it = a.begin(); it != a.end(); ++it)
+	{
+		if (it != a.begin())
+			out += ',';
+
+		SerializeValue(*it, out);
+	}
+
+	out += ']';
+}
+
+static void SerializeObject(const Object& obj, std::string& out)
+{
+	out += '{';
+
+	for (Object::ValueMap::const_iterator it = obj.begin(); it != obj.end(); ++it)
+	{
+		if (it != obj.begin())
+			out += ',';
+
+		WriteString(out, it->first);
+		out += ':';
+		SerializeValue(it->second, out);
+	}
+
+	out += '}';
+}
+
+void json::SerializeTo(const Value& v, std::string& out)
+{
+	SerializeValue(v, out);
+}
+
+void json::SerializeTo(const Object& obj, std::string& out)
+{
+	SerializeObject(obj, out);
+}
+
+void json::SerializeTo(const Array& a, std::string& out)
+{
+	SerializeArray(a, out);
+}
+
+std::string json::Serialize(const Object& obj)
+{
+	std::string str;
+	SerializeObject(obj, str);
+	return str;
+}
+
+std::string json::Serialize(const Array& a)
+{
+	std::string str;
+	SerializeArray(a, str);
+	return str;
+}
+
+std::string json::Serialize(const Value& v)
+{
+	// As per JSON specification, a JSON data structure must be an array or an object. Anything else returns an empty string.
+	if ((v.GetType() != ObjectVal) && (v.GetType() != ArrayVal))
+		return std::string();
+
+	std::string str;
+	SerializeValue(v, str);
+	return str;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline const char* SkipWhitespace(const char* p, const char* end)
+{
+	while ((p < end) && ((*p == ' ') || (*p == '\t') || (*p == '\n') || (*p == '\r')))
+		++p;
+
+	return p;
+}
+
+static inline bool IsDigit(char c)
+{
+	return (c >= '0') && (c <= '9');
+}
+
+static bool ParseHex4(const char* p, const char* end, unsigned int* code_point)
+{
+	if (end - p < 4)
+		return false;
+
+	unsigned int cp = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		char c = p[i];
+		cp <<= 4;
+		if (IsDigit(c))
+			cp |= (unsigned int)(c - '0');
+		else if ((c >= 'a') && (c <= 'f'))
+			cp |= (unsigned int)(c - 'a' + 10);
+		else if ((c >= 'A') && (c <= 'F'))
+			cp |= (unsigned int)(c - 'A' + 10);
+		else
+			return false;
+	}
+
+	*code_point = cp;
+	return true;
+}
+
+static void AppendUTF8(std::string& out, unsigned int cp)
+{
+	if (cp < 0x80)
+		out.push_back((char)cp);
+	else if (cp < 0x800)
+	{
+		out.push_back((char)(0xC0 | (cp >> 6)));
+		out.push_back((char)(0x80 | (cp & 0x3F)));
+	}
+	else if (cp < 0x10000)
+	{
+		out.push_back((char)(0xE0 | (cp >> 12)));
+		out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+		out.push_back((char)(0x80 | (cp & 0x3F)));
+	}
+	else
+	{
+		out.push_back((char)(0xF0 | (cp >> 18)));
+		out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+		out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+		out.push_back((char)(0x80 | (cp & 0x3F)));
+	}
+}
+
+// p must point at the opening quote. On success the unescaped contents are in out and p is just past the closing quote.
+// On failure p is left on the offending character.
+static bool ParseString(const char*& p, const char* end, std::string& out)
+{
+	out.clear();
+	++p;
+
+	for (;;)
+	{
+		// copy runs of plain characters in one go
+		const char* run = p;
+		while ((p < end) && (*p != '\"') && (*p != '\\') && ((unsigned char)*p >= 0x20))
+			++p;
+
+		out.append(run, p - run);
+
+		if (p >= end)
+			return false;
+
+		if (*p == '\"')
+		{
+			++p;
+			return true;
+		}
+
+		// unescaped control characters aren't allowed inside a JSON string
+		if (*p != '\\')
+			return false;
+
+		if (++p >= end)
+			return false;
+
+		switch (*p)
+		{
+			case '\"'	: out.push_back('\"'); break;
+			case '\\'	: out.push_back('\\'); break;
+			case '/'	: out.push_back('/'); break;
+			case 't'	: out.push_back('\t'); break;
+			case 'n'	: out.push_back('\n'); break;
+			case 'r'	: out.push_back('\r'); break;
+			case 'b'	: out.push_back('\b'); break;
+			case 'f'	: out.push_back('\f'); break;
+			case 'u'	:
+			{
+				unsigned int cp;
+				if (!ParseHex4(p + 1, end, &cp))
+					return false;
+
+				p += 4;
+
+				if ((cp >= 0xD800) && (cp <= 0xDBFF))
+				{
+					// high surrogate, must be followed by an escaped low surrogate
+					unsigned int low;
+					if ((end - p < 7) || (p[1] != '\\') || (p[2] != 'u') || !ParseHex4(p + 3, end, &low) || (low < 0xDC00) || (low > 0xDFFF))
+						return false;
+
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+					p += 6;
+				}
+				else if ((cp >= 0xDC00) && (cp <= 0xDFFF))
+					return false;
+
+				AppendUTF8(out, cp);
+				break;
+			}
+
+			default:
+				return false;
+		}
+
+		++p;
+	}
+}
+
+// Integers that fit in an int come back with *is_int set, everything else (fractions, exponents, big integers) as a double.
+static bool ParseNumber(const char*& p, const char* end, bool* is_int_val, int* int_val, double* double_val)
+{
+	const char* start = p;
+	bool is_int = true;
+
+	if ((p < end) && (*p == '-'))
+		++p;
+
+	// As per JSON standards, a number must start with a digit (so no .1 or e4) and can't have leading zeros
+	if ((p >= end) || !IsDigit(*p))
+		return false;
+
+	if (*p == '0')
+		++p;
+	else
+		while ((p < end) && IsDigit(*p))
+			++p;
+
+	if ((p < end) && (*p == '.'))
+	{
+		is_int = false;
+		if ((++p >= end) || !IsDigit(*p))
+			return false;
+
+		while ((p < end) && IsDigit(*p))
+			++p;
+	}
+
+	if ((p < end) && ((*p == 'e') || (*p == 'E')))
+	{
+		is_int = false;
+		if ((++p < end) && ((*p == '+') || (*p == '-')))
+			++p;
+
+		if ((p >= end) || !IsDigit(*p))
+			return false;
+
+		while ((p < end) && IsDigit(*p))
+			++p;
+	}
+
+	// Fast path for the common case, at most 10 digits (after the sign) can't overflow a long long
+	if (is_int && ((p - start) - (*start == '-') <= 10))
+	{
+		const char* d = start;
+		bool negative = (*d == '-');
+		if (negative)
+			++d;
+
+		long long ival = 0;
+		for (; d < p; ++d)
+			ival = (ival * 10) + (*d - '0');
+
+		if (negative)
+			ival = -ival;
+
+		if ((ival >= INT_MIN) && (ival <= INT_MAX))
+		{
+			*is_int_val = true;
+			*int_val = (int)ival;
+			*double_val = (double)ival;
+			return true;
+		}
+	}
+
+	// strtod needs a terminated string, so copy the (already validated) number out of the input
+	static const int BUFF_SZ = 64;
+	char buff[BUFF_SZ];
+	std::string long_number;
+	const char* number;
+	size_t length = (size_t)(p - start);
+
+	if (length < BUFF_SZ)
+	{
+		memcpy(buff, start, length);
+		buff[length] = '\0';
+		number = buff;
+	}
+	else
+	{
+		long_number.assign(start, length);
+		number = long_number.c_str();
+	}
+
+	errno = 0;
+	double d = strtod(number, nullptr);
+	if ((errno == ERANGE) && ((d == HUGE_VAL) || (d == -HUGE_VAL)))
+	{
+		// too big for a double
+		p = start;
+		return false;
+	}
+
+	*is_int_val = false;
+	*int_val = (int)d;
+	*double_val = d;
+	return true;
+}
+
+static bool ParseLiteral(const char*& p, const char* end, const char* literal, size_t length)
+{
+	if (((size_t)(end - p) < length) || (memcmp(p, literal, length) != 0))
+		return false;
+
+	p += length;
+	return true;
+}
+
+static bool ParseValue(const char*& p, const char* end, Value& out, int depth);
+
+static bool ParseArray(const char*& p, const char* end, Value& out, int depth)
+{
+	if (depth > MAX_DEPTH)
+		return false;
+
+	Array a;
+
+	p = SkipWhitespace(p + 1, end);
+	if ((p < end) && (*p == ']'))
+	{
+		++p;
+		out = Value(std::move(a));
+		return true;
+	}
+
+	for (;;)
+	{
+		// parse straight into the array's slot so nested values are never copied
+		a.push_back(Value());
+		if (!ParseValue(p, end, a[a.size() - 1], depth))
+			return false;
+
+		p = SkipWhitespace(p, end);
+		if (p >= end)
+			return false;
+
+		if (*p == ']')
+			break;
+		else if (*p != ',')
+			return false;
+
+		++p;
+	}
+
+	++p;
+	out = Value(std::move(a));
+	return true;
+}
+
+static bool ParseObject(const char*& p, const char* end, Value& out, int depth)
+{
+	if (depth > MAX_DEPTH)
+		return false;
+
+	Object obj;
+	std::string key;
+
+	p = SkipWhitespace(p + 1, end);
+	if ((p < end) && (*p == '}'))
+	{
+		++p;
+		out = Value(std::move(obj));
+		return true;
+	}
+
+	for (;;)
+	{
+		if ((p >= end) || (*p != '\"') || !ParseString(p, end, key))
+			return false;
+
+		p = SkipWhitespace(p, end);
+		if ((p >= end) || (*p != ':'))
+			return false;
+
+		if (!ParseValue(++p, end, obj[key], depth))
+			return false;
+
+		p = SkipWhitespace(p, end);
+		if (p >= end)
+			return false;
+
+		if (*p == '}')
+			break;
+		else if (*p != ',')
+			return false;
+
+		p = SkipWhitespace(p + 1, end);
+	}
+
+	++p;
+	out = Value(std::move(obj));
+	return true;
+}
+
+static bool ParseValue(const char*& p, const char* end, Value& out, int depth)
+{
+	p = SkipWhitespace(p, end);
+	if (p >= end)
+		return false;
+
+	switch (*p)
+	{
+		case '{'	: return ParseObject(p, end, out, depth + 1);
+		case '['	: return ParseArray(p, end, out, depth + 1);
+		case '\"'	:
+		{
+			std::string str;
+			if (!ParseString(p, end, str))
+				return false;
+
+			out = Value(std::move(str));
+			return true;
+		}
+
+		case 't'	: out = Value(true); return ParseLiteral(p, end, "true", 4);
+		case 'f'	: out = Value(false); return ParseLiteral(p, end, "false", 5);
+		case 'n'	: out = Value(); return ParseLiteral(p, end, "null", 4);
+		default		:
+		{
+			// store all floating point as doubles. This will also set the float and int values as well.
+			bool is_int;
+			int ival;
+			double dval;
+			if (!ParseNumber(p, end, &is_int, &ival, &dval))
+				return false;
+
+			out = is_int ? Value(ival) : Value(dval);
+			return true;
+		}
+	}
+}
+
+Value json::Deserialize(const char* data, size_t length, size_t* error_offset)
+{
+	const char* end = data + length;
+	const char* p = SkipWhitespace(data, end);
+	Value v;
+
+	// As a top level object must be either an array or an object, anything else is an error. Trailing garbage is too.
+	bool ok = (p < end) && ((*p == '{') || (*p == '[')) && ParseValue(p, end, v, 0);
+	if (ok)
+	{
+		p = SkipWhitespace(p, end);
+		ok = (p == end);
+	}
+
+	if (error_offset != nullptr)
+		*error_offset = ok ? std::string::npos : (size_t)(p - data);
+
+	if (!ok)
+		return Value();
+
+	return v;
+}
+
+Value json::Deserialize(const std::string& str, size_t* error_offset)
+{
+	return Deserialize(str.data(), str.length(), error_offset);
+}
+
+Value json::Deserialize(const std::string& str)
+{
+	return Deserialize(str.data(), str.length(), nullptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CBOR major types (the top 3 bits of an item's first byte)
+enum CBORMajorType
+{
+	CBORUnsigned	= 0,
+	CBORNegative	= 1,
+	CBORBytes		= 2,
+	CBORText		= 3,
+	CBORArray		= 4,
+	CBORMap			= 5,
+	CBORTag			= 6,
+	CBORSimple		= 7
+};
+
+static const unsigned char CBOR_FALSE = 0xF4;
+static const unsigned char CBOR_TRUE = 0xF5;
+static const unsigned char CBOR_NULL = 0xF6;
+static const unsigned char CBOR_UNDEFINED = 0xF7;
+static const unsigned char CBOR_HALF = 0xF9;
+static const unsigned char CBOR_FLOAT = 0xFA;
+static const unsigned char CBOR_DOUBLE = 0xFB;
+static const unsigned char CBOR_BREAK = 0xFF;
+static const unsigned char CBOR_INDEFINITE = 31;
+
+static inline int PutBigEndian(char* buff, unsigned long long v, int bytes)
+{
+	for (int i = bytes - 1; i >= 0; i--)
+	{
+		buff[i] = (char)(v & 0xFF);
+		v >>= 8;
+	}
+	return bytes;
+}
+
+// Writes an item's first byte plus its argument in the fewest bytes that hold it
+static inline void WriteCBORHead(std::string& out, CBORMajorType major, unsigned long long arg)
+{
+	char buff[9];
+	unsigned char type = (unsigned char)(major << 5);
+
+	if (arg < 24)
+	{
+		out += (char)(type | arg);
+		return;
+	}
+
+	int length;
+	if (arg <= 0xFF)
+	{
+		buff[0] = (char)(type | 24);
+		length = 1 + PutBigEndian(buff + 1, arg, 1);
+	}
+	else if (arg <= 0xFFFF)
+	{
+		buff[0] = (char)(type | 25);
+		length = 1 + PutBigEndian(buff + 1, arg, 2);
+	}
+	else if (arg <= 0xFFFFFFFFULL)
+	{
+		buff[0] = (char)(type | 26);
+		length = 1 + PutBigEndian(buff + 1, arg, 4);
+	}
+	else
+	{
+		buff[0] = (char)(type | 27);
+		length = 1 + PutBigEndian(buff + 1, arg, 8);
+	}
+
+	out.append(buff, length);
+}
+
+void json::WriteCBORInt(std::string& out, long long v)
+{
+	if (v >= 0)
+		WriteCBORHead(out, CBORUnsigned, (unsigned long long)v);
+	else
+		WriteCBORHead(out, CBORNegative, (unsigned long long)(-1 - v));
+}
+
+void json::WriteCBORFloat(std::string& out, float v)
+{
+	char buff[5];
+	unsigned int bits;
+	memcpy(&bits, &v, sizeof(bits));
+	buff[0] = (char)CBOR_FLOAT;
+	out.append(buff, 1 + PutBigEndian(buff + 1, bits, 4));
+}
+
+// 4 byte floats decode as FloatVal, so a double can only be written as one if the float serializes to the same JSON text.
+// Mostly it does (0.5, 12.25, 1e+20), but not for a widened float such as (double)0.1f, which is 0.10000000149011612.
+static bool WritesLikeFloat(double v, float f)
+{
+	static thread_local std::string as_double, as_float;
+	as_double.clear();
+	as_float.clear();
+	WriteDouble(as_double, v);
+	WriteFloat(as_float, f);
+
+	return as_double == as_float;
+}
+
+void json::WriteCBORDouble(std::string& out, double v)
+{
+	float f = (float)v;
+
+	if (((f == v) || std::isnan(v)) && WritesLikeFloat(v, f))
+	{
+		WriteCBORFloat(out, f);
+		return;
+	}
+
+	char buff[9];
+	unsigned long long bits;
+	memcpy(&bits, &v, sizeof(bits));
+	buff[0] = (char)CBOR_DOUBLE;
+	out.append(buff, 1 + PutBigEndian(buff + 1, bits, 8));
+}
+
+void json::WriteCBORBool(std::string& out, bool v)
+{
+	out += (char)(v ? CBOR_TRUE : CBOR_FALSE);
+}
+
+void json::WriteCBORNull(std::string& out)
+{
+	out += (char)CBOR_NULL;
+}
+
+// Keys and most values are a few bytes of ASCII, where the checks IsValidUTF8 sets up cost more than the string itself
+static inline bool IsShortASCII(const char* str, size_t length)
+{
+	if (length > 32)
+		return false;
+
+	unsigned char bits = 0;
+	for (size_t i = 0; i < length; i++)
+		bits |= (unsigned char)str[i];
+
+	return (bits & 0x80) == 0;
+}
+
+void json::WriteCBORString(std::string& out, const char* str, size_t length)
+{
+	if (IsShortASCII(str, length) || IsValidUTF8(str, length))
+	{
+		WriteCBORHead(out, CBORText, length);
+		out.append(str, length);
+		return;
+	}
+
+	// CBOR text must be valid UTF-8 too, so bad sequences are replaced with U+FFFD the same way WriteString does it
+	std::string clean;
+	clean.reserve(length + 8);
+	const unsigned char* p = (const unsigned char*)str;
+	const unsigned char* end = p + length;
+	while (p < end)
 	{
-		if (str[i] == '\"')
+		size_t sequence = UTF8SequenceLength(p, end);
+		if (sequence == 0)
 		{
-			if (str[i - 1] != '\\')
-				in_quote = !in_quote;
+			clean += "\xEF\xBF\xBD";
+			++p;
 		}
-		else if (!in_quote)
+		else
 		{
-			if (str[i] == '[')
-				depth_stack.push(InArray);
-			else if (str[i] == '{')
-				depth_stack.push(InObject);
-			else if (str[i] == ']')
-			{
-				StackDepthType t = depth_stack.top();
-				if (t != InArray)
-				{
-					// expected to be closing an array but instead we're inside an object block.
-					// Example problem: {]}
-					return std::string::npos;
-				}
-				
-				size_t count = depth_stack.size();
-				depth_stack.pop();
-				if (count == original_count)
-					break;
-			}
-			else if (str[i] == '}')
-			{
-				StackDepthType t = depth_stack.top();
-				if (t != InObject)
-				{
-					// expected to be closing an object but instead we're inside an array.
-					// Example problem: [}]
-					return std::string::npos;
-				}
-					
-				size_t count = depth_stack.size();
-				depth_stack.pop();
-				if (count == original_count)
-					break;
-			}
+			clean.append((const char*)p, sequence);
+			p += sequence;
 		}
 	}
-	
-	return i;
+
+	WriteCBORHead(out, CBORText, clean.length());
+	out += clean;
 }
 
-static std::string UnescapeJSONString(const std::string& str)
+void json::WriteCBORString(std::string& out, const std::string& str)
 {
-	std::string s = "";
-	
-	for (std::string::size_type i = 0; i < str.length(); i++)
+	WriteCBORString(out, str.data(), str.length());
+}
+
+void json::WriteCBORArrayHeader(std::string& out, size_t count)
+{
+	WriteCBORHead(out, CBORArray, count);
+}
+
+void json::WriteCBORMapHeader(std::string& out, size_t count)
+{
+	WriteCBORHead(out, CBORMap, count);
+}
+
+void json::WriteCBORIndefiniteArrayHeader(std::string& out)
+{
+	out += (char)((CBORArray << 5) | CBOR_INDEFINITE);
+}
+
+void json::WriteCBORBreak(std::string& out)
+{
+	out += (char)CBOR_BREAK;
+}
+
+static void EncodeCBORValue(const Value& v, std::string& out)
+{
+	switch (v.GetType())
 	{
-		char c = str[i];
-		if ((c == '\\') && (i + 1 < str.length()))
+		case NULLVal		: WriteCBORNull(out); break;
+		case StringVal		: WriteCBORString(out, v.ToString()); break;
+		case IntVal			: WriteCBORInt(out, v.ToInt()); break;
+		case FloatVal		: WriteCBORFloat(out, v.ToFloat()); break;
+		case DoubleVal		: WriteCBORDouble(out, v.ToDouble()); break;
+		case BoolVal		: WriteCBORBool(out, v.ToBool()); break;
+
+		case ObjectVal		:
 		{
-			int skip_ahead = 1;
-			unsigned int hex;
-			std::string hex_str;
-			
-			switch (str[i+1])
+			const Object& obj = v.ToObject();
+			WriteCBORMapHeader(out, obj.size());
+			for (Object::ValueMap::const_iterator it = obj.begin(); it != obj.end(); ++it)
 			{
-				case '"' : 	s.push_back('\"'); break;
-				case '\\': 	s.push_back('\\'); break;
-				case '/' : 	s.push_back('/'); break;
-				case 't' : 	s.push_back('\t'); break;
-				case 'n' : 	s.push_back('\n'); break;
-				case 'r' : 	s.push_back('\r'); break;
-				case 'b' :	s.push_back('\b'); break;
-				case 'f' : 	s.push_back('\f'); break;
-				case 'u' : 	skip_ahead = 5;
-					hex_str = str.substr(i + 4, 2);
-					hex = (unsigned int)std::strtoul(hex_str.c_str(), nullptr, 16);
-					s.push_back((char)hex);
-					break;
-					
-				default: break;
+				WriteCBORString(out, it->first.str());
+				EncodeCBORValue(it->second, out);
 			}
-			
-			i += skip_ahead;
+			break;
+		}
+
+		case ArrayVal		:
+		{
+			const Array& a = v.ToArray();
+			WriteCBORArrayHeader(out, a.size());
+			for (Array::ValueVector::const_iterator it = a.begin(); it != a.end(); ++it)
+				EncodeCBORValue(*it, out);
+			break;
 		}
-		else
-			s.push_back(c);
 	}
-	
-	return Trim(s);
 }
 
-static Value DeserializeValue(std::string& str, bool* had_error, std::stack<StackDepthType>& depth_stack)
+void json::EncodeCBOR(const Value& v, std::string& out)
 {
-	Value v;
+	EncodeCBORValue(v, out);
+}
+
+std::string json::EncodeCBOR(const Value& v)
+{
+	std::string out;
+	EncodeCBORValue(v, out);
+	return out;
+}
 
-	*had_error = false;
-	str = Trim(str);
+static unsigned long long ReadBigEndian(const unsigned char* p, int bytes)
+{
+	unsigned long long v = 0;
+	for (int i = 0; i < bytes; i++)
+		v = (v << 8) | p[i];
+	return v;
+}
 
-	if (str.length() == 0)
-		return v;
+// Reads the argument that follows an item's first byte. *indefinite is set for the "length follows as a stream" marker.
+static bool ReadCBORArgument(const unsigned char*& p, const unsigned char* end, unsigned char info, unsigned long long* arg, bool* indefinite)
+{
+	*indefinite = false;
 
-	if (str[0] == '[')
+	if (info < 24)
 	{
-		// This value is an array, determine the end of it and then deserialize the array
-		depth_stack.push(InArray);
-		size_t i = GetEndOfArrayOrObj(str, depth_stack);
-		if (i == std::string::npos)
-		{
-			*had_error = true;
-			return Value();
-		}
-		
-		std::string array_str = str.substr(0, i + 1);
-		v = Value(DeserializeArray(array_str, depth_stack));
-		str = str.substr(i + 1, str.length());
+		*arg = info;
+		return true;
 	}
-	else if (str[0] == '{')
+	else if (info == CBOR_INDEFINITE)
 	{
-		// This value is an object, determine the end of it and then deserialize the object
-		depth_stack.push(InObject);
-		size_t i = GetEndOfArrayOrObj(str, depth_stack);
+		*indefinite = true;
+		return true;
+	}
+	else if (info > 27)
+		return false;
 
-		if (i == std::string::npos)
-		{
-			*had_error = true;
-			return Value();
-		}
+	int bytes = 1 << (info - 24);
+	if ((end - p) < bytes)
+		return false;
+
+	*arg = ReadBigEndian(p, bytes);
+	p += bytes;
+	return true;
+}
 
-		std::string obj_str = str.substr(0, i + 1);
-		v = Value(DeserializeInternal(obj_str, depth_stack));
-		str = str.substr(i + 1, str.length());
+static double DecodeHalfFloat(unsigned int half)
+{
+	int exponent = (half >> 10) & 0x1F;
+	int mantissa = half & 0x3FF;
+	double v;
+
+	if (exponent == 0)
+		v = ldexp((double)mantissa, -24);
+	else if (exponent != 31)
+		v = ldexp((double)(mantissa + 1024), exponent - 25);
+	else
+		v = (mantissa == 0) ? HUGE_VAL : NAN;
+
+	return (half & 0x8000) ? -v : v;
+}
+
+static bool DecodeCBORItem(const unsigned char*& p, const unsigned char* end, Value& out, int depth);
+
+// Reads a definite or indefinite length text string whose first byte has already been consumed
+static bool DecodeCBORText(const unsigned char*& p, const unsigned char* end, unsigned char info, std::string& out)
+{
+	unsigned long long length;
+	bool indefinite;
+	if (!ReadCBORArgument(p, end, info, &length, &indefinite))
+		return false;
+
+	if (!indefinite)
+	{
+		if (length > (unsigned long long)(end - p))
+			return false;
+
+		const char* text = (const char*)p;
+		p += length;
+		if (!IsShortASCII(text, (size_t)length) && !IsValidUTF8(text, (size_t)length))
+			return false;
+
+		out.assign(text, (size_t)length);
+		return true;
 	}
-	else if (str[0] == '\"')
+
+	// an indefinite string is a run of definite text chunks closed by a break
+	out.clear();
+	for (;;)
 	{
-		// This value is a string
-		size_t end_quote = GetQuotePos(str, 1);
-		if (end_quote == std::string::npos)
-		{
-			*had_error = true;
-			return Value();
-		}
+		if (p >= end)
+			return false;
+
+		unsigned char ib = *p++;
+		if (ib == CBOR_BREAK)
+			return IsValidUTF8(out);
+		if (((ib >> 5) != CBORText) || ((ib & 0x1F) == CBOR_INDEFINITE))
+			return false;
 
-		v = Value(UnescapeJSONString(str.substr(1, end_quote - 1)));
-		str = str.substr(end_quote + 1, str.length());
+		if (!ReadCBORArgument(p, end, ib & 0x1F, &length, &indefinite) || (length > (unsigned long long)(end - p)))
+			return false;
+
+		out.append((const char*)p, (size_t)length);
+		p += length;
 	}
-	else
+}
+
+static bool DecodeCBORItem(const unsigned char*& p, const unsigned char* end, Value& out, int depth)
+{
+	if (p >= end)
+		return false;
+
+	unsigned char ib = *p++;
+	unsigned char info = ib & 0x1F;
+	unsigned long long arg = 0;
+	bool indefinite = false;
+
+	switch (ib >> 5)
 	{
-		// it's not an object, string, or array so it's either a boolean or a number or null.
-		// Numbers can contain an exponent indicator ('e') or a decimal point.
-		bool has_dot = false;
-		bool has_e = false;
-		std::string temp_val;
-		size_t i = 0;
-		bool found_digit = false;
-		bool found_first_valid_char = false;
+		case CBORUnsigned	:
+			if (!ReadCBORArgument(p, end, info, &arg, &indefinite) || indefinite)
+				return false;
+
+			// same rule as Deserialize: integers that don't fit in an int are stored as doubles
+			out = (arg <= INT_MAX) ? Value((int)arg) : Value((double)arg);
+			return true;
 
-		for (; i < str.length(); i++)
+		case CBORNegative	:
+			if (!ReadCBORArgument(p, end, info, &arg, &indefinite) || indefinite)
+				return false;
+
+			out = (arg <= INT_MAX) ? Value((int)(-1 - (long long)arg)) : Value(-1.0 - (double)arg);
+			return true;
+
+		case CBORText		:
 		{
-			if (str[i] == '.')
-			{
-				if (!found_digit)
-				{
-					// As per JSON standards, there must be a digit preceding a decimal point
-					*had_error = true;
-					return Value();
-				}
+			std::string str;
+			if (!DecodeCBORText(p, end, info, str))
+				return false;
 
-				has_dot = true;
-			}
-			else if ((str[i] == 'e') || (str[i] == 'E'))
-			{		
-				if ((_stricmp(temp_val.c_str(), "fals") != 0) && (_stricmp(temp_val.c_str(), "tru") != 0))
-				{
-					// it's not a boolean, check for scientific notation validity. This will also trap booleans with extra 'e' characters like falsee/truee
-					if (!found_digit)
-					{
-						// As per JSON standards, a digit must precede the 'e' notation
-						*had_error = true;
-						return Value();
-					}
-					else if (has_e)
-					{
-						// multiple 'e' characters not allowed
-						*had_error = true;
-						return Value();
-					}
+			out = Value(std::move(str));
+			return true;
+		}
 
-					has_e = true;
-				}
-			}
-			else if (str[i] == ']')
+		case CBORArray		:
+		{
+			if ((depth + 1 > MAX_DEPTH) || !ReadCBORArgument(p, end, info, &arg, &indefinite))
+				return false;
+
+			Array a;
+			if (!indefinite)
 			{
-				if (depth_stack.empty() || (depth_stack.top() != InArray))
+				// every item takes at least a byte, so a count past the end of the input is a lie; don't reserve on its word
+				if (arg > (unsigned long long)(end - p))
+					return false;
+
+				a.reserve((size_t)arg);
+				for (unsigned long long i = 0; i < arg; i++)
 				{
-					*had_error = true;
-					return Value();
+					a.push_back(Value());
+					if (!DecodeCBORItem(p, end, a[a.size() - 1], depth + 1))
+						return false;
 				}
-				
-				depth_stack.pop();
 			}
-			else if (str[i] == '}')
+			else
 			{
-				if (depth_stack.empty() || (depth_stack.top() != InObject))
+				while ((p < end) && (*p != CBOR_BREAK))
 				{
-					*had_error = true;
-					return Value();
+					a.push_back(Value());
+					if (!DecodeCBORItem(p, end, a[a.size() - 1], depth + 1))
+						return false;
 				}
-				
-				depth_stack.pop();
-			}
-			else if (str[i] == ',')
-				break;			
-			else if ((str[i] == '[') || (str[i] == '{'))
-			{
-				// error, we're supposed to be processing things besides arrays/objects in here
-				*had_error = true;
-				return Value();
-			}
-
-			if (!std::isspace(str[i]))
-			{
-				if (std::isdigit(str[i]))
-					found_digit = true;
 
-				found_first_valid_char = true;
-				temp_val += str[i];
+				if (p >= end)
+					return false;
+				++p;
 			}
+
+			out = Value(std::move(a));
+			return true;
 		}
 
-		// store all floating point as doubles. This will also set the float and int values as well.
-		if (_stricmp(temp_val.c_str(), "true") == 0)
-			v = Value(true);
-		else if (_stricmp(temp_val.c_str(), "false") == 0)
-			v = Value(false);
-		else if (has_e || has_dot)
+		case CBORMap		:
 		{
-			char* end_char;
-			errno = 0;
-			double d = strtod(temp_val.c_str(), &end_char);
-			if ((errno != 0) || (*end_char != '\0'))
+			if ((depth + 1 > MAX_DEPTH) || !ReadCBORArgument(p, end, info, &arg, &indefinite))
+				return false;
+
+			if (!indefinite && (arg > (unsigned long long)(end - p) / 2))
+				return false;
+
+			Object obj;
+			std::string key;
+			for (unsigned long long i = 0; indefinite || (i < arg); i++)
 			{
-				// invalid conversion or out of range
-				*had_error = true;
-				return Value();
+				if (p >= end)
+					return false;
+
+				if (indefinite && (*p == CBOR_BREAK))
+				{
+					++p;
+					break;
+				}
+
+				// JSON only has text keys
+				unsigned char key_ib = *p;
+				if ((key_ib >> 5) != CBORText)
+					return false;
+
+				++p;
+				if (!DecodeCBORText(p, end, key_ib & 0x1F, key))
+					return false;
+
+				if (!DecodeCBORItem(p, end, obj[key], depth + 1))
+					return false;
 			}
 
-			v = Value(d);
+			out = Value(std::move(obj));
+			return true;
 		}
-		else if (_stricmp(temp_val.c_str(), "null") == 0)
-			v = Value();
-		else
-		{
-			// Check if the value is beyond the size of an int and if so, store it as a double
-			char* end_char;
-			errno = 0;
-			long int ival = strtol(temp_val.c_str(), &end_char, 10);
-			if (*end_char != '\0')
-			{
-				// invalid character sequence, not a number
-				*had_error = true;
-				return Value();
-			}
-			else if ((errno == ERANGE) && ((ival == LONG_MAX) || (ival == LONG_MIN)))
+
+		case CBORTag		:
+			// tags (dates, bignums...) only qualify the item that follows; JSON has no use for them so the item is kept as is
+			if ((depth + 1 > MAX_DEPTH) || !ReadCBORArgument(p, end, info, &arg, &indefinite) || indefinite)
+				return false;
+
+			return DecodeCBORItem(p, end, out, depth + 1);
+
+		case CBORSimple		:
+			switch (ib)
 			{
-				// value is out of range for a long int, should be a double then. See if we can convert it correctly.
-				errno = 0;
-				double dval = strtod(temp_val.c_str(), &end_char);
-				if ((errno != 0) || (*end_char != '\0'))
+				case CBOR_FALSE		: out = Value(false); return true;
+				case CBOR_TRUE		: out = Value(true); return true;
+				case CBOR_NULL		:
+				case CBOR_UNDEFINED	: out = Value(); return true;
+
+				case CBOR_HALF		:
+					if ((end - p) < 2)
+						return false;
+					out = Value(DecodeHalfFloat((unsigned int)ReadBigEndian(p, 2)));
+					p += 2;
+					return true;
+
+				case CBOR_FLOAT		:
 				{
-					// error in conversion or it's too big for a double
-					*had_error = true;
-					return Value();
+					if ((end - p) < 4)
+						return false;
+					unsigned int bits = (unsigned int)ReadBigEndian(p, 4);
+					float f;
+					memcpy(&f, &bits, sizeof(f));
+					out = Value(f);
+					p += 4;
+					return true;
 				}
 
-				v = Value(dval);
-			}
-			else if ((ival >= INT_MIN) && (ival <= INT_MAX))
-			{
-				// valid integer range
-				v = Value((int)ival);
-			}
-			else
-			{
-				// probably running on a very old OS since this block implies that long isn't the same size as int.
-				// int is guaranteed to be at least 16 bits and long 32 bits...however nowadays they're almost
-				// always the same 32 bit size. But it's possible someone is running this on a very old architecture
-				// so for correctness, we'll error out here
-				*had_error = true;
-				return Value();
+				case CBOR_DOUBLE	:
+				{
+					if ((end - p) < 8)
+						return false;
+					unsigned long long bits = ReadBigEndian(p, 8);
+					double d;
+					memcpy(&d, &bits, sizeof(d));
+					out = Value(d);
+					p += 8;
+					return true;
+				}
+
+				default				: return false;
 			}
-		}
 
-		str = str.substr(i, str.length());
+		default				:
+			// byte strings have no JSON equivalent
+			return false;
 	}
+}
+
+Value json::DecodeCBOR(const char* data, size_t length, size_t* error_offset, size_t* consumed)
+{
+	const unsigned char* begin = (const unsigned char*)data;
+	const unsigned char* end = begin + length;
+	const unsigned char* p = begin;
+	Value v;
+
+	bool ok = DecodeCBORItem(p, end, v, 0);
+	if (ok && (consumed == nullptr))
+		ok = (p == end);
+
+	if (error_offset != nullptr)
+		*error_offset = ok ? std::string::npos : (size_t)(p - begin);
+
+	if (!ok)
+		return Value();
+
+	if (consumed != nullptr)
+		*consumed = (size_t)(p - begin);
 
 	return v;
 }
 
-static Value DeserializeArray(std::string& str, std::stack<StackDepthType>& depth_stack)
+Value json::DecodeCBOR(const std::string& data, size_t* error_offset)
 {
-	Array a;
-	bool had_error = false;
+	return DecodeCBOR(data.data(), data.length(), error_offset, nullptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+Reader::Reader() : mMapping(nullptr), mMappingLength(0)
+{
+	Reset(nullptr, 0);
+}
 
-	str = Trim(str);
+Reader::Reader(const char* data, size_t length) : mMapping(nullptr), mMappingLength(0)
+{
+	Reset(data, length);
+}
 
-	// Arrays begin and end with [], so if we don't find one, it's an error
-	if ((str[0] == '[') && (str[str.length() - 1] == ']'))
-		str = str.substr(1, str.length() - 2);
-	else
-		return Value();
+Reader::~Reader()
+{
+	Close();
+}
+
+void Reader::Close()
+{
+#ifndef WIN32
+	if (mMapping != nullptr)
+		munmap(mMapping, mMappingLength);
+#endif
+
+	mMapping = nullptr;
+	mMappingLength = 0;
+	mFileBuffer.clear();
+	Reset(nullptr, 0);
+}
+
+bool Reader::Open(const std::string& path)
+{
+	Close();
+
+#ifndef WIN32
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return false;
+	}
 
-	// extract out all values from the array (remember, a value can also be an array or an object)
-	while (str.length() > 0)
+	size_t length = (size_t)st.st_size;
+	if (length == 0)
 	{
-		std::string tmp;
+		// can't map an empty file, but it's still a (invalid) document
+		close(fd);
+		return true;
+	}
+
+	void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (mapping == MAP_FAILED)
+		return false;
+
+	// we only ever walk forward through the file, so let the kernel read ahead aggressively
+	madvise(mapping, length, MADV_SEQUENTIAL);
 
-		size_t i = 0;
-		for (; i < str.length(); i++)
+	mMapping = mapping;
+	mMappingLength = length;
+	Reset((const char*)mapping, length);
+#else
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		return false;
+
+	char buff[64 * 1024];
+	size_t count;
+	while ((count = fread(buff, 1, sizeof(buff), file)) > 0)
+		mFileBuffer.append(buff, count);
+
+	fclose(file);
+	Reset(mFileBuffer.data(), mFileBuffer.length());
+#endif
+
+	return true;
+}
+
+void Reader::Reset(const char* data, size_t length)
+{
+	mBegin = data;
+	mCursor = data;
+	mEnd = data + length;
+	mState = StateRoot;
+	mErrorOffset = std::string::npos;
+	mStack.clear();
+	mString.clear();
+	mIsInt = false;
+	mIntVal = 0;
+	mDoubleVal = 0;
+	mBoolVal = false;
+}
+
+ReaderEvent Reader::Error()
+{
+	mState = StateError;
+	mErrorOffset = (size_t)(mCursor - mBegin);
+	return ErrorEvent;
+}
+
+void Reader::FinishValue()
+{
+	mState = mStack.empty() ? StateEnd : StateNext;
+}
+
+ReaderEvent Reader::ReadValue()
+{
+	switch (*mCursor)
+	{
+		case '{'	:
+		case '['	:
 		{
-			// If we get to an object or array, parse it:
-			if ((str[i] == '{') || (str[i] == '['))
-			{
-				Value v = DeserializeValue(str, &had_error, depth_stack);
-				if (had_error)
-					return Value();
-				
-				if (v.GetType() != NULLVal)
-					a.push_back(v);
+			if (mStack.size() >= (size_t)MAX_DEPTH)
+				return Error();
+
+			bool is_object = (*mCursor == '{');
+			mStack.push_back(*mCursor);
+			++mCursor;
+			mState = is_object ? StateFirstKey : StateFirstElement;
+			return is_object ? StartObjectEvent : StartArrayEvent;
+		}
 
-				break;
-			}
+		case '\"'	:
+			if (!ParseString(mCursor, mEnd, mString))
+				return Error();
 
-			bool terminate_parsing = false;
+			FinishValue();
+			return StringEvent;
 
-			if ((str[i] == ',') || (str[i] == ']'))
-				terminate_parsing = true;			// hit the end of a value, parse it in the next block
-			else
+		case 't'	:
+		case 'f'	:
+		case 'n'	:
+		{
+			ReaderEvent e;
+			if (ParseLiteral(mCursor, mEnd, "true", 4))
 			{
-				// keep grabbing chars to build up the value
-				tmp += str[i];
-				if  (i == str.length() - 1)
-					terminate_parsing = true; // end of string, finish parsing
+				mBoolVal = true;
+				e = BoolEvent;
 			}
-
-			if (terminate_parsing)
+			else if (ParseLiteral(mCursor, mEnd, "false", 5))
 			{
-				Value v = DeserializeValue(tmp, &had_error, depth_stack);
-				if (had_error)
-					return Value();
-				
-				if (v.GetType() != NULLVal)
-					a.push_back(v);
-
-				str = str.substr(i + 1, str.length());
-				break;
+				mBoolVal = false;
+				e = BoolEvent;
 			}
+			else if (ParseLiteral(mCursor, mEnd, "null", 4))
+				e = NullEvent;
+			else
+				return Error();
+
+			FinishValue();
+			return e;
 		}
-	}
 
-	return a;
+		default		:
+			if (!ParseNumber(mCursor, mEnd, &mIsInt, &mIntVal, &mDoubleVal))
+				return Error();
+
+			FinishValue();
+			return NumberEvent;
+	}
 }
 
-static Value DeserializeObj(const std::string& _str, std::stack<StackDepthType>& depth_stack)
+ReaderEvent Reader::Next()
 {
-	Object obj;
+	for (;;)
+	{
+		if (mState == StateError)
+			return ErrorEvent;
 
-	std::string str = Trim(_str);
+		mCursor = SkipWhitespace(mCursor, mEnd);
 
-	// Objects begin and end with {} so if we don't find a pair, it's an error
-	if ((str[0] != '{') && (str[str.length() - 1] != '}'))
-		return Value();
-	else
-		str = str.substr(1, str.length() - 2);
+		if (mState == StateEnd)
+		{
+			// only whitespace may follow the root array/object
+			if (mCursor != mEnd)
+				return Error();
 
-	// Get all key/value pairs in this object...
-	while (str.length() > 0)
-	{
-		// Get the key name
-		size_t start_quote_idx = GetQuotePos(str);
-		size_t end_quote_idx = GetQuotePos(str, start_quote_idx + 1);
-		size_t colon_idx = str.find(':', end_quote_idx);
+			mState = StateDone;
+			return EndOfDocumentEvent;
+		}
+		else if (mState == StateDone)
+			return EndOfDocumentEvent;
 
-		if ((start_quote_idx == std::string::npos) || (end_quote_idx == std::string::npos) || (colon_idx == std::string::npos))
-			return Value();	// can't find key name
-		
-		std::string key = str.substr(start_quote_idx + 1, end_quote_idx - start_quote_idx - 1);
-		if (key.length() == 0)
-			return Value();
+		if (mCursor >= mEnd)
+			return Error();
 
-		bool had_error = false;
-		str = str.substr(colon_idx + 1, str.length());
+		char c = *mCursor;
 
-		// We have the key, now extract the value from the string
-		obj[key] = DeserializeValue(str, &had_error, depth_stack);
-		if (had_error)
-			return Value();
-	}
+		switch (mState)
+		{
+			case StateRoot:
+				// As a top level object must be either an array or an object, anything else is an error
+				if ((c != '{') && (c != '['))
+					return Error();
+
+				return ReadValue();
+
+			case StateFirstElement:
+				if (c == ']')
+					break;
+
+				return ReadValue();
+
+			case StateValue:
+				return ReadValue();
+
+			case StateFirstKey:
+			case StateKey:
+				if ((c == '}') && (mState == StateFirstKey))
+					break;
+
+				if ((c != '\"') || !ParseString(mCursor, mEnd, mString))
+					return Error();
+
+				mCursor = SkipWhitespace(mCursor, mEnd);
+				if ((mCursor >= mEnd) || (*mCursor != ':'))
+					return Error();
 
-	return obj;
+				++mCursor;
+				mState = StateValue;
+				return KeyEvent;
+
+			case StateNext:
+				if (c == ',')
+				{
+					++mCursor;
+					mState = (mStack.back() == '{') ? StateKey : StateValue;
+					continue;
+				}
+
+				break;
+
+			default:
+				return Error();
+		}
+
+		// c is a closing bracket, which has to match the innermost open array/object
+		if (((c == '}') && (mStack.back() != '{')) || ((c == ']') && (mStack.back() != '[')) || ((c != '}') && (c != ']')))
+			return Error();
+
+		mStack.pop_back();
+		++mCursor;
+		FinishValue();
+		return (c == '}') ? EndObjectEvent : EndArrayEvent;
+	}
 }
 
-Value json::Deserialize(const std::string &str)
+bool Reader::Skip()
 {
-	std::stack<StackDepthType> depth_stack;
-	return DeserializeInternal(str, depth_stack);
-}
+	size_t depth = mStack.size();
+
+	ReaderEvent e = Next();
+	if ((e != StartObjectEvent) && (e != StartArrayEvent))
+		return (e != ErrorEvent) && (e != EndOfDocumentEvent);
 
+	while (mStack.size() > depth)
+	{
+		e = Next();
+		if ((e == ErrorEvent) || (e == EndOfDocumentEvent))
+			return false;
+	}
+
+	return true;
+}
@@ -233,10 +233,16 @@
 #ifndef __SUPER_EASY_JSON_H__
 #define __SUPER_EASY_JSON_H__
 
+#include <atomic>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <memory>
 #include <string>
 #include <stdexcept>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
 
 
 // PLEASE SEE THE README FOR USAGE INFORMATION AND EXAMPLES. Comments will be kept to a minimum to reduce clutter.
@@ -256,28 +262,206 @@ namespace json
 
 	class Value;
 
+	// A monotonic bump allocator for building Value trees. Memory handed out is never freed individually: it all goes back at
+	// once when the Arena is destroyed (or Release()'d), which turns tearing down a document of thousands of small nodes into a
+	// handful of frees. Using one is opt-in; see Document and ArenaScope below. Not thread safe, use one per thread.
+	class Arena
+	{
+		public:
+
+			Arena();
+			~Arena();
+
+			void* Allocate(size_t bytes, size_t alignment);
+
+			// Containers hand back their old buffer every time they grow. Small buffers are kept on a free list for the next
+			// request of the same size so push_back heavy code doesn't leave a trail of dead buffers behind it; anything else
+			// simply waits for Release().
+			void Deallocate(void* p, size_t bytes);
+
+			// Frees every block. Anything allocated from this arena must be gone (or never touched again) by then.
+			void Release();
+
+			// Bytes carved out of the blocks so far / bytes reserved from the heap
+			size_t BytesUsed() const		{return mBytesUsed;}
+			size_t BytesReserved() const	{return mBytesReserved;}
+
+			// The arena new containers on this thread allocate from, or nullptr for the regular heap
+			static Arena* Current();
+
+		protected:
+
+			friend class ArenaScope;
+
+			struct Block
+			{
+				Block*	next;
+				size_t	size;
+			};
+
+			static const size_t GRANULE_SZ = 16;
+			static const size_t RECYCLE_LIMIT = 4096;
+
+			Arena(const Arena&);
+			Arena& operator =(const Arena&);
+
+			void* AllocateBlock(size_t bytes, size_t alignment);
+
+			Block*		mBlocks;
+			char*		mCursor;
+			char*		mLimit;
+			size_t		mNextBlockSize;
+			size_t		mBytesUsed;
+			size_t		mBytesReserved;
+			void*		mFreeLists[RECYCLE_LIMIT / GRANULE_SZ + 1];
+	};
+
+	// Standard allocator that draws from an Arena, or from the heap when it has none. A default constructed allocator picks up
+	// the thread's current arena, so every Object/Array created inside an ArenaScope lands in that arena without any changes to
+	// the code building the tree. Moving a container moves its allocator with it; copying one allocates from whatever arena is
+	// current where the copy is made.
+	template <typename T>
+	class ArenaAllocator
+	{
+		public:
+
+			typedef T value_type;
+			typedef std::true_type propagate_on_container_move_assignment;
+			typedef std::true_type propagate_on_container_swap;
+			typedef std::false_type propagate_on_container_copy_assignment;
+
+			ArenaAllocator() : mArena(Arena::Current()) {}
+			explicit ArenaAllocator(Arena* arena) : mArena(arena) {}
+			template <typename U>
+			ArenaAllocator(const ArenaAllocator<U>& other) : mArena(other.GetArena()) {}
+
+			T* allocate(size_t n)
+			{
+				if (mArena != nullptr)
+					return static_cast<T*>(mArena->Allocate(n * sizeof(T), alignof(T)));
+				return static_cast<T*>(::operator new(n * sizeof(T)));
+			}
+
+			void deallocate(T* p, size_t n)
+			{
+				if (mArena != nullptr)
+					mArena->Deallocate(p, n * sizeof(T));
+				else
+					::operator delete(p);
+			}
+
+			ArenaAllocator select_on_container_copy_construction() const	{return ArenaAllocator();}
+
+			Arena* GetArena() const		{return mArena;}
+
+			template <typename U>
+			struct rebind {typedef ArenaAllocator<U> other;};
+
+		protected:
+
+			Arena*	mArena;
+	};
+
+	template <typename T, typename U>
+	inline bool operator ==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs)	{return lhs.GetArena() == rhs.GetArena();}
+	template <typename T, typename U>
+	inline bool operator !=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs)	{return lhs.GetArena() != rhs.GetArena();}
+
+	// Makes arena the current arena for this thread until the scope ends, then restores whatever was current before
+	class ArenaScope
+	{
+		public:
+
+			explicit ArenaScope(Arena& arena);
+			explicit ArenaScope(class Document& doc);
+			~ArenaScope();
+
+		protected:
+
+			ArenaScope(const ArenaScope&);
+			ArenaScope& operator =(const ArenaScope&);
+
+			Arena*	mPrevious;
+	};
+
+	// An object key. Keys are interned: each distinct key string is stored once and a Key is just a pointer to that copy, so
+	// thousands of objects repeating the same few keys don't each carry their own string copies. The copies are reference
+	// counted and dropped when the last Key using them goes, so the keys of parsed documents don't pile up for the life of the
+	// program. Converts to a const std::string& wherever one is expected.
+	class Key
+	{
+		public:
+
+			// The interned string and the number of Keys (and per thread caches) using it
+			typedef std::pair<const std::string, std::atomic<long> > Entry;
+
+			Key(const std::string& key);
+			Key(const char* key);
+			Key(const Key& key) noexcept;
+			Key& operator =(const Key& key) noexcept;
+			~Key();
+
+			const std::string& str() const 			{return mEntry->first;}
+			const char* c_str() const 				{return mEntry->first.c_str();}
+			operator const std::string&() const 	{return mEntry->first;}
+
+			// Interned keys with the same text share an entry, so equality is a pointer compare
+			inline friend bool operator ==(const Key& lhs, const Key& rhs) 	{return lhs.mEntry == rhs.mEntry;}
+			inline friend bool operator !=(const Key& lhs, const Key& rhs) 	{return lhs.mEntry != rhs.mEntry;}
+			inline friend bool operator <(const Key& lhs, const Key& rhs) 	{return lhs.mEntry->first < rhs.mEntry->first;}
+
+		protected:
+
+			Entry*	mEntry;
+	};
+
 	// Represents a JSON object which is of the form {string:value, string:value, ...} Where string is the "key" name and is
 	// of the form "" or "characters". Value is either of: string, number, object, array, boolean, null
+	// Members are kept in a flat vector in insertion order (which is also the order they're serialized in). Small objects are
+	// searched linearly; once an object grows past LINEAR_SEARCH_LIMIT members a hash index is built for lookups.
 	class Object
 	{
 		public:
 
 			// This is the type used to store key/value pairs. If you want to get an iterator for this class to iterate over its members,
-			// use this. 
+			// use this. ->first is the Key, ->second is the Value.
 			// For example: Object::ValueMap::iterator my_iterator;
-			typedef std::map<std::string, Value> ValueMap;
+			typedef std::pair<Key, Value> Member;
+			typedef std::vector<Member, ArenaAllocator<Member> > ValueMap;
+
+			static const size_t LINEAR_SEARCH_LIMIT = 16;
 
 		protected:
 
-			ValueMap	mValues;
+			// The index hashes and compares key text, so looking a key up never has to touch the shared table of interned keys
+			struct KeyTextHash
+			{
+				size_t operator ()(const std::string* key) const	{return std::hash<std::string>()(*key);}
+			};
+
+			struct KeyTextEqual
+			{
+				bool operator ()(const std::string* lhs, const std::string* rhs) const	{return (lhs == rhs) || (*lhs == *rhs);}
+			};
+
+			typedef std::unordered_map<const std::string*, size_t, KeyTextHash, KeyTextEqual> IndexMap;
+
+			ValueMap					mValues;
+			std::unique_ptr<IndexMap>	mIndex;		// key text -> position in mValues, only for large objects
+
+			size_t IndexOf(const std::string& key) const;
+			void BuildIndex();
 
 		public:
 
 			Object();
 			Object(const Object& obj);
+			Object(Object&& obj) noexcept;
 
 			Object& operator =(const Object& obj);
+			Object& operator =(Object&& obj) noexcept;
 
+			// Objects compare like a std::map would, regardless of the order members were inserted in
 			friend bool operator ==(const Object& lhs, const Object& rhs);
 			inline friend bool operator !=(const Object& lhs, const Object& rhs) 	{return !(lhs == rhs);}
 			friend bool operator <(const Object& lhs, const Object& rhs);
@@ -290,6 +474,7 @@ namespace json
 			// Value my_val = my_object["some key name"];
 			// my_object["some key name"] = "overwriting the value with this new string value";
 			// my_object["new key name"] = "a new key being inserted";
+			// THE CONST VERSIONS THROW A std::runtime_error IF THE KEY DOESN'T EXIST.
 			Value& operator [](const std::string& key);
 			const Value& operator [](const std::string& key) const;
 			Value& operator [](const char* key);
@@ -300,7 +485,7 @@ namespace json
 			ValueMap::iterator begin();
 			ValueMap::iterator end();
 
-			// Find will return end() if the key can't be found, just like std::map does. ->first will be the key (a std::string),
+			// Find will return end() if the key can't be found, just like std::map does. ->first will be the key (a json::Key),
 			// ->second will be the Value.
 			ValueMap::iterator find(const std::string& key);
 			ValueMap::const_iterator find(const std::string& key) const;
@@ -316,7 +501,8 @@ namespace json
 			// Removes all values and resets the state back to default
 			void Clear();
 
-			size_t size() const {return mValues.size();}
+			void reserve(size_t count)	{mValues.reserve(count);}
+			size_t size() const 		{return mValues.size();}
 
 	};
 
@@ -328,7 +514,7 @@ namespace json
 			// This is the type used to store values. If you want to get an iterator for this class to iterate over its members,
 			// use this. 
 			// For example: Array::ValueVector::iterator my_array_iterator;
-			typedef std::vector<Value> ValueVector;
+			typedef std::vector<Value, ArenaAllocator<Value> > ValueVector;
 
 		protected:
 
@@ -338,8 +524,10 @@ namespace json
 
 			Array();
 			Array(const Array& a);
+			Array(Array&& a) noexcept;
 
 			Array& operator =(const Array& a);
+			Array& operator =(Array&& a) noexcept;
 
 			friend bool operator ==(const Array& lhs, const Array& rhs);
 			inline friend bool operator !=(const Array& lhs, const Array& rhs) {return !(lhs == rhs);}
@@ -366,8 +554,15 @@ namespace json
 			// Removes all values and resets the state back to default
 			void Clear();
 
+			// The rvalue versions take ownership of the passed in value instead of deep copying it, so building a tree with
+			// my_array.push_back(std::move(my_object)) doesn't copy my_object's members.
 			void push_back(const Value& v);
+			void push_back(Value&& v);
+			template <typename... Args>
+			void emplace_back(Args&&... args)						{mValues.emplace_back(std::forward<Args>(args)...);}
 			void insert(size_t index, const Value& v);
+			void insert(size_t index, Value&& v);
+			void reserve(size_t count)								{mValues.reserve(count);}
 			size_t size() const;
 	};
 
@@ -392,11 +587,15 @@ namespace json
 			Value(float v)				: mValueType(FloatVal), mIntVal((int)v), mFloatVal(v), mDoubleVal((double)v), mBoolVal(false) {}
 			Value(double v)				: mValueType(DoubleVal), mIntVal((int)v), mFloatVal((float)v), mDoubleVal(v), mBoolVal(false) {}
 			Value(const std::string& v) : mValueType(StringVal), mIntVal(), mFloatVal(), mDoubleVal(), mStringVal(v), mBoolVal(false) {}
+			Value(std::string&& v)		: mValueType(StringVal), mIntVal(), mFloatVal(), mDoubleVal(), mStringVal(std::move(v)), mBoolVal(false) {}
 			Value(const char* v)		: mValueType(StringVal), mIntVal(), mFloatVal(), mDoubleVal(), mStringVal(v), mBoolVal(false) {}
 			Value(const Object& v)		: mValueType(ObjectVal), mIntVal(), mFloatVal(), mDoubleVal(), mObjectVal(v), mBoolVal(false) {}
+			Value(Object&& v)			: mValueType(ObjectVal), mIntVal(), mFloatVal(), mDoubleVal(), mObjectVal(std::move(v)), mBoolVal(false) {}
 			Value(const Array& v)		: mValueType(ArrayVal), mIntVal(), mFloatVal(), mDoubleVal(), mArrayVal(v), mBoolVal(false) {}
+			Value(Array&& v)			: mValueType(ArrayVal), mIntVal(), mFloatVal(), mDoubleVal(), mArrayVal(std::move(v)), mBoolVal(false) {}
 			Value(bool v)				: mValueType(BoolVal), mIntVal(), mFloatVal(), mDoubleVal(), mBoolVal(v) {}
 			Value(const Value& v);
+			Value(Value&& v) noexcept;
 
 			// Use this to determine the underlying type that this Value class represents. It will be one of the
 			// ValueType enums as defined at the top of this file.
@@ -406,6 +605,7 @@ namespace json
 			bool IsNumeric() const 			{return (mValueType == IntVal) || (mValueType == DoubleVal) || (mValueType == FloatVal);}
 
 			Value& operator =(const Value& v);
+			Value& operator =(Value&& v) noexcept;
 
 			friend bool operator ==(const Value& lhs, const Value& rhs);
 			inline friend bool operator !=(const Value& lhs, const Value& rhs) 	{return !(lhs == rhs);}
@@ -434,13 +634,14 @@ namespace json
 
 		
 			// non-operator versions, **will throw a std::runtime_error if invalid with an appropriate error message**
+			// ToString/ToObject/ToArray return references into this Value, so reading a tree doesn't copy it.
 			int 				ToInt() const;
 			float 				ToFloat() const;
 			double 				ToDouble() const;
 			bool 				ToBool() const;
 			const std::string&	ToString() const;
-			Object 				ToObject() const;
-			Array 				ToArray() const;
+			const Object&		ToObject() const;
+			const Array&		ToArray() const;
 
 			// These versions do the same as above but will return your specified default value in the event there's an error, and thus **don't** throw an exception.
 			int					ToInt(int def) const					{return IsNumeric() ? mIntVal : def;}
@@ -473,6 +674,45 @@ namespace json
 
 	};
 
+	// A Value tree together with the Arena its nodes are allocated from. Build (or parse) the tree inside an ArenaScope for the
+	// document, and when the Document goes away the whole tree is released in one go instead of node by node:
+	//		json::Document doc;
+	//		json::ArenaScope scope(doc);
+	//		json::Array targets;						// allocated from doc's arena
+	//		...
+	//		doc.Root() = std::move(targets);
+	// Nothing taken from the tree may outlive the Document, or its next Parse() or Clear(), unless it's copied outside of the
+	// scope first. Moving out of Root() keeps the arena's memory, so use TakeRoot() to keep the whole tree. Strings short enough
+	// for std::string's inline buffer (all of the pipeline's) don't allocate at all; longer ones still come from the heap.
+	class Document
+	{
+		public:
+
+			Document() {}
+
+			Value& Root()					{return mRoot;}
+			const Value& Root() const		{return mRoot;}
+			Arena& GetArena()				{return mArena;}
+
+			// Parses data into Root(), allocating from this document's arena. Returns false (and leaves a NULLVal root) on error.
+			bool Parse(const char* data, size_t length, size_t* error_offset = nullptr);
+
+			// Drops the tree and all of the arena's memory so the document can be reused
+			void Clear();
+
+			// Returns a copy of the tree allocated from the heap, then clears the document. The copy costs as much as the
+			// tree is big, so only take the root of documents that need to outlive their arena.
+			Value TakeRoot();
+
+		protected:
+
+			Document(const Document&);
+			Document& operator =(const Document&);
+
+			Arena	mArena;		// declared first so it's destroyed after mRoot
+			Value	mRoot;
+	};
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// Converts a JSON Object or Array instance into a JSON string representing it. RETURNS EMPTY STRING ON ERROR. 
@@ -480,6 +720,31 @@ namespace json
 	// json::Array, json::Object, or a json::Value that has an Array or Object as its underlying type. 
 	std::string Serialize(const Value& obj);
 
+	// Same as above, but serializes the Object or Array in place instead of first copying it into a temporary Value.
+	std::string Serialize(const Object& obj);
+	std::string Serialize(const Array& a);
+
+	// Appends the JSON text to the end of out instead of returning a new string, so a whole document (or several) can be
+	// written into one growing buffer. Unlike Serialize, any Value is accepted, which makes it usable for writing fragments.
+	void SerializeTo(const Value& v, std::string& out);
+	void SerializeTo(const Object& obj, std::string& out);
+	void SerializeTo(const Array& a, std::string& out);
+
+	// The number writers the serializer uses, for code that wants to write JSON without building a Value tree first.
+	// Floating point values are written with the fewest digits that read back as the same value, and as null if nan/infinite.
+	void WriteInt(std::string& out, int v);
+	void WriteFloat(std::string& out, float v);
+	void WriteDouble(std::string& out, double v);
+
+	// Writes str as a quoted JSON string, escaping '"', '\' and control characters. Invalid UTF-8 sequences are replaced with
+	// U+FFFD so the output is always valid JSON. Runs of plain text are copied in bulk, so this is close to memcpy speed.
+	void WriteString(std::string& out, const char* str, size_t length);
+	void WriteString(std::string& out, const std::string& str);
+
+	// Checks that str is well formed UTF-8 (no overlong forms, surrogates or code points beyond U+10FFFF)
+	bool IsValidUTF8(const char* str, size_t length);
+	bool IsValidUTF8(const std::string& str);
+
 	// If there is an error, Value will be NULLVal. Pass in a valid JSON string (such as one returned from Serialize, or obtained
 	// elsewhere) to receive a Value in return that represents the JSON structure. Check the type of Value by calling GetType().
 	// It will be ObjectVal or ArrayVal (or NULLVal if invalid JSON). The Value class contains the operator [] for indexing in the
@@ -487,17 +752,151 @@ namespace json
 	// by this method by simply passing it into the constructor.
 	Value 		Deserialize(const std::string& str);
 
+	// Same as above, but also reports where the input stopped being valid JSON: on error, *error_offset is the byte offset of
+	// the offending character, on success it's std::string::npos. The input is parsed in a single pass without being copied,
+	// so the const char* version can be pointed straight at a file buffer (it doesn't need to be null terminated).
+	Value 		Deserialize(const std::string& str, size_t* error_offset);
+	Value 		Deserialize(const char* data, size_t length, size_t* error_offset = nullptr);
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	inline bool operator ==(const Object& lhs, const Object& rhs)
+	// Binary encoding in CBOR (RFC 8949), for links and archives where JSON text is too big or too slow to parse. Every Value
+	// maps onto CBOR and back, floats staying FloatVal, so EncodeCBOR followed by DecodeCBOR gives back an equal Value and
+	// converting CBOR output to JSON gives the same document json::Serialize would have written. Unlike Serialize, any Value can be encoded.
+	void		EncodeCBOR(const Value& v, std::string& out);
+	std::string	EncodeCBOR(const Value& v);
+
+	// Decodes one CBOR data item. On error the result is NULLVal and *error_offset is the byte offset the error was found at
+	// (npos on success). If consumed is given, trailing bytes are allowed and *consumed is set to the size of the item, so a
+	// file of several concatenated items (a CBOR sequence) can be walked; otherwise anything after the item is an error.
+	// Integers too big for an int become doubles, 4 byte floats become FloatVal and other floating point becomes DoubleVal.
+	// Byte strings, and maps with keys that aren't text, have no JSON equivalent and are rejected.
+	Value		DecodeCBOR(const char* data, size_t length, size_t* error_offset = nullptr, size_t* consumed = nullptr);
+	Value		DecodeCBOR(const std::string& data, size_t* error_offset = nullptr);
+
+	// The CBOR item writers the encoder uses, for writing CBOR without building a Value tree first (see WriteString & co.).
+	// Doubles are written as 4 byte floats when that loses nothing, the JSON text included: the float must convert back to the
+	// same double and WriteFloat it the same way WriteDouble would. Headers are followed by exactly count items (count
+	// key/value pairs for a map); the indefinite length array is closed by WriteCBORBreak.
+	void WriteCBORInt(std::string& out, long long v);
+	void WriteCBORFloat(std::string& out, float v);
+	void WriteCBORDouble(std::string& out, double v);
+	void WriteCBORBool(std::string& out, bool v);
+	void WriteCBORNull(std::string& out);
+	void WriteCBORString(std::string& out, const char* str, size_t length);
+	void WriteCBORString(std::string& out, const std::string& str);
+	void WriteCBORArrayHeader(std::string& out, size_t count);
+	void WriteCBORMapHeader(std::string& out, size_t count);
+	void WriteCBORIndefiniteArrayHeader(std::string& out);
+	void WriteCBORBreak(std::string& out);
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Events returned by Reader::Next(), in document order
+	enum ReaderEvent
 	{
-		return lhs.mValues == rhs.mValues;
-	}
+		StartObjectEvent,
+		EndObjectEvent,
+		StartArrayEvent,
+		EndArrayEvent,
+		KeyEvent,
+		StringEvent,
+		NumberEvent,
+		BoolEvent,
+		NullEvent,
+		EndOfDocumentEvent,
+		ErrorEvent
+	};
 
-	inline bool operator <(const Object& lhs, const Object& rhs)
+	// Pull parser for scanning documents too big to hold as a Value tree. Nothing is allocated per value: each call to Next()
+	// advances to the next event and the Get* methods describe it. Open() memory maps the file, so scanning is bound by I/O.
+	// Example, collecting just the letter of every target:
+	//		json::Reader reader;
+	//		reader.Open("output.json");
+	//		for (json::ReaderEvent e = reader.Next(); e != json::EndOfDocumentEvent && e != json::ErrorEvent; e = reader.Next())
+	//			if (e == json::KeyEvent && reader.GetString() == "letter" && reader.Next() == json::StringEvent)
+	//				letters.push_back(reader.GetString());
+	class Reader
 	{
-		return lhs.mValues < rhs.mValues;
-	}
+		public:
+
+			Reader();
+			Reader(const char* data, size_t length);
+			~Reader();
+
+			// Maps the file at path and resets the reader to its start. Returns false if the file can't be opened.
+			bool Open(const std::string& path);
+
+			// Reads from a caller owned buffer (it doesn't need to be null terminated), unmapping any open file
+			void Reset(const char* data, size_t length);
+			void Close();
+
+			// Returns ErrorEvent on invalid JSON (and from then on), EndOfDocumentEvent once the root array/object is closed
+			ReaderEvent Next();
+
+			// Call right after a KeyEvent (or anywhere a value is expected) to skip over the next value, including any nested
+			// arrays/objects. Returns false on error.
+			bool Skip();
+
+			// The unescaped text of the last KeyEvent or StringEvent. Reused between events, so copy it if you need to keep it.
+			const std::string&	GetString() const	{return mString;}
+
+			// Details of the last NumberEvent; IsInt() is true if it was an integer that fits in an int
+			bool				IsInt() const		{return mIsInt;}
+			int					GetInt() const		{return mIntVal;}
+			double				GetDouble() const	{return mDoubleVal;}
+
+			bool				GetBool() const		{return mBoolVal;}
+
+			// Number of currently open arrays/objects
+			size_t				GetDepth() const	{return mStack.size();}
+
+			// Byte offset of the offending character after an ErrorEvent, otherwise std::string::npos
+			size_t				GetErrorOffset() const	{return mErrorOffset;}
+
+		protected:
+
+			enum State
+			{
+				StateRoot,
+				StateFirstElement,
+				StateFirstKey,
+				StateKey,
+				StateValue,
+				StateNext,
+				StateEnd,
+				StateDone,
+				StateError
+			};
+
+			Reader(const Reader&);
+			Reader& operator =(const Reader&);
+
+			ReaderEvent ReadValue();
+			ReaderEvent Error();
+			void FinishValue();
+
+			const char*			mBegin;
+			const char*			mCursor;
+			const char*			mEnd;
+			State				mState;
+			size_t				mErrorOffset;
+			std::string			mStack;			// '{' or '[' for each open object/array
+			std::string			mString;
+			bool				mIsInt;
+			int					mIntVal;
+			double				mDoubleVal;
+			bool				mBoolVal;
+
+			void*				mMapping;
+			size_t				mMappingLength;
+			std::string			mFileBuffer;	// used instead of a mapping where mmap isn't available
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	bool operator ==(const Object& lhs, const Object& rhs);
+	bool operator <(const Object& lhs, const Object& rhs);
 
 	inline bool operator ==(const Array& lhs, const Array& rhs)
 	{
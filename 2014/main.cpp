@@ -7,6 +7,8 @@
 
 #include "projectHeaders.h"
 #include "projectFunctions.h"
+#include "pipeline.h"
+#include "imageWriter.h"
 
 using namespace cv;
 using namespace std;
@@ -17,216 +19,277 @@ const char *dir = "/Users/Aaron/Pictures/output"; //Edit this line to suit your
 const char *jsonOut = "/Users/Aaron/Desktop/FinalOutput/output.json"; //Edit this line to suit your machine/filename
 const char *finalOut = "/Users/Aaron/Desktop/FinalOutput/"; //Edit this line to suit your machine/filename
 const char *candidateDir = "/Users/Aaron/Desktop/Output/candidate"; //Edit this line to suit your machine/filename
+const char *cborOut = "/Users/Aaron/Desktop/FinalOutput/output.cbor"; //Edit this line to suit your machine/filename
+const char *chipArchive = "/Users/Aaron/Desktop/FinalOutput/chips"; //Edit this line to suit your machine/filename
+const char *stageOut = "/Users/Aaron/Desktop/FinalOutput/stages.json"; //Edit this line to suit your machine/filename
 
 //Verbose debugging output, 0=off, 1=on
 int verbose = 1;
 
+//Results file format, 0=JSON text (jsonOut), 1=CBOR binary (cborOut)
+//tools/cborConvert.cpp turns a CBOR results file back into the JSON one
+int binaryOutput = 0;
+
+//Debug images (verbose=1) are written on a background thread. Up to writerQueueLength
+//images may wait; past that writerPolicy drops them (WRITER_DROP), waits for room
+//(WRITER_BLOCK), or waits for 1 in every writerSampleEvery and drops the rest (WRITER_SAMPLE)
+size_t writerQueueLength = 64;
+WriterPolicy writerPolicy = WRITER_DROP;
+int writerSampleEvery = 10;
+int jpegQuality = 95; //0-100
+int pngCompression = 3; //0-9
+
+//Where debug images go, 1=appended to the chipArchive .pack/.idx pair (tools/chipExtract.cpp
+//pulls them back out), 0=one file each in candidateDir and finalOut
+int packChips = 1;
+
+//Per stage timings for tools/evaluate.cpp, 0=off, 1=written to stageOut
+int stageTimings = 0;
+
+//CPU hardware counters per stage in the verbose stage report, 0=off, 1=on (Linux only,
+//and not in most containers or VMs; the report says when they couldn't be opened)
+int hardwareCounters = 0;
+
+//Color removal and blob detection run on the frame shrunk by this, 1=full resolution, 2=half, 4=quarter.
+//Candidates are still cropped from the full resolution frame for classification.
+int detectionScale = 1;
+
+//Color removal, BinaryImage and blob detection in bands of rows on this many threads, 0=whole frame at once
+int tileThreads = 0;
+
+//With detectionScale above 1: 1=decode each frame at the reduced size for detection and then only
+//the candidates at full resolution (a -DJPEG_REGIONS build, see jpegRegions.h), 0=decode it all
+int regionDecode = 0;
+
+//Frame files read into memory this many frames ahead on a helper thread, so decoding doesn't wait on the disk, 0=off
+int prefetchFrames = 4;
+
+//Quick look at each frame's EXIF thumbnail (or a 1/8 decode) to skip the ones with nothing in them, see quickReject.h.
+//QUICK_REJECT_OFF, QUICK_REJECT_THUMBNAIL or QUICK_REJECT_REDUCED. The margin widens the candidate area limits
+//for the quick look each way: bigger rejects fewer frames and risks missing fewer targets.
+QuickRejectMode quickReject = QUICK_REJECT_OFF;
+float quickRejectMargin = 4;
+
+//Near duplicate frames (see duplicateFilter.h): 0=off, 1=record which earlier frame covers each one, 2=skip them too.
+//A frame is a near duplicate within duplicateDistance bits (of 64) of a frame kept at most duplicateMaxGap frames before it.
+int duplicateFrames = 0;
+int duplicateMaxGap = 2;
+int duplicateDistance = 4;
+
+//Match each frame to the last with ORB features and only detect on the ground it adds, carrying the last
+//frame's candidates forward for the rest (see frameRegistration.h), 0=off, 1=on
+int registerFrames = 0;
+
+//Frames scoring under minQuality for sharpness and exposure (0 to 1, see frameQuality.h): QUALITY_REPORT only records
+//the score, QUALITY_RAISE_BAR makes their candidates need lowQualityConfidence from OCR, QUALITY_SKIP skips them
+QualityPolicy qualityPolicy = QUALITY_REPORT;
+double minQuality = 0.3;
+float lowQualityConfidence = 85;
+
+//Queues the candidates and targets ProcessFrame finds on the image writer, into the chip
+//archive if it's open and as individual files if not. Chips are cloned, so the queue
+//doesn't hold on to the frame's pooled buffers.
+class DebugChips : public ChipSink {
+public:
+    long frameNumber;
+    string fullPath;
+    
+    DebugChips ( ImageWriter &writer, ChipArchiveWriter &archive ) : frameNumber( 0 ), imageWriter( writer ), chips( archive ), finalCount( 0 ), writeCandidateCounter( 0 ) {}
+    
+    void Candidate ( int index, const Mat &chip ) {
+        StageScope stage( STAGE_DEBUG_IMAGES );
+        
+        if ( chips.IsOpen() ) {
+            ChipEntry entry;
+            entry.frame = ( uint32_t )frameNumber;
+            entry.candidate = index;
+            entry.kind = CHIP_CANDIDATE;
+            entry.SetBoundingBox( chip );
+            imageWriter.SubmitChip( chips, entry, chip.clone() );
+            return;
+        }
+        
+        ss << ( writeCandidateCounter + 1 );
+        imageWriter.Submit( candidateDir + ss.str() + ".jpg", chip.clone() );
+        writeCandidateCounter++;
+        ss.str( "" );
+    }
+    
+    void Target ( int index, const Mat &chip, const String &label ) {
+        StageScope stage( STAGE_DEBUG_IMAGES );
+        
+        if ( chips.IsOpen() ) {
+            ChipEntry entry;
+            entry.frame = ( uint32_t )frameNumber;
+            entry.candidate = index;
+            entry.kind = CHIP_TARGET;
+            entry.SetBoundingBox( chip );
+            entry.SetLabel( label );
+            imageWriter.SubmitChip( chips, entry, chip.clone() );
+        }
+        else if ( isdigit( fullPath.at( ( fullPath.length()-6 ) ) ) ) {
+            ss << finalCount+1;
+            imageWriter.Submit( String( finalOut ) + "target" + ss.str() + label + "origin" + fullPath.substr( ( fullPath.length()-6 ),( fullPath.length()-6 ) ), chip.clone() );
+            finalCount++;
+            ss.str( "" );
+        }
+        else {
+            ss << finalCount+1;
+            imageWriter.Submit( String( finalOut ) + "target" + ss.str() + label + "origin" + fullPath.substr( ( fullPath.length()-5 ),( fullPath.length()-5 ) ), chip.clone() );
+            finalCount++;
+            ss.str( "" );
+        }
+    }
+    
+private:
+    ImageWriter &imageWriter;
+    ChipArchiveWriter &chips;
+    int finalCount, writeCandidateCounter;
+    ostringstream ss;
+};
+
+//Path of frame a in dir
+static string FramePath ( long a ) {
+    ostringstream name;
+    name << dir << "/" << a << ".jpg";
+    return name.str();
+}
+
 int main ( void ) {
-    int finalCount = 0, bFinal = 0, gFinal = 0, rFinal = 0, writeCandidateCounter = 0, readCandidateCounter = 0;
-    int posCounter = 0, xPos[XY_BUFFER] = {0}, yPos[XY_BUFFER] = {0};
     ofstream jsonOutput;
     ostringstream ss;
-    map < String, bool > colors;
-    time_t startTimer, endTimer, candidateStart, candidateEnd, imageStart, imageEnd, targetStart, targetEnd;
-    json::Array finalArray;
+    time_t startTimer, endTimer, imageStart, imageEnd;
+    PipelineSettings settings;
+    MissionWriter mission( binaryOutput != 0 ? CBOR_OUTPUT : JSON_OUTPUT );
+    ImageWriterSettings writerSettings;
+    writerSettings.queueLength = writerQueueLength;
+    writerSettings.policy = writerPolicy;
+    writerSettings.sampleEvery = writerSampleEvery;
+    writerSettings.jpegQuality = jpegQuality;
+    writerSettings.pngCompression = pngCompression;
+    ImageWriter imageWriter( writerSettings );
+    ChipArchiveWriter chips;
+    if ( verbose != 0 && packChips != 0 && !chips.Open( chipArchive ) ) {
+        printf( "Could not open chip archive %s, writing individual files instead\n", chipArchive );
+    }
+    const char *resultsOut = ( binaryOutput != 0 ) ? cborOut : jsonOut;
+    ios::openmode resultsMode = ( binaryOutput != 0 ) ? ( ios::app | ios::binary ) : ios::app;
+    FrameRecord frame;
+    BufferPool pool;
+    DebugChips debugChips( imageWriter, chips );
+    FramePrefetcher prefetcher;
+    QuickRejectStats quickStats;
+    DuplicateFilterSettings duplicateSettings;
+    duplicateSettings.policy = ( duplicateFrames == 2 ) ? DUPLICATES_SKIP : DUPLICATES_KEEP;
+    duplicateSettings.maxGap = duplicateMaxGap;
+    duplicateSettings.maxDistance = duplicateDistance;
+    DuplicateFilter duplicateFilter( duplicateSettings );
+    DuplicateFilter *duplicates = ( duplicateFrames != 0 ) ? &duplicateFilter : NULL;
+    FrameRegistration frameRegistration;
+    FrameRegistration *registration = ( registerFrames != 0 ) ? &frameRegistration : NULL;
     
-    //Choose to remove "green", "brown" and/or "gray" as defined in the HSV
-    //value ranges seen in the inRange() function calls in RemoveColorsFromImage
-    colors.insert( make_pair( "Green", true ) );
-    colors.insert( make_pair( "Brown", true ) );
-    colors.insert( make_pair( "Gray", true ) );
+    settings.detectionScale = detectionScale;
+    settings.tileThreads = tileThreads;
+    settings.quickReject = quickReject;
+    settings.quickRejectMargin = quickRejectMargin;
+    settings.quality.policy = qualityPolicy;
+    settings.quality.minScore = minQuality;
+    settings.quality.lowQualityConfidence = lowQualityConfidence;
+    long lowQualityFrames = 0;
+    
+    if ( hardwareCounters != 0 ) {
+        EnableStageCounters();
+    }
     
     //Start run timer
     time( &startTimer );
     
+    for ( long a = 0; a < prefetchFrames && a < NUM_FILES; a++ ) {
+        prefetcher.Prefetch( FramePath( a ) );
+    }
+    
     //For every file in the directory specified in global variable *dir
     for ( long a = 0; a < NUM_FILES; a++ ) {
         //Generate image name string
-        ss << a;
-        string fullPath = String( dir ) + "/" + ss.str() + ".jpg";
-        ss.str( "" );
+        string fullPath = FramePath( a );
+        
+        //Keep the helper prefetchFrames ahead of this frame
+        if ( prefetchFrames > 0 ) {
+            prefetcher.Claim( fullPath );
+            if ( a + prefetchFrames < NUM_FILES ) {
+                prefetcher.Prefetch( FramePath( a + prefetchFrames ) );
+            }
+        }
         
         //Start image timer
         time( &imageStart );
         
-        //Read an image
-        Mat original = CreateMatFromImage( fullPath );
-        
-        /*
-         Remove the desired colors from the image by scaling it
-         into the HSV colorspace, creating a binary mask from
-         the result, and overlaying it back onto the original.
-         */
-        Mat reducedColors = RemoveColorsFromImage( original, colors );
-        Mat binary = BinaryImage( reducedColors );
+        //Full resolution buffers are recycled from frame to frame
+        pool.NextFrame();
+        duplicateFilter.NextFrame( a );
         
-        /*
-         Store any candidate targets found in the image in an array
-         Min and Max area values determined from size of target and
-         height from which the image is taken (did not have time for
-         this algorithm; supplied values were determined from test
-         image generation suite inputs)
-         */
-        vector< Mat > candidates = FindCandidateTargets ( original, binary, MIN_AREA, MAX_AREA, WHITE, &posCounter, xPos, yPos );
+        //Read the image, detect and classify, handing debug chips to the writer if debugging enabled
+        debugChips.frameNumber = a;
+        debugChips.fullPath = fullPath;
+        ChipSink *chipSink = ( verbose != 0 ) ? &debugChips : NULL;
         
-        //Start candidate timer
-        time( &candidateStart );
-        
-        //Write all the candidate targets to a directory
-        for ( int i = 0; i < candidates.size(); i++ ) {
-            ss << ( writeCandidateCounter + 1 );
-            imwrite( candidateDir + ss.str() + ".jpg", candidates[i] );
-            writeCandidateCounter++;
-            ss.str( "" );
+        if ( QuickRejectFrame( fullPath, settings, quickStats ) ) {
+            //Nothing there worth a candidate: recorded as a frame where none were found
+            frame.targets.clear();
+            frame.candidate_time = "0";
+            frame.covered_by = -1;
+            frame.quality = -1;
+        }
+        else if ( regionDecode != 0 ) {
+            ProcessFrameFromFile( fullPath, settings, &pool, frame, chipSink, duplicates, registration );
+        }
+        else {
+            Mat original = CreateMatFromImage( fullPath, &pool );
+            ProcessFrame( original, settings, &pool, frame, chipSink, duplicates, registration );
         }
         
-        //stop candidate time
-        time( &candidateEnd );
-        double candidateTime = CalcTime( candidateStart, candidateEnd, "sec" );
-        
-        //Create new json array for each image
-        json::Array targets;
-        
-        //For each candidate that has been designated as a target
-        for ( int i = 0; i < candidates.size(); i++ ) {
-            //start target timer
-            time( &targetStart );
-            
-            String characterNames[CLUSTERS];
-            int badFlag = 0;
-            
-            //Split the target into 5 different color bins and write each bin
-            //to a separate Mat
-            ss << readCandidateCounter+1;
-            Mat can = imread( candidateDir + ss.str() + ".jpg" );
-            vector< Mat > clusters = CreateClustersFromMat( can, CLUSTERS );
-            readCandidateCounter++;
-            ss.str( "" );
-            
-            //Attempt to determine a character name from any of the five bins
-            for ( int x = 0; x < ( sizeof( characterNames )/sizeof( *characterNames ) ); x++ ) {
-                if ( !clusters[x].empty() ) {
-                    characterNames[x] = Identify( Mat(), clusters[x] );
-                }
-            }
-            
-            //Increment a counter if we found no character in a Mat
-            for ( int x = 0; x < ( sizeof( characterNames )/sizeof( *characterNames ) ); x++ ) {
-                if ( characterNames[x] == "BAD" ) {
-                    badFlag++;
-                }
-            }
-            
-            //If they're all bad, toss out the target
-            if ( badFlag == CLUSTERS ) {
-                posCounter++;
-                badFlag = 0;
-                continue;
-            }
-            
-            String conf[CLUSTERS];
-            
-            //Store the confidence rates in Strings
-            for ( int x = 0; x < ( sizeof( characterNames )/sizeof( *characterNames ) ); x++ ) {
-                if ( characterNames[x] != "BAD" )
-                    conf[x] = characterNames[x].substr( 2, 2 );
-                else
-                    conf[x] = "00000";
-            }
-            
-            //Assume conf1 is highest
-            int topConf = 1;
-            
-            istringstream istrConfs[CLUSTERS];
-            int confidence[CLUSTERS];
-            
-            //Take the String-based confidence rate and morph it into an Int
-            //Store the Ints in another array
-            for ( int x = 0; x < sizeof( istrConfs )/sizeof( *istrConfs ); x++ ) {
-                istrConfs[x].str(conf[x]);
-                istrConfs[x] >> confidence[x];
-            }
-            
-            //Determine the highest confidence rate out of the five bins
-            for ( int x = 0; x < sizeof( confidence )/sizeof( *confidence ); x++ ) {
-                if ( x == 0 ) {
-                    topConf = 0;
-                    continue;
-                }
-                else if ( confidence[x] > confidence[topConf] ) {
-                    topConf = x;
-                }
-            }
-            
-            //reset the bad character flag
-            badFlag = 0;
-            
-            //if the OCR function lets the candidate pass, it's a target
-            Mat targetCutout = candidates[i];
-            
-            Mat clearTarget = RemoveColorsFromImage( targetCutout, colors );
-            Mat cleanTargetThresh = BinaryImage( clearTarget );
-            
-            //Determine shape of the target
-            String shape = DetermineShape( cleanTargetThresh );
-            
-            //Determine target color and character (inner target) color
-            String targetColor = DetectTargetColor( clearTarget, &bFinal, &gFinal, &rFinal );
-            String characterColor = DetectCharacterColor( clearTarget, &bFinal, &gFinal, &rFinal );
-            
-            //Write the target out locally to a file for later evaluation if debugging enabled
-            if ( verbose != 0 ) {
-                if ( isdigit( fullPath.at( ( fullPath.length()-6 ) ) ) ) {
-                    ss << finalCount+1;
-                    imwrite( String( finalOut ) + "target" + ss.str() + characterNames[topConf] + "origin" + fullPath.substr( ( fullPath.length()-6 ),( fullPath.length()-6 ) ), targetCutout );
-                    finalCount++;
-                    ss.str( "" );
-                }
-                else {
-                    ss << finalCount+1;
-                    imwrite( String( finalOut ) + "target" + ss.str() + characterNames[topConf] + "origin" + fullPath.substr( ( fullPath.length()-5 ),( fullPath.length()-5 ) ), targetCutout );
-                    finalCount++;
-                    ss.str( "" );
-                }
-            }
-            
-            //stop target time
-            time( &targetEnd );
-            double targetTime = CalcTime( targetStart, targetEnd, "sec" );
-            
-            //save target data to JSON object
-            ss << targetTime;
-            json::Object myObject;
-            string sub = characterNames[topConf].substr( 0,1 );
-            myObject["letter"] = LowerLetter( sub );
-            myObject["letter_color"] = characterColor;
-            myObject["shape"] = shape;
-            myObject["shape_color"] = targetColor;
-            myObject["x"] = xPos[posCounter];
-            myObject["y"] = yPos[posCounter];
-            myObject["target_time"] = ss.str();
-            posCounter++;
-            ss.str( "" );
-            
-            //save target data to original image's JSON object
-            targets.push_back( myObject );
+        if ( frame.quality >= 0 && frame.quality < minQuality ) {
+            lowQualityFrames++;
         }
         
         //stop image time
         time( &imageEnd );
         double imageTime = CalcTime( imageStart, imageEnd, "sec" );
         
-        //save calculation time data
-        json::Object myObject;
-        ss << candidateTime;
-        myObject["candidate_time"] = ss.str();
-        ss.str("");
+        //save calculation time data and write the frame straight into the output text
         ss << imageTime;
-        myObject["image_time"] = ss.str();
+        frame.image_time = ss.str();
         ss.str("");
-        myObject["targets"] = targets;
         
-        finalArray.push_back( myObject );
+        {
+            StageScope stage( STAGE_EMIT );
+            mission.AddFrame( frame );
+        }
+        
+        //Once the pool has warmed up this should report no allocations
+        if ( verbose != 0 ) {
+            pool.PrintFrameStats( a );
+        }
+    }
+    
+    //Let any debug images still queued reach the disk before timing the run
+    imageWriter.Finish();
+    chips.Close();
+    prefetcher.Stop();
+    if ( verbose != 0 ) {
+        imageWriter.PrintStats();
+        prefetcher.PrintStats();
+        if ( quickReject != QUICK_REJECT_OFF ) {
+            PrintQuickRejectStats( quickStats );
+        }
+        if ( duplicates != NULL ) {
+            duplicates->PrintStats();
+        }
+        if ( registration != NULL ) {
+            registration->PrintStats();
+        }
+        printf( "Quality: %ld frames under %.2f%s\n", lowQualityFrames, minQuality,
+                qualityPolicy == QUALITY_SKIP ? ", skipped" : qualityPolicy == QUALITY_RAISE_BAR ? ", OCR bar raised" : "" );
     }
     
     //stop run time
@@ -238,11 +301,9 @@ int main ( void ) {
     
     //output run time to JSON file and close it
     try {
-        json::Object myObject;
-        myObject["runtime"] = runTime;
-        finalArray.push_back( myObject );
-        String serialized_json = json::Serialize( finalArray );
-        jsonOutput.open( jsonOut, ios::app );
+        StageScope stage( STAGE_EMIT );
+        const String &serialized_json = mission.Finish( runTime );
+        jsonOutput.open( resultsOut, resultsMode );
         jsonOutput << serialized_json;
         jsonOutput.close();
     } catch(...) {
@@ -253,8 +314,8 @@ int main ( void ) {
     
     if (closingFlag == 1) {
         try {
-            String serialized_json = json::Serialize( finalArray );
-            jsonOutput.open( jsonOut, ios::app );
+            const String &serialized_json = mission.GetText();
+            jsonOutput.open( resultsOut, resultsMode );
             jsonOutput << serialized_json;
             jsonOutput.close();
         } catch (...) {
@@ -263,5 +324,15 @@ int main ( void ) {
         }
     }
     
+    //Where the time and (with memoryTrace.cpp built in) the memory went, stage by stage
+    if ( verbose != 0 ) {
+        PrintStageReport();
+    }
+    
+    //The same timings for tools/evaluate.cpp to put next to the accuracy
+    if ( stageTimings != 0 && !WriteStageTimings( stageOut ) ) {
+        printf( "Could not write the stage timings to %s\n", stageOut );
+    }
+    
     return 0;
 }
\ No newline at end of file
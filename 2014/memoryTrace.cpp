@@ -0,0 +1,170 @@
+//
+//  memoryTrace.cpp
+//  capstone_functions
+//
+//  Allocation hooks for the stage report (stageProfiler.h). This file is
+//  empty unless it's built with -DTRACE_MEMORY. Then it replaces the global
+//  operator new/delete, and on OpenCV 3 and later the default cv::Mat
+//  allocator, so every allocation is charged to the stage that thread is
+//  in. Mat pixels don't go through operator new. OpenCV 2.4 has no default
+//  allocator to swap out, so on 2.4 only the C++ heap gets counted.
+//
+//  Every operator new block grows by 16 bytes, and every allocation pays a
+//  few atomic adds. Keep it out of flight builds.
+//
+
+#ifdef TRACE_MEMORY
+
+#include <stdlib.h>
+#include <new>
+#include <opencv2/opencv.hpp>
+#include "stageProfiler.h"
+
+//Each block carries its size in front so delete knows how much to give back.
+//16 bytes keeps what follows as aligned as malloc left it.
+static const size_t HEADER = 16;
+
+static void *TracedAlloc ( size_t size ) {
+    void *block = malloc( size + HEADER );
+    if ( block == NULL ) {
+        return NULL;
+    }
+    *( size_t * )block = size;
+    TraceAllocation( size );
+    return ( char * )block + HEADER;
+}
+
+static void TracedFree ( void *memory ) {
+    if ( memory == NULL ) {
+        return;
+    }
+    void *block = ( char * )memory - HEADER;
+    TraceFree( *( size_t * )block );
+    free( block );
+}
+
+static void *TracedNew ( size_t size ) {
+    for ( ;; ) {
+        void *memory = TracedAlloc( size );
+        if ( memory != NULL ) {
+            return memory;
+        }
+
+        std::new_handler handler = std::get_new_handler();
+        if ( handler == NULL ) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void *operator new ( size_t size ) {
+    return TracedNew( size );
+}
+
+void *operator new[] ( size_t size ) {
+    return TracedNew( size );
+}
+
+void *operator new ( size_t size, const std::nothrow_t & ) noexcept {
+    try {
+        return TracedNew( size );
+    }
+    catch ( ... ) {
+        return NULL;
+    }
+}
+
+void *operator new[] ( size_t size, const std::nothrow_t & ) noexcept {
+    try {
+        return TracedNew( size );
+    }
+    catch ( ... ) {
+        return NULL;
+    }
+}
+
+void operator delete ( void *memory ) noexcept {
+    TracedFree( memory );
+}
+
+void operator delete[] ( void *memory ) noexcept {
+    TracedFree( memory );
+}
+
+void operator delete ( void *memory, const std::nothrow_t & ) noexcept {
+    TracedFree( memory );
+}
+
+void operator delete[] ( void *memory, const std::nothrow_t & ) noexcept {
+    TracedFree( memory );
+}
+
+#if defined( __cpp_sized_deallocation )
+void operator delete ( void *memory, size_t ) noexcept {
+    TracedFree( memory );
+}
+
+void operator delete[] ( void *memory, size_t ) noexcept {
+    TracedFree( memory );
+}
+#endif
+
+#if CV_MAJOR_VERSION >= 3
+
+#if CV_MAJOR_VERSION >= 4
+typedef cv::AccessFlag MatAccessFlags;
+#else
+typedef int MatAccessFlags;
+#endif
+
+//Lets OpenCV's own allocator do the work and counts what it hands out. Mats it
+//allocates point back here, so their release comes through deallocate() too.
+class TracingMatAllocator : public cv::MatAllocator {
+public:
+    TracingMatAllocator () : inner( cv::Mat::getStdAllocator() ) {}
+
+    cv::UMatData *allocate ( int dims, const int *sizes, int type, void *data, size_t *step, MatAccessFlags flags, cv::UMatUsageFlags usage ) const {
+        cv::UMatData *u = inner->allocate( dims, sizes, type, data, step, flags, usage );
+        if ( u != NULL ) {
+            u->currAllocator = this;
+            if ( !( u->flags & cv::UMatData::USER_ALLOCATED ) ) {
+                TraceAllocation( u->size );
+            }
+        }
+        return u;
+    }
+
+    bool allocate ( cv::UMatData *u, MatAccessFlags flags, cv::UMatUsageFlags usage ) const {
+        return inner->allocate( u, flags, usage );
+    }
+
+    void deallocate ( cv::UMatData *u ) const {
+        if ( u == NULL ) {
+            return;
+        }
+        if ( !( u->flags & cv::UMatData::USER_ALLOCATED ) ) {
+            TraceFree( u->size );
+        }
+        u->currAllocator = inner;
+        inner->deallocate( u );
+    }
+
+private:
+    cv::MatAllocator *inner;
+};
+
+#endif
+
+//Runs during static initialization. The allocator is never deleted, because
+//Mats released after main() returns still call back into it.
+static struct InstallMemoryTrace {
+    InstallMemoryTrace () {
+        EnableMemoryTrace();
+#if CV_MAJOR_VERSION >= 3
+        cv::Mat::setDefaultAllocator( new TracingMatAllocator() );
+#endif
+    }
+} installMemoryTrace;
+
+#endif /* TRACE_MEMORY */
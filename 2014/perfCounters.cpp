@@ -0,0 +1,138 @@
+//
+//  perfCounters.cpp
+//  capstone_functions
+//
+
+#include "perfCounters.h"
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+using namespace std;
+
+static const char *counterNames[COUNTER_COUNT] = { "cycles", "instructions", "cache misses", "branch misses" };
+
+const char *CounterName ( HardwareCounter counter ) {
+    return ( counter >= 0 && counter < COUNTER_COUNT ) ? counterNames[counter] : "?";
+}
+
+PerfCounters::PerfCounters () : leader( -1 ), opened( 0 ) {
+    for ( int i = 0; i < COUNTER_COUNT; i++ ) {
+        fds[i] = -1;
+        slot[i] = -1;
+    }
+}
+
+PerfCounters::~PerfCounters () {
+    Close();
+}
+
+#ifdef __linux__
+
+static const uint64_t eventConfig[COUNTER_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+static int OpenEvent ( uint64_t config, int groupFd ) {
+    struct perf_event_attr attr;
+    memset( &attr, 0, sizeof( attr ) );
+    attr.size = sizeof( attr );
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = ( groupFd < 0 ) ? 1 : 0;       //the whole group starts when the leader does
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    //This thread, on whichever CPU it runs
+    return ( int )syscall( __NR_perf_event_open, &attr, 0, -1, groupFd, 0 );
+}
+
+bool PerfCounters::Open () {
+    Close();
+
+    //Whichever counter opens first leads the group
+    for ( int i = 0; i < COUNTER_COUNT; i++ ) {
+        int fd = OpenEvent( eventConfig[i], leader );
+        if ( fd < 0 ) {
+            if ( error.empty() ) {
+                error = string( "perf_event_open (" ) + counterNames[i] + "): " + strerror( errno );
+                if ( errno == EACCES || errno == EPERM ) {
+                    error += " (check /proc/sys/kernel/perf_event_paranoid)";
+                }
+            }
+            continue;
+        }
+
+        if ( leader < 0 ) {
+            leader = fd;
+        }
+        fds[i] = fd;
+        slot[i] = opened++;
+    }
+
+    if ( leader < 0 ) {
+        return false;
+    }
+
+    ioctl( leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+    ioctl( leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+    return true;
+}
+
+void PerfCounters::Close () {
+    for ( int i = 0; i < COUNTER_COUNT; i++ ) {
+        if ( fds[i] >= 0 ) {
+            close( fds[i] );
+        }
+        fds[i] = -1;
+        slot[i] = -1;
+    }
+    leader = -1;
+    opened = 0;
+    error.clear();
+}
+
+bool PerfCounters::Read ( uint64_t values[COUNTER_COUNT] ) const {
+    if ( leader < 0 ) {
+        return false;
+    }
+
+    //Group layout: number of counters, time enabled, time running, then one value per counter
+    uint64_t data[3 + COUNTER_COUNT];
+    ssize_t got = read( leader, data, sizeof( data ) );
+    if ( got < ( ssize_t )( 3 * sizeof( uint64_t ) ) || data[0] != ( uint64_t )opened || data[2] == 0 ) {
+        return false;
+    }
+
+    double scale = ( double )data[1] / data[2];
+    for ( int i = 0; i < COUNTER_COUNT; i++ ) {
+        values[i] = ( slot[i] >= 0 ) ? ( uint64_t )( data[3 + slot[i]] * scale ) : 0;
+    }
+    return true;
+}
+
+#else
+
+bool PerfCounters::Open () {
+    error = "hardware counters need Linux perf_event_open";
+    return false;
+}
+
+void PerfCounters::Close () {
+}
+
+bool PerfCounters::Read ( uint64_t values[COUNTER_COUNT] ) const {
+    return false;
+}
+
+#endif
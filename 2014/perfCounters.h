@@ -0,0 +1,62 @@
+//
+//  perfCounters.h
+//  capstone_functions
+//
+//  CPU hardware counters (cycles, instructions, cache misses, branch misses)
+//  for the calling thread, read through Linux perf_event_open. The four
+//  counters are opened as one group so they all cover the same stretch of
+//  time. Kernel time isn't counted, so the default perf_event_paranoid
+//  setting of 2 is enough.
+//
+//  Many machines can't provide these: anything but Linux, most containers
+//  and some VMs. Open() then returns false and Error() says why. If only
+//  some events are missing (e.g. a VM with cycles but no cache events),
+//  the rest still work and Has() reports which ones did.
+//
+
+#ifndef __capstone_functions__perfCounters__
+#define __capstone_functions__perfCounters__
+
+#include <stdint.h>
+#include <string>
+
+enum HardwareCounter {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES,       //last level cache
+    COUNTER_BRANCH_MISSES,
+    COUNTER_COUNT
+};
+
+const char *CounterName ( HardwareCounter counter );
+
+class PerfCounters {
+public:
+    PerfCounters ();
+    ~PerfCounters ();
+
+    //Starts counting on the calling thread; reads from any other thread are meaningless
+    bool Open ();
+    void Close ();
+    bool IsOpen () const { return leader >= 0; }
+
+    bool Has ( HardwareCounter counter ) const { return slot[counter] >= 0; }
+
+    //Totals since Open(), scaled up if the kernel had to share the hardware with
+    //other counters. Counters Has() says are missing read 0.
+    bool Read ( uint64_t values[COUNTER_COUNT] ) const;
+
+    const std::string &Error () const { return error; }
+
+private:
+    PerfCounters ( const PerfCounters & );
+    PerfCounters &operator= ( const PerfCounters & );
+
+    int leader;                     //group leader's fd, -1 when closed
+    int fds[COUNTER_COUNT];
+    int slot[COUNTER_COUNT];        //position in the group read, -1 if the counter couldn't be opened
+    int opened;
+    std::string error;
+};
+
+#endif /* defined(__capstone_functions__perfCounters__) */
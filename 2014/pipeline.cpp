@@ -0,0 +1,339 @@
+//
+//  pipeline.cpp
+//  capstone_functions
+//
+
+#include "pipeline.h"
+
+/*
+ Remove the desired colors from the image by scaling it
+ into the HSV colorspace, creating a binary mask from
+ the result, and overlaying it back onto the original.
+ */
+static Mat CandidateMask ( Mat detect, const PipelineSettings &settings, BufferPool *pool ) {
+    if ( settings.tileThreads > 0 ) {
+        //The same mask worked out a band of rows at a time, in parallel
+        return TiledCandidateMask( detect, settings.colors, pool, settings.tileThreads );
+    }
+
+    Mat reducedColors = RemoveColorsFromImage( detect, settings.colors, pool );
+    return BinaryImage( reducedColors, pool );
+}
+
+/*
+ Store any candidate targets found in the image in an array
+ Min and Max area values determined from size of target and
+ height from which the image is taken (did not have time for
+ this algorithm; supplied values were determined from test
+ image generation suite inputs)
+ */
+static vector< CandidateRegion > FindRegions ( Mat binary, const PipelineSettings &settings, Point offset = Point() ) {
+    return FindCandidateRegions( binary, settings.minArea, settings.maxArea, WHITE, settings.detectionScale, settings.tileThreads, offset );
+}
+
+//Looks for a carried candidate again inside its box, centered where the homography puts it, so its
+//position comes from this frame. False if nothing is there any more, and the candidate is dropped.
+static bool Redetect ( Mat detect, const PipelineSettings &settings, CandidateRegion &region ) {
+    int scale = max( 1, settings.detectionScale );
+    Rect window( region.box.x / scale, region.box.y / scale, region.box.width / scale, region.box.height / scale );
+    window &= Rect( 0, 0, detect.cols, detect.rows );
+    if ( window.area() == 0 ) {
+        return false;
+    }
+
+    //The window is a few times the blob's size, too small to be worth tiling or pooling
+    Mat binary = BinaryImage( RemoveColorsFromImage( detect( window ), settings.colors ) );
+    vector< CandidateRegion > found = FindCandidateRegions( binary, settings.minArea, settings.maxArea, WHITE, settings.detectionScale, 0, window.tl() );
+
+    double closest = -1;
+    for ( size_t i = 0; i < found.size(); i++ ) {
+        Point gap = found[i].center - region.center;
+        double distance = gap.dot( gap );
+        if ( closest < 0 || distance < closest ) {
+            closest = distance;
+            region = found[i];
+        }
+    }
+    return closest >= 0;
+}
+
+//Detection on the detection image, or with a FrameRegistration on just the part of it the last frame
+//didn't cover, plus the last frame's candidates that are still in view (see frameRegistration.h)
+static vector< CandidateRegion > DetectRegions ( Mat detect, const PipelineSettings &settings, BufferPool *pool, FrameRegistration *registration ) {
+    if ( registration == NULL ) {
+        return FindRegions( CandidateMask( detect, settings, pool ), settings );
+    }
+
+    registration->Register( detect, settings.detectionScale );
+    vector< CandidateRegion > carried = registration->CarryForward(), regions;
+    for ( size_t i = 0; i < carried.size(); i++ ) {
+        if ( !Redetect( detect, settings, carried[i] ) ) {
+            continue;
+        }
+
+        //Two carried candidates can close in on the same blob
+        bool seen = false;
+        for ( size_t j = 0; j < regions.size() && !seen; j++ ) {
+            seen = regions[j].center == carried[i].center;
+        }
+        if ( !seen ) {
+            regions.push_back( carried[i] );
+        }
+    }
+
+    Rect exposed = registration->ExposedRegion();
+    if ( exposed.area() > 0 ) {
+        vector< CandidateRegion > found = FindRegions( CandidateMask( detect( exposed ), settings, pool ), settings, exposed.tl() );
+        for ( size_t i = 0; i < found.size(); i++ ) {
+            if ( !registration->InOverlap( found[i].center ) ) {
+                regions.push_back( found[i] );
+            }
+        }
+    }
+
+    registration->Keep( regions );
+    return regions;
+}
+
+//Everything after detection: crops the candidates out of the full resolution frame and classifies them
+static int ClassifyCandidates ( Mat original, const vector< CandidateRegion > &regions, const PipelineSettings &settings, float minConfidence, FrameRecord &frame, ChipSink *chips ) {
+    int bFinal = 0, gFinal = 0, rFinal = 0;
+    int posCounter = 0, xPos[XY_BUFFER] = {0}, yPos[XY_BUFFER] = {0};
+    time_t candidateStart, candidateEnd, targetStart, targetEnd;
+    ostringstream ss;
+
+    vector< Mat > candidates = CropCandidates( original, regions, &posCounter, xPos, yPos );
+
+    //Start candidate timer
+    time( &candidateStart );
+
+    //Hand all the candidate targets to the debug output if there is one
+    if ( chips != NULL ) {
+        for ( int i = 0; i < candidates.size(); i++ ) {
+            chips->Candidate( i, candidates[i] );
+        }
+    }
+
+    //stop candidate time
+    time( &candidateEnd );
+    ss << CalcTime( candidateStart, candidateEnd, "sec" );
+    frame.candidate_time = ss.str();
+    ss.str( "" );
+
+    //Start a new record for each image
+    frame.targets.clear();
+
+    //For each candidate that has been designated as a target
+    for ( int i = 0; i < candidates.size(); i++ ) {
+        //start target timer
+        time( &targetStart );
+
+        String characterNames[CLUSTERS];
+        int badFlag = 0;
+
+        //Split the target into 5 different color bins and write each bin
+        //to a separate Mat. The candidate is a view into the frame, so
+        //clone it into the continuous buffer k means needs
+        Mat can = candidates[i].clone();
+        vector< Mat > clusters = CreateClustersFromMat( can, CLUSTERS );
+
+        //Attempt to determine a character name from any of the five bins
+        for ( int x = 0; x < ( sizeof( characterNames )/sizeof( *characterNames ) ); x++ ) {
+            if ( !clusters[x].empty() ) {
+                characterNames[x] = Identify( Mat(), clusters[x], minConfidence );
+            }
+        }
+
+        //Increment a counter if we found no character in a Mat
+        for ( int x = 0; x < ( sizeof( characterNames )/sizeof( *characterNames ) ); x++ ) {
+            if ( characterNames[x] == "BAD" ) {
+                badFlag++;
+            }
+        }
+
+        //If they're all bad, toss out the target
+        if ( badFlag == CLUSTERS ) {
+            posCounter++;
+            badFlag = 0;
+            continue;
+        }
+
+        String conf[CLUSTERS];
+
+        //Store the confidence rates in Strings
+        for ( int x = 0; x < ( sizeof( characterNames )/sizeof( *characterNames ) ); x++ ) {
+            if ( characterNames[x] != "BAD" )
+                conf[x] = characterNames[x].substr( 2, 2 );
+            else
+                conf[x] = "00000";
+        }
+
+        //Assume conf1 is highest
+        int topConf = 1;
+
+        istringstream istrConfs[CLUSTERS];
+        int confidence[CLUSTERS];
+
+        //Take the String-based confidence rate and morph it into an Int
+        //Store the Ints in another array
+        for ( int x = 0; x < sizeof( istrConfs )/sizeof( *istrConfs ); x++ ) {
+            istrConfs[x].str(conf[x]);
+            istrConfs[x] >> confidence[x];
+        }
+
+        //Determine the highest confidence rate out of the five bins
+        for ( int x = 0; x < sizeof( confidence )/sizeof( *confidence ); x++ ) {
+            if ( x == 0 ) {
+                topConf = 0;
+                continue;
+            }
+            else if ( confidence[x] > confidence[topConf] ) {
+                topConf = x;
+            }
+        }
+
+        //reset the bad character flag
+        badFlag = 0;
+
+        //if the OCR function lets the candidate pass, it's a target
+        Mat targetCutout = candidates[i];
+
+        Mat clearTarget = RemoveColorsFromImage( targetCutout, settings.colors );
+        Mat cleanTargetThresh = BinaryImage( clearTarget );
+
+        //Determine shape of the target
+        String shape = DetermineShape( cleanTargetThresh );
+
+        //Determine target color and character (inner target) color
+        String targetColor = DetectTargetColor( clearTarget, &bFinal, &gFinal, &rFinal );
+        String characterColor = DetectCharacterColor( clearTarget, &bFinal, &gFinal, &rFinal );
+
+        //Hand the target to the debug output for later evaluation
+        if ( chips != NULL ) {
+            chips->Target( i, targetCutout, characterNames[topConf] );
+        }
+
+        //stop target time
+        time( &targetEnd );
+        double targetTime = CalcTime( targetStart, targetEnd, "sec" );
+
+        //save target data to the image's record
+        ss << targetTime;
+        TargetRecord target;
+        string sub = characterNames[topConf].substr( 0,1 );
+        target.letter = LowerLetter( sub );
+        target.letter_color = characterColor;
+        target.shape = shape;
+        target.shape_color = targetColor;
+        target.x = xPos[posCounter];
+        target.y = yPos[posCounter];
+        target.target_time = ss.str();
+        posCounter++;
+        ss.str( "" );
+
+        frame.targets.push_back( std::move( target ) );
+    }
+
+    return ( int )candidates.size();
+}
+
+//Records which earlier frame covers this one, if any, and whether that means skipping the rest of the pipeline
+static bool SkipDuplicate ( Mat image, DuplicateFilter *duplicates, FrameRecord &frame ) {
+    frame.covered_by = ( duplicates != NULL ) ? ( int )duplicates->Check( image ) : -1;
+    frame.quality = -1;
+
+    if ( frame.covered_by < 0 || !duplicates->SkipsDuplicates() ) {
+        return false;
+    }
+
+    //Nothing here the covering frame didn't already see
+    frame.targets.clear();
+    frame.candidate_time = "0";
+    return true;
+}
+
+//Lets a frame that's going through the pipeline cover the ones after it. Only after the quality gate:
+//a skipped blurred frame would otherwise get a sharp near copy of it skipped as well.
+static void CommitFrame ( DuplicateFilter *duplicates ) {
+    if ( duplicates != NULL ) {
+        duplicates->Commit();
+    }
+}
+
+//Scores the frame into frame.quality. Returns the OCR confidence its candidates need, or -1 if
+//it's poor enough to skip the rest of the pipeline.
+static float QualityGate ( Mat image, const PipelineSettings &settings, FrameRecord &frame ) {
+    frame.quality = MeasureFrameQuality( image, settings.quality ).score;
+
+    if ( frame.quality >= settings.quality.minScore || settings.quality.policy == QUALITY_REPORT ) {
+        return MIN_CONFIDENCE;
+    }
+    if ( settings.quality.policy == QUALITY_RAISE_BAR ) {
+        return settings.quality.lowQualityConfidence;
+    }
+
+    //Whatever it found would be junk
+    frame.targets.clear();
+    frame.candidate_time = "0";
+    return -1;
+}
+
+int ProcessFrame ( Mat original, const PipelineSettings &settings, BufferPool *pool, FrameRecord &frame, ChipSink *chips, DuplicateFilter *duplicates, FrameRegistration *registration ) {
+    if ( SkipDuplicate( original, duplicates, frame ) ) {
+        return 0;
+    }
+
+    //At MIN_AREA a target is still plenty of pixels at half or quarter size, so detection can run on a shrunk copy
+    Mat detect = ReduceImage( original, settings.detectionScale, pool );
+
+    float minConfidence = QualityGate( detect, settings, frame );
+    if ( minConfidence < 0 ) {
+        return 0;
+    }
+    CommitFrame( duplicates );
+
+    return ClassifyCandidates( original, DetectRegions( detect, settings, pool, registration ), settings, minConfidence, frame, chips );
+}
+
+int ProcessFrameFromFile ( const string &fullPath, const PipelineSettings &settings, BufferPool *pool, FrameRecord &frame, ChipSink *chips, DuplicateFilter *duplicates, FrameRegistration *registration ) {
+    //Without a reduced detection pass every pixel is needed anyway
+    if ( settings.detectionScale <= 1 ) {
+        return ProcessFrame( CreateMatFromImage( fullPath, pool ), settings, pool, frame, chips, duplicates, registration );
+    }
+
+    //Detect on a reduced decode, then decode just the candidates at full resolution. The hash
+    //only looks at the frame at 9x8, so the reduced decode does for it too.
+    Mat detect = CreateMatFromImage( fullPath, pool, settings.detectionScale );
+    if ( SkipDuplicate( detect, duplicates, frame ) ) {
+        return 0;
+    }
+
+    float minConfidence = QualityGate( detect, settings, frame );
+    if ( minConfidence < 0 ) {
+        return 0;
+    }
+    CommitFrame( duplicates );
+
+    vector< CandidateRegion > regions = DetectRegions( detect, settings, pool, registration );
+
+    vector< Rect > boxes;
+    for ( size_t i = 0; i < regions.size(); i++ ) {
+        boxes.push_back( regions[i].box );
+    }
+    Mat original = CreateMatFromImageRegions( fullPath, boxes, pool );
+
+    return ClassifyCandidates( original, regions, settings, minConfidence, frame, chips );
+}
+
+bool QuickRejectFrame ( const string &fullPath, const PipelineSettings &settings, QuickRejectStats &stats ) {
+    if ( settings.quickReject == QUICK_REJECT_OFF ) {
+        return false;
+    }
+
+    //The frame's decode maps the file again if it isn't rejected, which costs next to nothing with the pages already in memory
+    MappedFile file;
+    if ( !file.Open( fullPath ) ) {
+        return false;
+    }
+    return QuickLookEmpty( file.AsMat(), settings.quickReject, settings.colors, settings.minArea, settings.maxArea, settings.quickRejectMargin, stats );
+}
@@ -0,0 +1,67 @@
+//
+//  pipeline.h
+//  capstone_functions
+//
+//  One decoded frame through the whole detection and classification chain:
+//  color removal, candidate detection, then clustering, OCR, shape and color
+//  for every candidate. main() and the benchmarks both call it. Debug output
+//  is left to an optional ChipSink, so a caller that only wants the results
+//  pays nothing for it.
+//
+
+#ifndef __capstone_functions__pipeline__
+#define __capstone_functions__pipeline__
+
+#include "projectFunctions.h"
+#include "targetRecord.h"
+#include "quickReject.h"
+#include "duplicateFilter.h"
+#include "frameRegistration.h"
+#include "frameQuality.h"
+
+struct PipelineSettings {
+    map< String, bool > colors;     //colors RemoveColorsFromImage takes out of the frame
+    float minArea;                  //candidate blob size limits in pixels, see FindCandidateTargets
+    float maxArea;
+    int detectionScale;             //color removal and blob detection run on the frame shrunk by this (1, 2 or 4);
+                                    //candidates are still cut from the full resolution frame
+    int tileThreads;                //0 runs the detection stages over the whole frame at once; more
+                                    //splits them into bands of rows on this many threads (tiledDetection.h)
+    QuickRejectMode quickReject;    //cheap look for frames with nothing in them, see quickReject.h
+    float quickRejectMargin;        //how far the quick look widens the area limits each way; bigger rejects fewer frames
+    QualitySettings quality;        //what's done with blurred or badly exposed frames, see frameQuality.h
+
+    //Removes "green", "brown" and "gray" as defined in the HSV ranges in RemoveColorsFromImage
+    PipelineSettings () : minArea( MIN_AREA ), maxArea( MAX_AREA ), detectionScale( 1 ), tileThreads( 0 ), quickReject( QUICK_REJECT_OFF ), quickRejectMargin( 4 ) {
+        colors.insert( make_pair( "Green", true ) );
+        colors.insert( make_pair( "Brown", true ) );
+        colors.insert( make_pair( "Gray", true ) );
+    }
+};
+
+//Receives each candidate and each identified target as it's found. Chips are
+//views into the frame, so anything kept past the call has to be cloned.
+class ChipSink {
+public:
+    virtual ~ChipSink () {}
+    virtual void Candidate ( int index, const Mat &chip ) = 0;
+    virtual void Target ( int index, const Mat &chip, const String &label ) = 0;
+};
+
+//Fills in frame.targets, frame.candidate_time, frame.covered_by and frame.quality. image_time is left to the caller,
+//which is the one that knows how long decoding took. Returns the number of candidates. With a
+//DuplicateFilter, a frame it finds covered by an earlier one may skip everything after decode; only
+//frames that get past the quality gate can cover later ones. With a FrameRegistration, detection only
+//runs on what the last frame didn't cover.
+int ProcessFrame ( Mat original, const PipelineSettings &settings, BufferPool *pool, FrameRecord &frame, ChipSink *chips = NULL, DuplicateFilter *duplicates = NULL, FrameRegistration *registration = NULL );
+
+//ProcessFrame for a frame still on disk. With a detectionScale above 1, detection runs on a reduced
+//decode (see CreateMatFromImage) and only the candidates are decoded at full resolution (jpegRegions.h),
+//so frames with few candidates are never decoded in full.
+int ProcessFrameFromFile ( const string &fullPath, const PipelineSettings &settings, BufferPool *pool, FrameRecord &frame, ChipSink *chips = NULL, DuplicateFilter *duplicates = NULL, FrameRegistration *registration = NULL );
+
+//Whether a quick look at the frame at fullPath (see quickReject.h) finds nothing that could be a
+//candidate, so it can skip the rest of the pipeline. Always false with settings.quickReject off.
+bool QuickRejectFrame ( const string &fullPath, const PipelineSettings &settings, QuickRejectStats &stats );
+
+#endif /* defined(__capstone_functions__pipeline__) */
@@ -10,15 +10,92 @@
 
 using namespace tesseract;
 
-Mat CreateMatFromImage ( string fullPathToImage ) {
+Mat CreateMatFromImage ( string fullPathToImage, BufferPool *pool, int scale ) {
     /*
-     Input: string that is an explicit path to an image file
+     Input: string that is an explicit path to an image file, optionally a pool to
+     take the image's buffer from, and optionally a scale to shrink the image by
      
-     Output: a BGR Mat element with the same dimensions as the supplied image file
+     Output: a BGR Mat element with the dimensions of the supplied image file divided by scale
      */
     
-    //Read an image from file
-    Mat originalImage = imread( fullPathToImage );
+    StageScope stage( STAGE_READ_IMAGE );
+    
+    //libjpeg can shrink by 1/2, 1/4 or 1/8 while decoding, which skips most of its work
+#if CV_MAJOR_VERSION >= 3
+    int reducedFlags = ( scale == 2 ) ? IMREAD_REDUCED_COLOR_2 : ( scale == 4 ) ? IMREAD_REDUCED_COLOR_4 : ( scale == 8 ) ? IMREAD_REDUCED_COLOR_8 : 0;
+#else
+    int reducedFlags = 0;
+#endif
+    
+    //Any other scale, or an OpenCV without reduced decoding, decodes in full and shrinks that
+    if ( scale > 1 && reducedFlags == 0 ) {
+        return ReduceImage( CreateMatFromImage( fullPathToImage ), scale, pool );
+    }
+    
+    //The decoder reads straight out of the mapped file
+    MappedFile file;
+    Mat originalImage;
+    
+    if ( file.Open( fullPathToImage ) ) {
+        //Decode into last frame's buffer (shrunk by scale, which the decoder rounds up); if this
+        //image is a different size the decoder allocates its own and the pool takes that one over
+        Size frameSize = ( pool != NULL ) ? pool->GetFrameSize() : Size();
+        if ( reducedFlags != 0 ) {
+            frameSize = Size( ( frameSize.width + scale - 1 ) / scale, ( frameSize.height + scale - 1 ) / scale );
+        }
+        if ( frameSize.area() > 0 ) {
+            originalImage = pool->Acquire( frameSize, CV_8UC3 );
+        }
+        
+        const uchar *before = originalImage.data;
+        imdecode( file.AsMat(), ( reducedFlags != 0 ) ? reducedFlags : CV_LOAD_IMAGE_COLOR, &originalImage );
+        
+        if ( pool != NULL && !originalImage.empty() && originalImage.data != before ) {
+            pool->Adopt( originalImage );
+            if ( reducedFlags == 0 ) {
+                pool->SetFrameSize( originalImage.size() );
+            }
+        }
+    }
+    
+    //Call error function if no image is loaded into the Mat
+    if ( originalImage.empty() == true ) {
+        ErrorDialogue( "Could not find image at location " + fullPathToImage );
+        exit( -1 );
+    }
+    
+    return originalImage;
+}
+
+Mat CreateMatFromImageRegions ( string fullPathToImage, const vector< Rect > &regions, BufferPool *pool ) {
+    /*
+     Input: string that is an explicit path to an image file, the regions of it that are
+     needed, and optionally a pool to take the image's buffer from
+     
+     Output: a BGR Mat element with the same dimensions as the supplied image file, in which
+     only the pixels under regions are sure to be decoded (see jpegRegions.h)
+     */
+    
+    StageScope stage( STAGE_READ_IMAGE );
+    
+    MappedFile file;
+    Mat originalImage;
+    
+    if ( file.Open( fullPathToImage ) ) {
+        //Decode into last frame's buffer, as CreateMatFromImage does
+        if ( pool != NULL && pool->GetFrameSize().area() > 0 ) {
+            originalImage = pool->Acquire( pool->GetFrameSize(), CV_8UC3 );
+        }
+        
+        const uchar *before = originalImage.data;
+        if ( !DecodeJpegRegions( file.AsMat(), regions, originalImage ) ) {
+            originalImage = Mat();
+        }
+        else if ( pool != NULL && originalImage.data != before ) {
+            pool->Adopt( originalImage );
+            pool->SetFrameSize( originalImage.size() );
+        }
+    }
     
     //Call error function if no image is loaded into the Mat
     if ( originalImage.empty() == true ) {
@@ -29,6 +106,33 @@ Mat CreateMatFromImage ( string fullPathToImage ) {
     return originalImage;
 }
 
+Mat ReduceImage ( Mat image, int scale, BufferPool *pool ) {
+    /*
+     Input: a Mat element, the factor to shrink it by, and optionally a pool to take
+     the result's buffer from
+     
+     Output: the Mat element with its width and height divided by scale, each pixel
+     the average of the scale x scale block it covers (the Mat itself if scale is 1)
+     */
+    
+    if ( scale <= 1 ) {
+        return image;
+    }
+    
+    StageScope stage( STAGE_REDUCE );
+    
+    Size reducedSize( image.cols / scale, image.rows / scale );
+    Mat reduced;
+    
+    if ( pool != NULL ) {
+        reduced = pool->Acquire( reducedSize, image.type() );
+    }
+    
+    resize( image, reduced, reducedSize, 0, 0, INTER_AREA );
+    
+    return reduced;
+}
+
 Mat CreateThreshold ( Mat image, double lowH, double lowS, double lowV, double highH, double highS, double highV, bool invert ) {
     /*
      Input: a Mat element, as well as lower and upper bounds for hue, saturation and value
@@ -58,14 +162,19 @@ Mat CreateThreshold ( Mat image, double lowH, double lowS, double lowV, double h
     return hsv;
 }
 
-vector< Mat> FindCandidateTargets ( Mat original, Mat image, float minArea, float maxArea, int color, int *counter, int *x, int *y ) {
+vector< CandidateRegion > FindCandidateRegions ( Mat image, float minArea, float maxArea, int color, int scale, int threads, Point offset ) {
     /*
-     Input: a Mat element containing the original image, a Mat element containing the thresholded
-     original image, a minimum pixel area, and a maximum pixel area
+     Input: a Mat element containing the thresholded original image, a minimum pixel area, and a
+     maximum pixel area. If the thresholded image was made from the original shrunk by scale (see
+     ReduceImage), areas and positions stay in full resolution pixels. If it only covers part of
+     that, offset is where its top left corner is (in the shrunk image's pixels). With more than
+     one thread the blobs are found in bands of rows in parallel (TiledDetectBlobs).
      
-     Output: an array of vectors containing the Mat elements of the cropped candidate targets
+     Output: where each blob is in the original image, and the box to crop around it
      */
     
+    StageScope stage( STAGE_FIND_CANDIDATES );
+    
     //Look for any blobs with a pixel area between minArea and maxArea
     SimpleBlobDetector::Params params;
     params.filterByArea = true;
@@ -73,41 +182,77 @@ vector< Mat> FindCandidateTargets ( Mat original, Mat image, float minArea, floa
     params.filterByConvexity = false;
     params.filterByInertia = false;
     params.filterByColor = true;
-    params.minArea = minArea;
-    params.maxArea = maxArea;
+    params.minArea = minArea / ( scale * scale );
+    params.maxArea = maxArea / ( scale * scale );
     params.blobColor = color;
     
     SimpleBlobDetector blobDetector( params );
     vector< KeyPoint > keyPoints;
-    vector< Mat > candidates;
-    Mat crop;
-    Mat keypts;
-    Rect roi;
-    *counter = 0;
+    vector< CandidateRegion > regions;
     
     //Detect the blobs with the above parameters and store their locations in keyPoints
-    blobDetector.detect( image, keyPoints );
+    if ( threads > 1 ) {
+        TiledDetectBlobs( image, params, threads, keyPoints );
+    }
+    else {
+        blobDetector.detect( image, keyPoints );
+    }
     
     cout << "\n";
     
-    //Determine a bounding box for each blob and crop it out of the original image
+    //Determine a bounding box for each blob
     for ( int i = 0; i < keyPoints.size(); i++ ) {
+        CandidateRegion region;
+        
+        //Blob position and size in the original's pixels
+        Point2f pt = ( keyPoints[i].pt + Point2f( offset ) ) * ( float )scale;
+        float size = keyPoints[i].size * scale;
+        region.center = Point( ( int )pt.x, ( int )pt.y );
         
         //Compute bounding box
-        roi.x = std::max( 0, ( int )( keyPoints[i].pt.x - keyPoints[i].size * 2 ) );
-        roi.y = std::max( 0, ( int )( keyPoints[i].pt.y - keyPoints[i].size * 2 ) );
-        roi.width = ( int )( keyPoints[i].size * 4 );
-        roi.height = ( int )( keyPoints[i].size * 4 );
+        region.box.x = std::max( 0, ( int )( pt.x - size * 2 ) );
+        region.box.y = std::max( 0, ( int )( pt.y - size * 2 ) );
+        region.box.width = ( int )( size * 4 );
+        region.box.height = ( int )( size * 4 );
+        
+        regions.push_back( region );
+    }
+    
+    return regions;
+}
+
+vector< Mat > CropCandidates ( Mat original, const vector< CandidateRegion > &regions, int *counter, int *x, int *y ) {
+    /*
+     Input: a Mat element containing the original image, the regions FindCandidateRegions found in
+     it, and arrays of XY_BUFFER entries to hold the x and y position of each candidate
+     
+     Output: an array of vectors containing the Mat elements of the cropped candidate targets
+     */
+    
+    StageScope stage( STAGE_FIND_CANDIDATES );
+    
+    vector< Mat > candidates;
+    Mat crop;
+    *counter = 0;
+    
+    //Crop each bounding box out of the original image
+    for ( int i = 0; i < regions.size(); i++ ) {
+        
+        //The caller's x and y arrays only have room for XY_BUFFER positions
+        if ( *counter >= XY_BUFFER ) {
+            printf( "More than %d candidates, ignoring the rest\n", XY_BUFFER );
+            break;
+        }
         
         //todo change to middle of target
-        printf( "Candidate target located at (x:%d, y:%d)\n", ( int )keyPoints[i].pt.x, ( int )keyPoints[i].pt.y );
+        printf( "Candidate target located at (x:%d, y:%d)\n", regions[i].center.x, regions[i].center.y );
         
         /*
          Take the bounding box measurements calculated above and remove that section from the original image,
          creating a smaller, cropped image of the candidate target.. then push that onto an array of candidates
          */
         try {
-            crop = original(roi);
+            crop = original( regions[i].box );
         }
         catch ( ... ) {
             printf( "ROI would break the universe, moving on..\n\n" );
@@ -115,8 +260,8 @@ vector< Mat> FindCandidateTargets ( Mat original, Mat image, float minArea, floa
         }
         
         //keep track of the X and Y coordinates of the target
-        x[*counter] = ( int )keyPoints[i].pt.x;
-        y[*counter] = ( int )keyPoints[i].pt.y;
+        x[*counter] = regions[i].center.x;
+        y[*counter] = regions[i].center.y;
         candidates.push_back( crop );
         ( *counter )++;
     }
@@ -127,6 +272,18 @@ vector< Mat> FindCandidateTargets ( Mat original, Mat image, float minArea, floa
     return candidates;
 }
 
+vector< Mat> FindCandidateTargets ( Mat original, Mat image, float minArea, float maxArea, int color, int *counter, int *x, int *y, int scale, int threads ) {
+    /*
+     Input: a Mat element containing the original image, a Mat element containing the thresholded
+     original image, a minimum pixel area, and a maximum pixel area (see FindCandidateRegions for
+     scale and threads)
+     
+     Output: an array of vectors containing the Mat elements of the cropped candidate targets
+     */
+    
+    return CropCandidates( original, FindCandidateRegions( image, minArea, maxArea, color, scale, threads ), counter, x, y );
+}
+
 vector< Mat > CreateClustersFromMat ( Mat image, int clusterCount ) {
     /*
      Input: A Mat element to cluster, number of clusters to create
@@ -134,6 +291,8 @@ vector< Mat > CreateClustersFromMat ( Mat image, int clusterCount ) {
      Output: An array of Mat elements, each containing a single cluster
      */
     
+    StageScope stage( STAGE_CLUSTERS );
+    
     //This variable is kinda BS since we use TERMCRIT_ITER to determine
     //how many attempts will be made
     int attempts = 5;
@@ -166,6 +325,8 @@ String DetermineShape ( Mat image ) {
      Output: a String representing the shape of the target
      */
     
+    StageScope stage( STAGE_SHAPE );
+    
     string shape = "UNKNOWN SHAPE";
     vector< vector < Point > > contours;
     vector< Vec4i > hierarchy;
@@ -220,6 +381,8 @@ char* DetectTargetColor( Mat image, int *b, int *g, int *r ) {
      Output: a pointer to a Char containing the background color of the target
      */
     
+    StageScope stage( STAGE_COLORS );
+    
     Vec3b *pixel = new Vec3b [image.rows * image.cols];
     Vec3b test;
     int max = 0, index = 0, count = 0;
@@ -308,6 +471,8 @@ char* DetectCharacterColor( Mat image, int *b, int *g, int *r ) {
      Output: a pointer to a Char containing the color of the inner target
      */
     
+    StageScope stage( STAGE_COLORS );
+    
     Vec3b *pixel = new Vec3b [image.rows * image.cols];
     Vec3b test;
     int index = 0, count = 0, max = 0;
@@ -456,30 +621,41 @@ void RotateImage( Mat& src, double angle, Mat& dst ) {
     warpAffine( src, dst, r, Size( len, len ), INTER_CUBIC, BORDER_CONSTANT, Scalar( 255, 255, 255 ) ); //the scalar is what does the white background
 }
 
-Mat BinaryImage ( Mat image ) {
+Mat BinaryImage ( Mat image, BufferPool *pool ) {
     /*
-     Input: a Mat element populated with data
+     Input: a Mat element populated with data, and optionally a pool to take the
+     grayscale and binary buffers from
      
      Output: a binary Mat element of the input data
      */
     
-    cvtColor( image, image, CV_BGR2GRAY );
+    StageScope stage( STAGE_BINARY_IMAGE );
     
-    Mat binary( image.size(), image.type() );
+    Mat gray, binary;
+    
+    if ( pool != NULL ) {
+        gray = pool->Acquire( image.size(), CV_8UC1 );
+        binary = pool->Acquire( image.size(), CV_8UC1 );
+    }
+    
+    cvtColor( image, gray, CV_BGR2GRAY );
     
     //Threshold the input Mat element
-    threshold( image, binary, 0, 255, THRESH_BINARY );
+    threshold( gray, binary, 0, 255, THRESH_BINARY );
     
     return binary;
 }
 
-string Identify( Mat src, Mat refineMe ) {
+string Identify( Mat src, Mat refineMe, float minConfidence ) {
     /*
      * Function to identify a capital letter
-     * Input: a blank Mat element and a Mat containing the inner target to be refined into a binary image
+     * Input: a blank Mat element, a Mat containing the inner target to be refined into a binary image,
+     * and the confidence tesseract has to reach for the letter to count
      * Output: string with letter and confidence
      */
     
+    StageScope stage( STAGE_IDENTIFY );
+    
     Vec3b test;
     
     for ( int i = 0; i < refineMe.rows; i++ ) {
@@ -657,7 +833,7 @@ string Identify( Mat src, Mat refineMe ) {
     //the last check in this if statement is kind of cheating, but this
     //function  practically thinks anything that isn't a letter is
     //the letter I..
-    if ( finalConf < 71 || finalOutput == "I" )
+    if ( finalConf < minConfidence || finalOutput == "I" )
         return "BAD";
     
     ostringstream ss;
@@ -666,65 +842,76 @@ string Identify( Mat src, Mat refineMe ) {
     return finalOutput + " " + ss.str();
 }
 
-Mat RemoveColorsFromImage ( Mat image, map < String, bool > colors ) {
+Mat RemoveColorsFromImage ( Mat image, map < String, bool > colors, BufferPool *pool ) {
     /*
-     Input: A Mat element and a map of colors to remove from the Mat
+     Input: A Mat element, a map of colors to remove from the Mat, and optionally a
+     pool to take the working buffers from
      
-     Output: The Mat element minus the specified colors
+     Output: The Mat element minus the specified colors (those pixels set to black)
      */
     
-    Mat finishedProduct, originalThresh, noGreen, noBrown, noGray;
-    int threshSeq = 0;
+    StageScope stage( STAGE_REMOVE_COLORS );
     
-    if ( colors["Green"] == true ) {
-        originalThresh = CreateThreshold( image, 27.5, 0, 0, 80, 255, 255, true );
-        image.copyTo( noGreen, originalThresh );
-        threshSeq = 1;
-    }
+    bool removeGreen = colors["Green"], removeBrown = colors["Brown"], removeGray = colors["Gray"];
     
-    if ( colors["Brown"] == true && colors["Green"] == true && threshSeq == 1 ) {
-        originalThresh = CreateThreshold( image, 15, 0, 0, 25, 255, 255, true );
-        noGreen.copyTo( noBrown, originalThresh );
-        threshSeq = 2;
-    }
-    else if ( colors["Brown"] == true && threshSeq == 0 ) {
-        originalThresh = CreateThreshold( image, 15, 0, 0, 25, 255, 255, true );
-        image.copyTo( noBrown, originalThresh );
-        threshSeq = 1;
+    if ( !removeGreen && !removeBrown && !removeGray ) {
+        return image;
     }
     
-    if ( colors["Gray"] == true && colors["Green"] == true && colors["Brown"] == true && threshSeq == 2 ) {
-        originalThresh = CreateThreshold( image, 0, 0, 51, 180, 25.5, 196.35, true );
-        noBrown.copyTo( noGray, originalThresh );
-        threshSeq = 3;
-    }
-    else if ( colors["Gray"] == true && colors["Green"] == true && colors["Brown"] == false && threshSeq == 1 ) {
-        originalThresh = CreateThreshold( image, 0, 0, 51, 180, 25.5, 196.35, true );
-        noGreen.copyTo( noGray, originalThresh );
-        threshSeq = 2;
-    }
-    else if ( colors["Gray"] == true && colors["Green"] == false && colors["Brown"] == true && threshSeq == 1 ) {
-        originalThresh = CreateThreshold( image, 0, 0, 51, 180, 25.5, 196.35, true );
-        noBrown.copyTo( noGray, originalThresh );
-        threshSeq = 2;
-    }
-    else if ( colors["Gray"] == true && threshSeq == 0 ) {
-        originalThresh = CreateThreshold( image, 0, 0, 51, 180, 25.5, 196.35, true );
-        image.copyTo( noGray, originalThresh );
-        threshSeq = 1;
+    Mat hsv, inColor, removeMask, finishedProduct;
+    
+    if ( pool != NULL ) {
+        hsv = pool->Acquire( image.size(), CV_8UC3 );
+        inColor = pool->Acquire( image.size(), CV_8UC1 );
+        removeMask = pool->Acquire( image.size(), CV_8UC1 );
+        finishedProduct = pool->Acquire( image.size(), image.type() );
     }
     
-    if ( !noGray.empty() ) {
-        return noGray;
+    //Convert to HSV once, then mark every pixel that falls in any of the colors being removed
+    cvtColor( image, hsv, CV_BGR2HSV );
+    
+    //Call error function if no image is loaded into the Mat
+    if ( hsv.empty() == true ) {
+        ErrorDialogue( "Could not convert image to HSV (are you passing this function a BGR image?)" );
+        exit( -1 );
     }
-    else if ( !noBrown.empty() ) {
-        return noBrown;
+    
+    ColorRemovalMask( hsv, colors, removeMask, inColor );
+    
+    //Same result as masking a copy once per color: everything outside the removed colors survives
+    image.copyTo( finishedProduct );
+    finishedProduct.setTo( Scalar::all( 0 ), removeMask );
+    
+    return finishedProduct;
+}
+
+void ColorRemovalMask ( const Mat &hsv, const map < String, bool > &colors, Mat &mask, Mat &scratch ) {
+    /*
+     Input: an HSV Mat element, a map of colors to remove, and a single channel Mat
+     of the same size to work in
+     
+     Output: mask set to 255 wherever a pixel falls in any of the colors being removed,
+     0 everywhere else
+     */
+    
+    map < String, bool >::const_iterator green = colors.find( "Green" ), brown = colors.find( "Brown" ), gray = colors.find( "Gray" );
+    
+    mask.create( hsv.size(), CV_8UC1 );
+    mask.setTo( Scalar::all( 0 ) );
+    
+    if ( green != colors.end() && green->second ) {
+        inRange( hsv, Scalar( 27.5, 0, 0 ), Scalar( 80, 255, 255 ), scratch );
+        bitwise_or( mask, scratch, mask );
     }
-    else if ( !noGreen.empty() ) {
-        return noGreen;
+    
+    if ( brown != colors.end() && brown->second ) {
+        inRange( hsv, Scalar( 15, 0, 0 ), Scalar( 25, 255, 255 ), scratch );
+        bitwise_or( mask, scratch, mask );
     }
-    else {
-        return image;
+    
+    if ( gray != colors.end() && gray->second ) {
+        inRange( hsv, Scalar( 0, 0, 51 ), Scalar( 180, 25.5, 196.35 ), scratch );
+        bitwise_or( mask, scratch, mask );
     }
 }
 
@@ -747,6 +934,8 @@ vector< Mat > GatherResults( const cv::Mat& labels, const cv::Mat& centers, int
      Output: An array of 3 Mat elements each containing a single cluster
      */
     
+    StageScope stage( STAGE_GATHER_RESULTS );
+    
     Vec3b white;
     white.val[0] = 255;
     white.val[1] = 255;
@@ -11,23 +11,39 @@
 
 #include <stdio.h>
 #include "projectHeaders.h"
+#include "bufferPool.h"
+#include "stageProfiler.h"
+#include "tiledDetection.h"
+#include "jpegRegions.h"
+#include "imageIngest.h"
 
 using namespace std;
 using namespace cv;
 
+//A blob FindCandidateRegions found: its position, and the box cropped out around it for classification
+struct CandidateRegion {
+    Point center;
+    Rect box;
+};
+
 //Function headers
-Mat CreateMatFromImage ( string fullPathToImage );
+Mat CreateMatFromImage ( string fullPathToImage, BufferPool *pool = NULL, int scale = 1 );
+Mat CreateMatFromImageRegions ( string fullPathToImage, const vector< Rect > &regions, BufferPool *pool = NULL );
+Mat ReduceImage ( Mat image, int scale, BufferPool *pool = NULL );
 Mat CreateThreshold ( Mat image, double lowH, double lowS, double lowV, double highH, double highS, double highV, bool invert );
-vector< Mat > FindCandidateTargets ( Mat original, Mat image, float minArea, float maxArea, int color, int *counter, int *x, int *y );
+vector< Mat > FindCandidateTargets ( Mat original, Mat image, float minArea, float maxArea, int color, int *counter, int *x, int *y, int scale = 1, int threads = 0 );
+vector< CandidateRegion > FindCandidateRegions ( Mat image, float minArea, float maxArea, int color, int scale = 1, int threads = 0, Point offset = Point() );
+vector< Mat > CropCandidates ( Mat original, const vector< CandidateRegion > &regions, int *counter, int *x, int *y );
 String DetermineShape ( Mat image );
 char* DetectTargetColor( Mat image, int *b, int *g, int *r );
 char* DetectCharacterColor( Mat image, int *b, int *g, int *r );
 char* GetColorName( int red, int green, int blue );
 void RotateImage( Mat& src, double angle, Mat& dst );
-Mat BinaryImage ( Mat image );
-String Identify( Mat src, Mat refineMe );
+Mat BinaryImage ( Mat image, BufferPool *pool = NULL );
+String Identify( Mat src, Mat refineMe, float minConfidence = MIN_CONFIDENCE );
 vector< Mat > CreateClustersFromMat ( Mat image, int clusterCount );
-Mat RemoveColorsFromImage ( Mat image, map <String, bool> colors );
+Mat RemoveColorsFromImage ( Mat image, map <String, bool> colors, BufferPool *pool = NULL );
+void ColorRemovalMask ( const Mat &hsv, const map <String, bool> &colors, Mat &mask, Mat &scratch );
 void ErrorDialogue ( string error );
 vector< Mat > GatherResults(const cv::Mat& labels, const cv::Mat& centers, int height, int width);
 string LowerLetter (String convertMe);
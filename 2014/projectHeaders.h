@@ -37,6 +37,7 @@
 #define BLACK 0
 #define MIN_AREA 1000
 #define MAX_AREA 20000
+#define MIN_CONFIDENCE 71
 
 /*
  Windows users might require the header below
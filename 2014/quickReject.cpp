@@ -0,0 +1,224 @@
+//
+//  quickReject.cpp
+//  capstone_functions
+//
+
+#include "quickReject.h"
+#include "projectFunctions.h"
+#include <chrono>
+#include <string.h>
+
+using namespace std;
+using namespace cv;
+
+//TIFF data in either byte order
+struct TiffReader {
+    const uchar *begin;
+    size_t length;
+    bool bigEndian;
+
+    bool Has ( size_t offset, size_t bytes ) const { return offset <= length && bytes <= length - offset; }
+
+    unsigned U16 ( size_t offset ) const {
+        const uchar *p = begin + offset;
+        return bigEndian ? ( p[0] << 8 | p[1] ) : ( p[1] << 8 | p[0] );
+    }
+
+    unsigned long U32 ( size_t offset ) const {
+        unsigned long high = U16( offset ), low = U16( offset + 2 );
+        return bigEndian ? ( high << 16 | low ) : ( low << 16 | high );
+    }
+};
+
+//Reads an APP1 Exif segment's TIFF data. IFD0 describes the main image and holds its orientation;
+//IFD1, the one after it, gives the thumbnail's offset and length
+static void ReadExif ( const uchar *tiff, size_t length, JpegHeaders &headers ) {
+    if ( length < 8 || !( ( tiff[0] == 'I' && tiff[1] == 'I' ) || ( tiff[0] == 'M' && tiff[1] == 'M' ) ) ) {
+        return;
+    }
+
+    TiffReader reader = { tiff, length, tiff[0] == 'M' };
+    if ( reader.U16( 2 ) != 42 ) {
+        return;
+    }
+
+    size_t ifd0 = reader.U32( 4 );
+    if ( !reader.Has( ifd0, 2 ) ) {
+        return;
+    }
+    unsigned ifd0Entries = reader.U16( ifd0 );
+    for ( unsigned i = 0; i < ifd0Entries && reader.Has( ifd0 + 2 + 12 * i, 12 ); i++ ) {
+        size_t entry = ifd0 + 2 + 12 * i;
+        if ( reader.U16( entry ) == 0x0112 && reader.U16( entry + 2 ) == 3 ) {
+            headers.orientation = ( int )reader.U16( entry + 8 );
+        }
+    }
+
+    size_t ifd1Link = ifd0 + 2 + 12 * ifd0Entries;
+    if ( !reader.Has( ifd1Link, 4 ) ) {
+        return;
+    }
+    size_t ifd1 = reader.U32( ifd1Link );
+    if ( ifd1 == 0 || !reader.Has( ifd1, 2 ) ) {
+        return;
+    }
+
+    size_t offset = 0, bytes = 0;
+    unsigned entries = reader.U16( ifd1 );
+    for ( unsigned i = 0; i < entries && reader.Has( ifd1 + 2 + 12 * i, 12 ); i++ ) {
+        size_t entry = ifd1 + 2 + 12 * i;
+        unsigned tag = reader.U16( entry ), type = reader.U16( entry + 2 );
+        size_t value = ( type == 3 ) ? reader.U16( entry + 8 ) : reader.U32( entry + 8 );
+
+        if ( tag == 0x0201 ) {
+            offset = value;     //JPEGInterchangeFormat
+        }
+        else if ( tag == 0x0202 ) {
+            bytes = value;      //JPEGInterchangeFormatLength
+        }
+    }
+
+    if ( bytes > 2 && reader.Has( offset, bytes ) && tiff[offset] == 0xFF && tiff[offset + 1] == 0xD8 ) {
+        headers.thumbnail = tiff + offset;
+        headers.thumbnailLength = bytes;
+    }
+}
+
+bool ReadJpegHeaders ( const uchar *data, size_t length, JpegHeaders &headers ) {
+    headers = JpegHeaders();
+    if ( length < 4 || data[0] != 0xFF || data[1] != 0xD8 ) {
+        return false;
+    }
+
+    size_t pos = 2;
+    while ( pos + 4 <= length && data[pos] == 0xFF ) {
+        uchar marker = data[pos + 1];
+
+        //Fill bytes and markers without a length
+        if ( marker == 0xFF ) {
+            pos++;
+            continue;
+        }
+        if ( marker == 0x01 || ( marker >= 0xD0 && marker <= 0xD8 ) ) {
+            pos += 2;
+            continue;
+        }
+
+        //Start of scan or end of image: the headers are over
+        if ( marker == 0xDA || marker == 0xD9 ) {
+            break;
+        }
+
+        size_t segment = data[pos + 2] << 8 | data[pos + 3];
+        if ( segment < 2 || pos + 2 + segment > length ) {
+            break;
+        }
+        const uchar *payload = data + pos + 4;
+        size_t payloadLength = segment - 2;
+
+        //Every start of frame marker but DHT (C4), JPG (C8) and DAC (CC)
+        bool startOfFrame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if ( startOfFrame && payloadLength >= 5 ) {
+            headers.size = Size( payload[3] << 8 | payload[4], payload[1] << 8 | payload[2] );
+        }
+        else if ( marker == 0xE1 && payloadLength > 6 && memcmp( payload, "Exif\0\0", 6 ) == 0 ) {
+            ReadExif( payload + 6, payloadLength - 6, headers );
+        }
+
+        pos += 2 + segment;
+    }
+
+    return true;
+}
+
+//Whether the color removed binary image has a white component with an area between minArea and maxArea
+static bool HasPlausibleBlob ( Mat &binary, double minArea, double maxArea ) {
+    for ( int y = 0; y < binary.rows; y++ ) {
+        const uchar *row = binary.ptr( y );
+        for ( int x = 0; x < binary.cols; x++ ) {
+            if ( row[x] != WHITE ) {
+                continue;
+            }
+
+            //Filled components are marked so they're only counted once
+            int area = floodFill( binary, Point( x, y ), Scalar::all( 128 ), 0, Scalar(), Scalar(), 8 );
+            if ( area >= minArea && area <= maxArea ) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static double Seconds ( chrono::steady_clock::time_point start ) {
+    return chrono::duration< double >( chrono::steady_clock::now() - start ).count();
+}
+
+bool QuickLookEmpty ( const Mat &bytes, QuickRejectMode mode, const map< String, bool > &colors, float minArea, float maxArea, float margin, QuickRejectStats &stats ) {
+    StageScope stage( STAGE_QUICK_REJECT );
+
+    auto start = chrono::steady_clock::now();
+    stats.frames++;
+
+    if ( mode == QUICK_REJECT_OFF || bytes.empty() ) {
+        stats.unchecked++;
+        return false;
+    }
+
+    JpegHeaders headers;
+    ReadJpegHeaders( bytes.data, bytes.total(), headers );
+
+    Mat small;
+    if ( mode == QUICK_REJECT_THUMBNAIL && headers.thumbnail != NULL && headers.size.area() > 0 ) {
+        Mat thumbnail( 1, ( int )headers.thumbnailLength, CV_8UC1, ( void * )headers.thumbnail );
+        imdecode( thumbnail, CV_LOAD_IMAGE_COLOR, &small );
+        if ( !small.empty() ) {
+            stats.thumbnails++;
+        }
+    }
+
+#if CV_MAJOR_VERSION >= 3
+    if ( small.empty() ) {
+        imdecode( bytes, IMREAD_REDUCED_COLOR_8, &small );
+        if ( !small.empty() ) {
+            stats.reduced++;
+        }
+    }
+#endif
+
+    //Without either there's nothing cheap to look at, so the frame gets the full pipeline
+    if ( small.empty() ) {
+        stats.unchecked++;
+        stats.seconds += Seconds( start );
+        return false;
+    }
+
+    //Thumbnails keep the whole frame, letterboxed if their shape differs, so the larger ratio is the real one
+    double scale = 8;
+    if ( headers.size.area() > 0 ) {
+        scale = max( headers.size.width / ( double )small.cols, headers.size.height / ( double )small.rows );
+    }
+    double pixelArea = scale * scale;
+    margin = max( 1.0f, margin );
+
+    //The same mask CandidateMask makes: gray above 0, and not one of the removed colors
+    Mat hsv, mask, scratch, gray, binary;
+    cvtColor( small, hsv, CV_BGR2HSV );
+    ColorRemovalMask( hsv, colors, mask, scratch );
+    cvtColor( small, gray, CV_BGR2GRAY );
+    threshold( gray, binary, 0, 255, THRESH_BINARY );
+    binary.setTo( Scalar::all( 0 ), mask );
+
+    bool empty = !HasPlausibleBlob( binary, minArea / ( margin * pixelArea ), maxArea * margin / pixelArea );
+    if ( empty ) {
+        stats.rejected++;
+    }
+
+    stats.seconds += Seconds( start );
+    return empty;
+}
+
+void PrintQuickRejectStats ( const QuickRejectStats &stats, FILE *out ) {
+    fprintf( out, "Quick reject: %ld frames, %ld rejected, %ld from thumbnails, %ld from 1/8 decodes, %ld unchecked, %.2lfs looking\n",
+             stats.frames, stats.rejected, stats.thumbnails, stats.reduced, stats.unchecked, stats.seconds );
+}
@@ -0,0 +1,64 @@
+//
+//  quickReject.h
+//  capstone_functions
+//
+//  A cheap first look at each frame, so frames with nothing in them can skip
+//  the full pipeline. Most frames over grass hold no targets, but each one
+//  still pays for a full decode, the HSV passes and blob detection.
+//
+//  The look runs the same color removal and threshold as the real detection,
+//  but on a tiny copy of the frame. That copy is the thumbnail the camera
+//  embeds in the EXIF header, or, without one, a 1/8 scale decode (libjpeg
+//  skips most of the IDCT for it). Then it checks for any component whose
+//  size scaled back up could pass the candidate area limits. The limits are
+//  widened by a margin each way, since a target only a few pixels across in
+//  the small copy blends into the grass around it. A bigger margin rejects
+//  fewer frames and misses fewer targets.
+//
+
+#ifndef __capstone_functions__quickReject__
+#define __capstone_functions__quickReject__
+
+#include <stdio.h>
+#include <map>
+#include <opencv2/opencv.hpp>
+
+//What the quick look is taken from
+enum QuickRejectMode {
+    QUICK_REJECT_OFF,           //every frame goes through the full pipeline
+    QUICK_REJECT_THUMBNAIL,     //the EXIF thumbnail, or a 1/8 decode for frames without one
+    QUICK_REJECT_REDUCED        //always a 1/8 decode (OpenCV 3 or later)
+};
+
+struct QuickRejectStats {
+    long frames;            //frames looked at
+    long rejected;          //frames with nothing plausible in them
+    long thumbnails;        //looks taken from the EXIF thumbnail
+    long reduced;           //looks taken from a 1/8 decode
+    long unchecked;         //frames there was no cheap way to look at, passed on
+    double seconds;
+
+    QuickRejectStats () : frames( 0 ), rejected( 0 ), thumbnails( 0 ), reduced( 0 ), unchecked( 0 ), seconds( 0 ) {}
+};
+
+//What the markers ahead of a JPEG's image data say about it
+struct JpegHeaders {
+    cv::Size size;                  //the full image's size, from its frame header
+    const uchar *thumbnail;         //the EXIF thumbnail JPEG, pointing into the file, or NULL
+    size_t thumbnailLength;
+    int orientation;                //the EXIF Orientation tag, 1 (stored upright) without one
+
+    JpegHeaders () : thumbnail( NULL ), thumbnailLength( 0 ), orientation( 1 ) {}
+};
+
+//Reads the markers of the JPEG in data up to its image data. False if it isn't a JPEG.
+bool ReadJpegHeaders ( const uchar *data, size_t length, JpegHeaders &headers );
+
+//Whether a quick look at the encoded frame in bytes (a 1 x N CV_8UC1 Mat, see MappedFile::AsMat)
+//finds nothing that could be a candidate after removing colors. minArea and maxArea are the
+//candidate limits in full resolution pixels, widened by margin (1 or more) each way.
+bool QuickLookEmpty ( const cv::Mat &bytes, QuickRejectMode mode, const std::map< cv::String, bool > &colors, float minArea, float maxArea, float margin, QuickRejectStats &stats );
+
+void PrintQuickRejectStats ( const QuickRejectStats &stats, FILE *out = stdout );
+
+#endif /* defined(__capstone_functions__quickReject__) */
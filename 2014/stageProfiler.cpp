@@ -0,0 +1,400 @@
+//
+//  stageProfiler.cpp
+//  capstone_functions
+//
+
+#include "stageProfiler.h"
+#include "targetRecord.h"
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <sys/resource.h>
+
+using namespace std;
+
+static const char *stageNames[STAGE_COUNT] = {
+    "Other",
+    "CreateMatFromImage",
+    "ReduceImage",
+    "QuickReject",
+    "DuplicateCheck",
+    "RegisterFrames",
+    "FrameQuality",
+    "RemoveColorsFromImage",
+    "TiledCandidateMask",
+    "BinaryImage",
+    "FindCandidateTargets",
+    "CreateClustersFromMat",
+    "GatherResults",
+    "Identify",
+    "DetermineShape",
+    "DetectColors",
+    "DebugImages",
+    "EmitResults"
+};
+
+//The memory counters have to work before main() (and before any dynamic
+//initialization) because operator new does, so they're plain atomics that
+//start out zeroed along with the rest of static storage
+static thread_local PipelineStage currentStage = STAGE_OTHER;
+static atomic< long > stageAllocations[STAGE_COUNT];
+static atomic< size_t > stageBytes[STAGE_COUNT];
+static atomic< size_t > stagePeak[STAGE_COUNT];
+static atomic< size_t > liveBytes;
+static atomic< size_t > peakBytes;
+static atomic< bool > memoryTraced;
+
+static LatencyHistogram stageTiming[STAGE_COUNT];
+
+static atomic< bool > countersEnabled;
+static bool countersRequested = false;
+static bool counterAvailable[COUNTER_COUNT];
+static string countersError;
+static atomic< long > stageCounterScopes[STAGE_COUNT];
+static atomic< uint64_t > stageCounterValues[STAGE_COUNT][COUNTER_COUNT];
+
+//Each thread's own counter group, opened the first time it's needed
+static PerfCounters *ThreadCounters () {
+    static thread_local PerfCounters counters;
+    static thread_local bool tried = false;
+
+    if ( !tried ) {
+        tried = true;
+        counters.Open();
+    }
+    return counters.IsOpen() ? &counters : NULL;
+}
+
+template < typename T >
+static void RaiseTo ( atomic< T > &peak, T value ) {
+    T seen = peak.load( memory_order_relaxed );
+    while ( value > seen && !peak.compare_exchange_weak( seen, value, memory_order_relaxed ) ) {
+    }
+}
+
+const char *StageName ( PipelineStage stage ) {
+    return ( stage >= 0 && stage < STAGE_COUNT ) ? stageNames[stage] : "?";
+}
+
+//Bucket i covers [2^(i/8) * (1 + (i%8)/8), the next bucket's start) nanoseconds
+static int BucketFor ( uint64_t nanos ) {
+    if ( nanos < 1 ) {
+        return 0;
+    }
+
+    int exponent;
+    double mantissa = frexp( ( double )nanos, &exponent );     //nanos = mantissa * 2^exponent, mantissa in [0.5, 1)
+    int bucket = ( exponent - 1 ) * LatencyHistogram::SUB_BUCKETS + ( int )( ( mantissa * 2 - 1 ) * LatencyHistogram::SUB_BUCKETS );
+    return min( bucket, LatencyHistogram::BUCKETS - 1 );
+}
+
+static double BucketMiddle ( int bucket ) {
+    int octave = bucket / LatencyHistogram::SUB_BUCKETS, sub = bucket % LatencyHistogram::SUB_BUCKETS;
+    return ldexp( 1.0 + ( sub + 0.5 ) / LatencyHistogram::SUB_BUCKETS, octave );
+}
+
+void LatencyHistogram::Add ( double seconds ) {
+    uint64_t nanos = ( seconds > 0 ) ? ( uint64_t )( seconds * 1e9 ) : 0;
+    buckets[BucketFor( nanos )].fetch_add( 1, memory_order_relaxed );
+    count.fetch_add( 1, memory_order_relaxed );
+    totalNanos.fetch_add( nanos, memory_order_relaxed );
+    RaiseTo( maxNanos, nanos );
+}
+
+void LatencyHistogram::Reset () {
+    for ( int i = 0; i < BUCKETS; i++ ) {
+        buckets[i].store( 0 );
+    }
+    count.store( 0 );
+    totalNanos.store( 0 );
+    maxNanos.store( 0 );
+}
+
+long LatencyHistogram::Count () const {
+    return count.load();
+}
+
+double LatencyHistogram::TotalSeconds () const {
+    return totalNanos.load() / 1e9;
+}
+
+double LatencyHistogram::MaxSeconds () const {
+    return maxNanos.load() / 1e9;
+}
+
+double LatencyHistogram::MeanSeconds () const {
+    long n = Count();
+    return ( n > 0 ) ? TotalSeconds() / n : 0;
+}
+
+double LatencyHistogram::Percentile ( double p ) const {
+    long n = Count();
+    if ( n == 0 ) {
+        return 0;
+    }
+
+    long rank = max( 1L, ( long )ceil( p / 100.0 * n ) );
+    long seen = 0;
+    for ( int i = 0; i < BUCKETS; i++ ) {
+        seen += buckets[i].load( memory_order_relaxed );
+        if ( seen >= rank ) {
+            return min( BucketMiddle( i ), ( double )maxNanos.load() ) / 1e9;
+        }
+    }
+    return MaxSeconds();
+}
+
+StageScope::StageScope ( PipelineStage newStage ) : stage( newStage ), previous( currentStage ), start( chrono::steady_clock::now() ), counting( false ) {
+    currentStage = stage;
+
+    //Read last so the counters see as little of the bookkeeping as possible
+    if ( countersEnabled.load( memory_order_relaxed ) ) {
+        PerfCounters *counters = ThreadCounters();
+        counting = ( counters != NULL ) && counters->Read( startCounts );
+    }
+}
+
+StageScope::~StageScope () {
+    uint64_t endCounts[COUNTER_COUNT];
+    if ( counting && ThreadCounters()->Read( endCounts ) ) {
+        stageCounterScopes[stage].fetch_add( 1, memory_order_relaxed );
+        for ( int i = 0; i < COUNTER_COUNT; i++ ) {
+            //Scaling for multiplexing can make a reading come out a little behind the last one
+            if ( endCounts[i] > startCounts[i] ) {
+                stageCounterValues[stage][i].fetch_add( endCounts[i] - startCounts[i], memory_order_relaxed );
+            }
+        }
+    }
+
+    stageTiming[stage].Add( chrono::duration< double >( chrono::steady_clock::now() - start ).count() );
+    currentStage = previous;
+}
+
+PipelineStage CurrentStage () {
+    return currentStage;
+}
+
+const LatencyHistogram &GetStageTiming ( PipelineStage stage ) {
+    return stageTiming[stage];
+}
+
+StageMemoryStats GetStageMemory ( PipelineStage stage ) {
+    StageMemoryStats stats;
+    stats.allocations = stageAllocations[stage].load();
+    stats.bytesAllocated = stageBytes[stage].load();
+    stats.peakBytes = stagePeak[stage].load();
+    return stats;
+}
+
+StageCounterStats GetStageCounters ( PipelineStage stage ) {
+    StageCounterStats stats;
+    stats.scopes = stageCounterScopes[stage].load();
+    for ( int i = 0; i < COUNTER_COUNT; i++ ) {
+        stats.values[i] = stageCounterValues[stage][i].load();
+    }
+    return stats;
+}
+
+bool EnableStageCounters () {
+    countersRequested = true;
+
+    //Probe on this thread; the group it opens is the one this thread keeps using
+    PerfCounters probe;
+    if ( !probe.Open() || ThreadCounters() == NULL ) {
+        countersError = probe.Error();
+        return false;
+    }
+
+    for ( int i = 0; i < COUNTER_COUNT; i++ ) {
+        counterAvailable[i] = probe.Has( ( HardwareCounter )i );
+    }
+    countersError = probe.Error();
+    countersEnabled.store( true );
+    return true;
+}
+
+bool StageCountersEnabled () {
+    return countersEnabled.load();
+}
+
+void ResetStageStats () {
+    size_t live = liveBytes.load();
+    for ( int i = 0; i < STAGE_COUNT; i++ ) {
+        stageTiming[i].Reset();
+        stageAllocations[i].store( 0 );
+        stageBytes[i].store( 0 );
+        stagePeak[i].store( 0 );
+        stageCounterScopes[i].store( 0 );
+        for ( int j = 0; j < COUNTER_COUNT; j++ ) {
+            stageCounterValues[i][j].store( 0 );
+        }
+    }
+    peakBytes.store( live );
+}
+
+bool MemoryTraceEnabled () {
+    return memoryTraced.load();
+}
+
+size_t GetLiveHeapBytes () {
+    return liveBytes.load();
+}
+
+size_t GetPeakHeapBytes () {
+    return peakBytes.load();
+}
+
+void EnableMemoryTrace () {
+    memoryTraced.store( true );
+}
+
+void TraceAllocation ( size_t bytes ) {
+    PipelineStage stage = currentStage;
+    size_t live = liveBytes.fetch_add( bytes, memory_order_relaxed ) + bytes;
+
+    stageAllocations[stage].fetch_add( 1, memory_order_relaxed );
+    stageBytes[stage].fetch_add( bytes, memory_order_relaxed );
+    RaiseTo( stagePeak[stage], live );
+    RaiseTo( peakBytes, live );
+}
+
+void TraceFree ( size_t bytes ) {
+    liveBytes.fetch_sub( bytes, memory_order_relaxed );
+}
+
+//Peak resident set size of the whole process in MB
+static double PeakRSS () {
+    struct rusage usage;
+    if ( getrusage( RUSAGE_SELF, &usage ) != 0 ) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / ( 1024.0 * 1024.0 );     //bytes
+#else
+    return usage.ru_maxrss / 1024.0;                  //kilobytes
+#endif
+}
+
+//Prints value / divisor, or a dash for a counter this machine doesn't have
+static void PrintCounter ( FILE *out, HardwareCounter counter, double value, double divisor, const char *format ) {
+    if ( !counterAvailable[counter] || divisor <= 0 ) {
+        fprintf( out, " %9s", "-" );
+    }
+    else {
+        fprintf( out, format, value / divisor );
+    }
+}
+
+static void PrintCounterReport ( FILE *out ) {
+    if ( !countersRequested ) {
+        return;
+    }
+    if ( !StageCountersEnabled() ) {
+        fprintf( out, "Hardware counters unavailable: %s\n", countersError.c_str() );
+        return;
+    }
+
+    //Misses per thousand instructions: high cache MPKI with low IPC means the stage is waiting on memory
+    fprintf( out, "%-22s %8s %9s %9s %9s %9s %9s\n", "Stage", "scopes", "Mcycles", "Minstr", "IPC", "cacheMPKI", "branchMPKI" );
+    for ( int i = 0; i < STAGE_COUNT; i++ ) {
+        StageCounterStats stats = GetStageCounters( ( PipelineStage )i );
+        if ( stats.scopes == 0 ) {
+            continue;
+        }
+
+        double cycles = ( double )stats.values[COUNTER_CYCLES], instructions = ( double )stats.values[COUNTER_INSTRUCTIONS];
+        double kiloInstructions = counterAvailable[COUNTER_INSTRUCTIONS] ? instructions / 1e3 : 0;
+
+        fprintf( out, "%-22s %8ld", StageName( ( PipelineStage )i ), stats.scopes );
+        PrintCounter( out, COUNTER_CYCLES, cycles, 1e6, " %9.2lf" );
+        PrintCounter( out, COUNTER_INSTRUCTIONS, instructions, 1e6, " %9.2lf" );
+        PrintCounter( out, COUNTER_INSTRUCTIONS, instructions, counterAvailable[COUNTER_CYCLES] ? cycles : 0, " %9.2lf" );
+        PrintCounter( out, COUNTER_CACHE_MISSES, ( double )stats.values[COUNTER_CACHE_MISSES], kiloInstructions, " %9.2lf" );
+        PrintCounter( out, COUNTER_BRANCH_MISSES, ( double )stats.values[COUNTER_BRANCH_MISSES], kiloInstructions, " %9.2lf" );
+        fprintf( out, "\n" );
+    }
+
+    if ( !countersError.empty() ) {
+        fprintf( out, "Some counters unavailable: %s\n", countersError.c_str() );
+    }
+}
+
+void PrintStageReport ( FILE *out ) {
+    const double MB = 1024.0 * 1024.0;
+    bool traced = MemoryTraceEnabled();
+
+    fprintf( out, "%-22s %8s %10s %9s %9s %9s %9s", "Stage", "calls", "total s", "mean ms", "p50 ms", "p99 ms", "max ms" );
+    if ( traced ) {
+        fprintf( out, " %10s %10s %9s", "allocs", "alloc MB", "peak MB" );
+    }
+    fprintf( out, "\n" );
+
+    for ( int i = 0; i < STAGE_COUNT; i++ ) {
+        PipelineStage stage = ( PipelineStage )i;
+        const LatencyHistogram &timing = GetStageTiming( stage );
+        StageMemoryStats memory = GetStageMemory( stage );
+
+        if ( timing.Count() == 0 && memory.allocations == 0 ) {
+            continue;
+        }
+
+        fprintf( out, "%-22s %8ld %10.3lf %9.3lf %9.3lf %9.3lf %9.3lf", StageName( stage ), timing.Count(), timing.TotalSeconds(),
+                 timing.MeanSeconds() * 1e3, timing.Percentile( 50 ) * 1e3, timing.Percentile( 99 ) * 1e3, timing.MaxSeconds() * 1e3 );
+        if ( traced ) {
+            fprintf( out, " %10ld %10.1lf %9.1lf", memory.allocations, memory.bytesAllocated / MB, memory.peakBytes / MB );
+        }
+        fprintf( out, "\n" );
+    }
+
+    if ( traced ) {
+        fprintf( out, "Heap peak %.1lfMB, %.1lfMB still allocated, peak RSS %.1lfMB\n", GetPeakHeapBytes() / MB, GetLiveHeapBytes() / MB, PeakRSS() );
+    }
+    else {
+        fprintf( out, "Peak RSS %.1lfMB (build memoryTrace.cpp with -DTRACE_MEMORY for allocations per stage)\n", PeakRSS() );
+    }
+
+    PrintCounterReport( out );
+}
+
+vector< StageTimingRecord > GetStageTimings () {
+    vector< StageTimingRecord > records;
+
+    for ( int i = 0; i < STAGE_COUNT; i++ ) {
+        const LatencyHistogram &timing = GetStageTiming( ( PipelineStage )i );
+        if ( timing.Count() == 0 ) {
+            continue;
+        }
+
+        StageTimingRecord record;
+        record.stage = StageName( ( PipelineStage )i );
+        record.calls = ( int )timing.Count();
+        record.total = timing.TotalSeconds();
+        record.mean = timing.MeanSeconds();
+        record.p50 = timing.Percentile( 50 );
+        record.p90 = timing.Percentile( 90 );
+        record.p99 = timing.Percentile( 99 );
+        record.max = timing.MaxSeconds();
+        records.push_back( record );
+    }
+    return records;
+}
+
+bool WriteStageTimings ( const char *path ) {
+    string text;
+    WriteRecordValue( text, GetStageTimings() );
+
+    FILE *file = fopen( path, "wb" );
+    if ( file == NULL ) {
+        return false;
+    }
+    bool ok = fwrite( text.data(), 1, text.size(), file ) == text.size();
+    return ( fclose( file ) == 0 ) && ok;
+}
+
+bool ReadStageTimings ( const char *path, vector< StageTimingRecord > &records ) {
+    json::Reader reader;
+    if ( !reader.Open( path ) ) {
+        return false;
+    }
+    return ReadRecordValue( reader, reader.Next(), records );
+}
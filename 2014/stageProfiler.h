@@ -0,0 +1,183 @@
+//
+//  stageProfiler.h
+//  capstone_functions
+//
+//  Per-stage accounting for the detection pipeline. Each pipeline function
+//  opens a StageScope, and the wall time it spends lands in that stage's
+//  latency histogram. When memoryTrace.cpp is built in with -DTRACE_MEMORY,
+//  every heap and cv::Mat allocation made meanwhile is charged to the stage
+//  as well. Scopes nest: allocations go to the innermost open stage, time
+//  to every open one. The current stage is tracked per thread, so work on
+//  other threads (the image writer, say) counts as STAGE_OTHER.
+//
+//  EnableStageCounters() also has each scope read the CPU's hardware
+//  counters (perfCounters.h). That tells memory-bound stages (many cache
+//  misses per instruction, low IPC) apart from compute-bound ones.
+//
+
+#ifndef __capstone_functions__stageProfiler__
+#define __capstone_functions__stageProfiler__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "perfCounters.h"
+
+enum PipelineStage {
+    STAGE_OTHER,            //anything outside a StageScope
+    STAGE_READ_IMAGE,       //CreateMatFromImage
+    STAGE_REDUCE,           //ReduceImage
+    STAGE_QUICK_REJECT,     //QuickLookEmpty
+    STAGE_DUPLICATES,       //DuplicateFilter::Check
+    STAGE_REGISTER,         //FrameRegistration::Register
+    STAGE_QUALITY,          //MeasureFrameQuality
+    STAGE_REMOVE_COLORS,    //RemoveColorsFromImage
+    STAGE_CANDIDATE_MASK,   //TiledCandidateMask (color removal and BinaryImage in one pass)
+    STAGE_BINARY_IMAGE,     //BinaryImage
+    STAGE_FIND_CANDIDATES,  //FindCandidateTargets
+    STAGE_CLUSTERS,         //CreateClustersFromMat
+    STAGE_GATHER_RESULTS,   //GatherResults (inside CreateClustersFromMat)
+    STAGE_IDENTIFY,         //Identify (OCR)
+    STAGE_SHAPE,            //DetermineShape
+    STAGE_COLORS,           //DetectTargetColor, DetectCharacterColor
+    STAGE_DEBUG_IMAGES,     //handing candidate and target chips to the image writer
+    STAGE_EMIT,             //building and serializing the results
+    STAGE_COUNT
+};
+
+const char *StageName ( PipelineStage stage );
+
+//Log-scale histogram of durations, 8 buckets per power of two, so percentiles
+//come back within about 6%. Safe to add to from several threads at once.
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKETS = 8;
+    static const int BUCKETS = 44 * SUB_BUCKETS;   //1ns to a few hours
+
+    LatencyHistogram () { Reset(); }
+
+    void Add ( double seconds );
+    void Reset ();
+
+    long Count () const;
+    double TotalSeconds () const;
+    double MaxSeconds () const;
+    double MeanSeconds () const;
+
+    //p in [0, 100]; 0 if nothing has been added
+    double Percentile ( double p ) const;
+
+private:
+    LatencyHistogram ( const LatencyHistogram & );
+    LatencyHistogram &operator= ( const LatencyHistogram & );
+
+    std::atomic< long > buckets[BUCKETS];
+    std::atomic< long > count;
+    std::atomic< uint64_t > totalNanos;
+    std::atomic< uint64_t > maxNanos;
+};
+
+//Charges the current thread's time and allocations to stage until it goes out of scope
+class StageScope {
+public:
+    explicit StageScope ( PipelineStage stage );
+    ~StageScope ();
+
+private:
+    StageScope ( const StageScope & );
+    StageScope &operator= ( const StageScope & );
+
+    PipelineStage stage;
+    PipelineStage previous;
+    std::chrono::steady_clock::time_point start;
+    bool counting;
+    uint64_t startCounts[COUNTER_COUNT];
+};
+
+struct StageMemoryStats {
+    long allocations;
+    size_t bytesAllocated;
+    size_t peakBytes;       //highest the whole heap reached on an allocation made in this stage
+
+    StageMemoryStats () : allocations( 0 ), bytesAllocated( 0 ), peakBytes( 0 ) {}
+};
+
+struct StageCounterStats {
+    long scopes;                        //scopes that got a reading
+    uint64_t values[COUNTER_COUNT];     //summed over those scopes
+
+    StageCounterStats () : scopes( 0 ) {
+        for ( int i = 0; i < COUNTER_COUNT; i++ ) {
+            values[i] = 0;
+        }
+    }
+};
+
+PipelineStage CurrentStage ();
+const LatencyHistogram &GetStageTiming ( PipelineStage stage );
+StageMemoryStats GetStageMemory ( PipelineStage stage );
+StageCounterStats GetStageCounters ( PipelineStage stage );
+
+//Turns on hardware counters for every StageScope from here on, on every thread.
+//Each thread opens its own counters the first time it enters a stage. Returns
+//false and leaves them off if this machine can't count; the report says why.
+bool EnableStageCounters ();
+bool StageCountersEnabled ();
+
+//Zeroes every stage's timing, counters and allocation totals (for benchmarks that
+//run the pipeline several times over). The heap high-water mark restarts from what's
+//live now. Don't call it while another thread is inside a StageScope.
+void ResetStageStats ();
+
+//Whether the allocation hooks are built in; without them the memory stats stay zero
+bool MemoryTraceEnabled ();
+size_t GetLiveHeapBytes ();
+size_t GetPeakHeapBytes ();
+
+//Per-stage table of calls, latency percentiles and (when traced) allocations, plus peak RSS,
+//followed by the hardware counter table when they're enabled
+void PrintStageReport ( FILE *out = stdout );
+
+//One stage's timing as written to the stage stats file, in seconds
+struct StageTimingRecord {
+    std::string stage;
+    int calls;
+    double total;
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+
+    StageTimingRecord () : calls( 0 ), total( 0 ), mean( 0 ), p50( 0 ), p90( 0 ), p99( 0 ), max( 0 ) {}
+
+    template < typename Visitor >
+    static void Describe ( Visitor &v ) {
+        v.Field( "stage", &StageTimingRecord::stage );
+        v.Field( "calls", &StageTimingRecord::calls );
+        v.Field( "total", &StageTimingRecord::total );
+        v.Field( "mean", &StageTimingRecord::mean );
+        v.Field( "p50", &StageTimingRecord::p50 );
+        v.Field( "p90", &StageTimingRecord::p90 );
+        v.Field( "p99", &StageTimingRecord::p99 );
+        v.Field( "max", &StageTimingRecord::max );
+    }
+};
+
+//Every stage that ran, in pipeline order
+std::vector< StageTimingRecord > GetStageTimings ();
+
+//Writes GetStageTimings() to path as a JSON array (see tools/evaluate.cpp), or reads it back
+bool WriteStageTimings ( const char *path );
+bool ReadStageTimings ( const char *path, std::vector< StageTimingRecord > &records );
+
+//Called from the allocation hooks in memoryTrace.cpp. They run inside operator new,
+//so they must never allocate themselves.
+void EnableMemoryTrace ();
+void TraceAllocation ( size_t bytes );
+void TraceFree ( size_t bytes );
+
+#endif /* defined(__capstone_functions__stageProfiler__) */
@@ -0,0 +1,258 @@
+//
+//  syntheticTargets.cpp
+//  capstone_functions
+//
+
+#include "syntheticTargets.h"
+#include <stdio.h>
+#include <sstream>
+#include <sys/stat.h>
+
+using namespace cv;
+using namespace std;
+
+struct PaletteColor {
+    const char *name;
+    Scalar bgr;
+};
+
+//Entries from GetColorName's table, so the pipeline can name them back exactly
+static const PaletteColor shapeColors[] = {
+    { "white", Scalar( 255, 255, 255 ) },
+    { "red", Scalar( 51, 51, 255 ) },
+    { "blue", Scalar( 255, 0, 0 ) },
+    { "purple", Scalar( 255, 102, 178 ) },
+    { "magenta", Scalar( 255, 51, 255 ) },
+    { "pink", Scalar( 204, 153, 255 ) },
+    { "cyan", Scalar( 255, 255, 51 ) }
+};
+static const int SHAPE_COLOR_COUNT = sizeof( shapeColors ) / sizeof( *shapeColors );
+static const PaletteColor black = { "black", Scalar( 0, 0, 0 ) };
+
+enum ShapeKind { SHAPE_TRIANGLE, SHAPE_SQUARE, SHAPE_RECTANGLE, SHAPE_PENTAGON, SHAPE_HEXAGON, SHAPE_CIRCLE, SHAPE_KIND_COUNT };
+
+//What DetermineShape calls each of them
+static const char *shapeNames[SHAPE_KIND_COUNT] = { "triangle", "4-gon", "4-gon", "pentagon", "hexagon", "circle" };
+
+//Smooth random field in [0, 255] at size, built from octaves of bilinearly upsampled noise.
+//cell is the spacing of the coarsest octave in pixels.
+static Mat NoiseField ( RNG &rng, Size size, int cell, int octaves ) {
+    Mat field = Mat::zeros( size, CV_32F ), coarse, fine;
+    float weight = 1, total = 0;
+
+    for ( int i = 0; i < octaves; i++ ) {
+        coarse.create( size.height / cell + 2, size.width / cell + 2, CV_32F );
+        rng.fill( coarse, RNG::UNIFORM, Scalar::all( 0 ), Scalar::all( 1 ) );
+        resize( coarse, fine, size, 0, 0, INTER_LINEAR );
+        scaleAdd( fine, weight, field, field );
+
+        total += weight;
+        weight *= 0.5f;
+        cell = max( 1, cell / 2 );
+    }
+
+    Mat result;
+    field.convertTo( result, CV_8U, 255.0 / total );
+    return result;
+}
+
+/*
+ Terrain is grass (HSV hue 35-70) with patches of dirt (hue 17-23) and a few
+ roads (gray, saturation under 8), all inside RemoveColorsFromImage's ranges
+ with some margin. Where grass meets dirt, the saturation fades to gray.
+ Blurring (ours, or JPEG's chroma subsampling) then only mixes the two into
+ more gray. It never produces the hues between the brown and green ranges,
+ which would survive color removal as long thin false candidates.
+ */
+static Mat RenderTerrain ( RNG &rng, Size size ) {
+    //The fields are made at a quarter of the size and upsampled, which is plenty for terrain
+    Size small( max( 1, size.width / 4 ), max( 1, size.height / 4 ) );
+    Mat moisture, hue, saturation, value;
+    resize( NoiseField( rng, small, 200, 3 ), moisture, size, 0, 0, INTER_LINEAR );
+    resize( NoiseField( rng, small, 50, 3 ), hue, size, 0, 0, INTER_LINEAR );
+    resize( NoiseField( rng, small, 30, 4 ), saturation, size, 0, 0, INTER_LINEAR );
+    resize( NoiseField( rng, small, 10, 4 ), value, size, 0, 0, INTER_LINEAR );
+
+    Mat hsv( size, CV_8UC3 );
+    for ( int i = 0; i < size.height; i++ ) {
+        const uchar *m = moisture.ptr< uchar >( i ), *h = hue.ptr< uchar >( i ), *s = saturation.ptr< uchar >( i ), *v = value.ptr< uchar >( i );
+        Vec3b *out = hsv.ptr< Vec3b >( i );
+
+        for ( int j = 0; j < size.width; j++ ) {
+            bool grass = m[j] > 110;
+            int edge = min( 24, abs( m[j] - 110 ) );
+            out[j][0] = ( uchar )( grass ? 35 + h[j] * 35 / 255 : 17 + h[j] * 6 / 255 );
+            out[j][1] = ( uchar )( ( 90 + s[j] * 110 / 255 ) * edge / 24 );
+            out[j][2] = ( uchar )( 70 + v[j] * 110 / 255 );
+        }
+    }
+
+    //Roads: straight-ish gray strips corner to corner
+    int roads = rng.uniform( 0, 3 );
+    for ( int i = 0; i < roads; i++ ) {
+        Point from( rng.uniform( 0, size.width ), 0 ), to( rng.uniform( 0, size.width ), size.height - 1 );
+        Point middle( ( from.x + to.x ) / 2 + rng.uniform( -size.width / 8, size.width / 8 + 1 ), size.height / 2 );
+        Scalar gray( 0, rng.uniform( 0, 8 ), rng.uniform( 100, 170 ) );
+        int thickness = rng.uniform( 20, 60 );
+        line( hsv, from, middle, gray, thickness, 8 );
+        line( hsv, middle, to, gray, thickness, 8 );
+    }
+
+    Mat terrain;
+    cvtColor( hsv, terrain, CV_HSV2BGR );
+
+    //Sensor grain
+    Mat grain( size, CV_16SC3 );
+    rng.fill( grain, RNG::NORMAL, Scalar::all( 0 ), Scalar::all( 4 ) );
+    add( terrain, grain, terrain, noArray(), CV_8U );
+    return terrain;
+}
+
+static void DrawTarget ( Mat &frame, const TruthTarget &target, ShapeKind kind, const Scalar &shapeColor, const Scalar &letterColor ) {
+    //Room for the shape at any rotation
+    int side = target.size * 2;
+    Point2f center( side / 2.0f, side / 2.0f );
+    float radius = target.size / 2.0f;
+
+    //The canvas is the shape's color all over, so rotating it only blends the letter
+    //into the shape; the mask says what ends up in the frame
+    Mat canvas( side, side, CV_8UC3, shapeColor ), mask = Mat::zeros( side, side, CV_8UC1 );
+
+    if ( kind == SHAPE_CIRCLE ) {
+        circle( mask, center, ( int )radius, Scalar( 255 ), -1, 8 );
+    }
+    else {
+        vector< Point > corners;
+        if ( kind == SHAPE_SQUARE || kind == SHAPE_RECTANGLE ) {
+            float halfHeight = ( kind == SHAPE_SQUARE ) ? radius : radius * 0.65f;
+            corners.push_back( Point( cvRound( center.x - radius ), cvRound( center.y - halfHeight ) ) );
+            corners.push_back( Point( cvRound( center.x + radius ), cvRound( center.y - halfHeight ) ) );
+            corners.push_back( Point( cvRound( center.x + radius ), cvRound( center.y + halfHeight ) ) );
+            corners.push_back( Point( cvRound( center.x - radius ), cvRound( center.y + halfHeight ) ) );
+        }
+        else {
+            int sides = ( kind == SHAPE_TRIANGLE ) ? 3 : ( kind == SHAPE_PENTAGON ) ? 5 : 6;
+            float r = ( kind == SHAPE_TRIANGLE ) ? radius * 1.15f : radius;
+            for ( int i = 0; i < sides; i++ ) {
+                double angle = -CV_PI / 2 + 2 * CV_PI * i / sides;
+                corners.push_back( Point( cvRound( center.x + r * cos( angle ) ), cvRound( center.y + r * sin( angle ) ) ) );
+            }
+        }
+
+        const Point *points = &corners[0];
+        int count = ( int )corners.size();
+        fillPoly( mask, &points, &count, 1, Scalar( 255 ), 8 );
+    }
+
+    //Letter about half the shape's height, centered
+    string letter( 1, ( char )toupper( target.letter[0] ) );
+    int thickness = max( 2, target.size / 10 ), baseline = 0;
+    double scale = 1.0;
+    Size textSize = getTextSize( letter, FONT_HERSHEY_SIMPLEX, scale, thickness, &baseline );
+    scale = target.size * 0.5 / textSize.height;
+    textSize = getTextSize( letter, FONT_HERSHEY_SIMPLEX, scale, thickness, &baseline );
+    putText( canvas, letter, Point( ( int )( center.x - textSize.width / 2 ), ( int )( center.y + textSize.height / 2 ) ), FONT_HERSHEY_SIMPLEX, scale, letterColor, thickness, CV_AA );
+
+    Mat rotation = getRotationMatrix2D( center, target.rotation, 1.0 ), rotatedCanvas, rotatedMask;
+    warpAffine( canvas, rotatedCanvas, rotation, canvas.size(), INTER_LINEAR, BORDER_REPLICATE );
+    warpAffine( mask, rotatedMask, rotation, mask.size(), INTER_NEAREST );
+
+    Mat where = frame( Rect( target.x - side / 2, target.y - side / 2, side, side ) );
+    rotatedCanvas.copyTo( where, rotatedMask );
+}
+
+Mat RenderSyntheticFrame ( const SyntheticSettings &settings, int index, TruthFrame &truth ) {
+    //Each frame gets its own generator, so frames can be rendered in any order
+    RNG rng( settings.seed * 1000003ULL + ( unsigned long long )index + 1 );
+    Size size( settings.width, settings.height );
+    Mat frame = RenderTerrain( rng, size );
+
+    ostringstream name;
+    name << index << ".jpg";
+    truth.file = name.str();
+    truth.targets.clear();
+
+    int count = rng.uniform( settings.minTargets, settings.maxTargets + 1 );
+    for ( int i = 0; i < count; i++ ) {
+        TruthTarget target;
+        target.size = rng.uniform( settings.minSize, settings.maxSize + 1 );
+        target.rotation = rng.uniform( 0.0, 360.0 );
+
+        //Keep the whole canvas inside the frame and well clear of the other targets
+        int half = target.size;
+        bool placed = false;
+        for ( int attempt = 0; attempt < 50 && !placed; attempt++ ) {
+            target.x = rng.uniform( half + 1, max( half + 2, settings.width - half - 1 ) );
+            target.y = rng.uniform( half + 1, max( half + 2, settings.height - half - 1 ) );
+            placed = true;
+            for ( size_t j = 0; j < truth.targets.size(); j++ ) {
+                int dx = target.x - truth.targets[j].x, dy = target.y - truth.targets[j].y;
+                int apart = 2 * ( target.size + truth.targets[j].size );
+                if ( dx * dx + dy * dy < apart * apart ) {
+                    placed = false;
+                }
+            }
+        }
+        if ( !placed || target.x + half > settings.width || target.y + half > settings.height ) {
+            continue;
+        }
+
+        ShapeKind kind = ( ShapeKind )rng.uniform( 0, SHAPE_KIND_COUNT );
+        int shapeColor = rng.uniform( 0, SHAPE_COLOR_COUNT );
+
+        //Any other palette color, or black, for the letter
+        int letterColor = rng.uniform( 0, SHAPE_COLOR_COUNT );
+        const PaletteColor &letterPaint = ( letterColor == shapeColor ) ? black : shapeColors[letterColor];
+
+        target.letter = string( 1, ( char )( 'a' + rng.uniform( 0, 26 ) ) );
+        target.shape = shapeNames[kind];
+        target.shape_color = shapeColors[shapeColor].name;
+        target.letter_color = letterPaint.name;
+
+        DrawTarget( frame, target, kind, shapeColors[shapeColor].bgr, letterPaint.bgr );
+        truth.targets.push_back( target );
+    }
+
+    //A little lens softness
+    GaussianBlur( frame, frame, Size( 3, 3 ), 0 );
+    return frame;
+}
+
+bool GenerateSyntheticCorpus ( const string &dir, int count, const SyntheticSettings &settings ) {
+    mkdir( dir.c_str(), 0755 );
+
+    vector< int > params;
+    params.push_back( CV_IMWRITE_JPEG_QUALITY );
+    params.push_back( settings.jpegQuality );
+
+    vector< TruthFrame > frames( count );
+    for ( int i = 0; i < count; i++ ) {
+        Mat frame = RenderSyntheticFrame( settings, i, frames[i] );
+        if ( !imwrite( dir + "/" + frames[i].file, frame, params ) ) {
+            printf( "Could not write %s/%s\n", dir.c_str(), frames[i].file.c_str() );
+            return false;
+        }
+    }
+
+    return WriteTruth( dir + "/truth.json", frames );
+}
+
+bool WriteTruth ( const string &path, const vector< TruthFrame > &frames ) {
+    string text;
+    WriteRecordValue( text, frames );
+
+    FILE *file = fopen( path.c_str(), "wb" );
+    if ( file == NULL ) {
+        return false;
+    }
+    bool ok = fwrite( text.data(), 1, text.size(), file ) == text.size();
+    return ( fclose( file ) == 0 ) && ok;
+}
+
+bool ReadTruth ( const string &path, vector< TruthFrame > &frames ) {
+    json::Reader reader;
+    if ( !reader.Open( path ) ) {
+        return false;
+    }
+    return ReadRecordValue( reader, reader.Next(), frames );
+}
@@ -0,0 +1,94 @@
+//
+//  syntheticTargets.h
+//  capstone_functions
+//
+//  Renders test frames like the ones the plane takes: terrain textured in
+//  the colors RemoveColorsFromImage takes out (grass, dirt, roads), with
+//  targets scattered over it. Each target is a shape with a letter, at a
+//  random rotation, scale and position. A frame depends only on the settings
+//  and its index, so a corpus is the same wherever it's rendered (given the
+//  same OpenCV). Every frame comes with a record of what was placed where,
+//  written as a truth.json sidecar.
+//
+//  The names in the truth match what the pipeline writes to output.json.
+//  Shapes use DetermineShape's names ("4-gon" for squares and rectangles),
+//  colors use GetColorName's palette, and letters are lower case like
+//  LowerLetter makes them. Target colors avoid green, brown, yellow, orange
+//  and gray, since RemoveColorsFromImage would erase a target in those along
+//  with the terrain.
+//
+
+#ifndef __capstone_functions__syntheticTargets__
+#define __capstone_functions__syntheticTargets__
+
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "targetRecord.h"
+
+struct SyntheticSettings {
+    int width;                  //frame size in pixels
+    int height;
+    int minTargets;             //targets per frame, picked uniformly in [minTargets, maxTargets]
+    int maxTargets;
+    int minSize;                //target width in pixels
+    int maxSize;
+    int jpegQuality;
+    unsigned long long seed;    //frames with the same seed and index come out the same
+
+    //12MP frames, with target sizes chosen to land inside MIN_AREA..MAX_AREA once detected
+    SyntheticSettings () : width( 4000 ), height( 3000 ), minTargets( 0 ), maxTargets( 4 ), minSize( 60 ), maxSize( 130 ), jpegQuality( 90 ), seed( 2014 ) {}
+};
+
+//One target placed in a frame. x and y are its center, like TargetRecord's.
+struct TruthTarget {
+    std::string letter;
+    std::string letter_color;
+    std::string shape;
+    std::string shape_color;
+    int x;
+    int y;
+    int size;                   //width of the shape before rotation, in pixels
+    double rotation;            //degrees counterclockwise
+
+    TruthTarget () : x( 0 ), y( 0 ), size( 0 ), rotation( 0 ) {}
+
+    template < typename Visitor >
+    static void Describe ( Visitor &v ) {
+        v.Field( "letter", &TruthTarget::letter );
+        v.Field( "letter_color", &TruthTarget::letter_color );
+        v.Field( "shape", &TruthTarget::shape );
+        v.Field( "shape_color", &TruthTarget::shape_color );
+        v.Field( "x", &TruthTarget::x );
+        v.Field( "y", &TruthTarget::y );
+        v.Field( "size", &TruthTarget::size );
+        v.Field( "rotation", &TruthTarget::rotation );
+    }
+};
+
+struct TruthFrame {
+    std::string file;           //image file name, relative to the corpus directory
+    std::vector< TruthTarget > targets;
+
+    template < typename Visitor >
+    static void Describe ( Visitor &v ) {
+        v.Field( "file", &TruthFrame::file );
+        v.Field( "targets", &TruthFrame::targets );
+    }
+};
+
+//Renders frame number index, filling in truth with what was placed in it
+cv::Mat RenderSyntheticFrame ( const SyntheticSettings &settings, int index, TruthFrame &truth );
+
+/*
+ Renders frames 0..count-1 into dir as 0.jpg, 1.jpg, ... (the naming main()
+ expects) and writes dir/truth.json listing every frame's targets. Returns
+ false if anything couldn't be written.
+ */
+bool GenerateSyntheticCorpus ( const std::string &dir, int count, const SyntheticSettings &settings );
+
+//truth.json is a JSON array of TruthFrames, one per image, in frame order
+bool WriteTruth ( const std::string &path, const std::vector< TruthFrame > &frames );
+bool ReadTruth ( const std::string &path, std::vector< TruthFrame > &frames );
+
+#endif /* defined(__capstone_functions__syntheticTargets__) */
@@ -0,0 +1,98 @@
+//
+//  targetRecord.cpp
+//  capstone_functions
+//
+
+#include "targetRecord.h"
+
+MissionWriter::MissionWriter ( OutputFormat outputFormat ) : format( outputFormat ), first( true ) {
+    if ( format == CBOR_OUTPUT ) {
+        json::WriteCBORIndefiniteArrayHeader( text );
+    }
+    else {
+        text = "[";
+    }
+}
+
+void MissionWriter::AddFrame ( const FrameRecord &frame ) {
+    if ( format == CBOR_OUTPUT ) {
+        WriteRecordCBOR( text, frame );
+        return;
+    }
+
+    if ( !first ) {
+        text += ',';
+    }
+    first = false;
+    WriteRecord( text, frame );
+}
+
+const std::string &MissionWriter::Finish ( double runtime ) {
+    if ( format == CBOR_OUTPUT ) {
+        json::WriteCBORMapHeader( text, 1 );
+        json::WriteCBORString( text, "runtime" );
+        json::WriteCBORDouble( text, runtime );
+        json::WriteCBORBreak( text );
+        return text;
+    }
+
+    if ( !first ) {
+        text += ',';
+    }
+    first = false;
+    text += "{\"runtime\":";
+    json::WriteDouble( text, runtime );
+    text += "}]";
+    return text;
+}
+
+bool ReadMission ( const char *data, size_t length, std::vector< FrameRecord > &frames, double *runtime ) {
+    json::Reader reader( data, length );
+    std::string key;
+
+    frames.clear();
+    if ( reader.Next() != json::StartArrayEvent ) {
+        return false;
+    }
+
+    for ( json::ReaderEvent e = reader.Next(); e != json::EndArrayEvent; e = reader.Next() ) {
+        if ( e != json::StartObjectEvent ) {
+            return false;
+        }
+
+        //Every element is read as a frame; the runtime object is recognized by its key
+        FrameRecord frame;
+        bool isRuntime = false;
+
+        for ( e = reader.Next(); e != json::EndObjectEvent; e = reader.Next() ) {
+            if ( e != json::KeyEvent ) {
+                return false;
+            }
+            key = reader.GetString();
+
+            bool matched = false;
+            if ( key == "runtime" ) {
+                double value = 0;
+                if ( !ReadRecordValue( reader, reader.Next(), value ) ) {
+                    return false;
+                }
+                if ( runtime != NULL ) {
+                    *runtime = value;
+                }
+                isRuntime = true;
+            }
+            else if ( !ReadRecordField( reader, key, frame, &matched ) ) {
+                return false;
+            }
+            else if ( !matched && !reader.Skip() ) {
+                return false;
+            }
+        }
+
+        if ( !isRuntime ) {
+            frames.push_back( std::move( frame ) );
+        }
+    }
+
+    return reader.Next() == json::EndOfDocumentEvent;
+}
@@ -0,0 +1,318 @@
+//
+//  targetRecord.h
+//  capstone_functions
+//
+//  Typed records for the results file main() writes. Each record lists its
+//  fields once, in Describe(), and that one descriptor drives both writing
+//  the record straight into an output buffer and reading it back with a
+//  json::Reader, so no json::Value tree is built on either path.
+//
+
+#ifndef __capstone_functions__targetRecord__
+#define __capstone_functions__targetRecord__
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include "json.h"
+
+//One identified target, in the order the fields appear in output.json
+struct TargetRecord {
+    std::string letter;
+    std::string letter_color;
+    std::string shape;
+    std::string shape_color;
+    int x;
+    int y;
+    std::string target_time;
+
+    TargetRecord () : x( 0 ), y( 0 ) {}
+
+    template < typename Visitor >
+    static void Describe ( Visitor &v ) {
+        v.Field( "letter", &TargetRecord::letter );
+        v.Field( "letter_color", &TargetRecord::letter_color );
+        v.Field( "shape", &TargetRecord::shape );
+        v.Field( "shape_color", &TargetRecord::shape_color );
+        v.Field( "x", &TargetRecord::x );
+        v.Field( "y", &TargetRecord::y );
+        v.Field( "target_time", &TargetRecord::target_time );
+    }
+};
+
+//One processed frame: its timings and every target found in it
+struct FrameRecord {
+    std::string candidate_time;
+    std::string image_time;
+    std::vector< TargetRecord > targets;
+    int covered_by;                         //number of the earlier frame in the run this one nearly duplicates, or -1
+    double quality;                         //0 to 1 (see frameQuality.h), or -1 if the frame was skipped before it was scored
+
+    FrameRecord () : covered_by( -1 ), quality( -1 ) {}
+
+    template < typename Visitor >
+    static void Describe ( Visitor &v ) {
+        v.Field( "candidate_time", &FrameRecord::candidate_time );
+        v.Field( "image_time", &FrameRecord::image_time );
+        v.Field( "targets", &FrameRecord::targets );
+        v.Field( "covered_by", &FrameRecord::covered_by );
+        v.Field( "quality", &FrameRecord::quality );
+    }
+};
+
+/*
+ Writing: every field type gets a WriteRecordValue overload, records
+ (anything with a Describe) fall through to the template
+ */
+inline void WriteRecordValue ( std::string &out, const std::string &value ) { json::WriteString( out, value ); }
+inline void WriteRecordValue ( std::string &out, int value ) { json::WriteInt( out, value ); }
+inline void WriteRecordValue ( std::string &out, double value ) { json::WriteDouble( out, value ); }
+
+template < typename Record >
+void WriteRecordValue ( std::string &out, const Record &record );
+
+template < typename T >
+void WriteRecordValue ( std::string &out, const std::vector< T > &values ) {
+    out += '[';
+    for ( size_t i = 0; i < values.size(); i++ ) {
+        if ( i != 0 ) {
+            out += ',';
+        }
+        WriteRecordValue( out, values[i] );
+    }
+    out += ']';
+}
+
+template < typename Record >
+struct RecordWriter {
+    std::string &out;
+    const Record &record;
+    bool first;
+
+    RecordWriter ( std::string &o, const Record &r ) : out( o ), record( r ), first( true ) {}
+
+    //Field names are plain ASCII, so they're copied in without going through the escaper
+    template < typename T >
+    void Field ( const char *name, T Record::*member ) {
+        if ( !first ) {
+            out += ',';
+        }
+        first = false;
+        out += '"';
+        out += name;
+        out += "\":";
+        WriteRecordValue( out, record.*member );
+    }
+};
+
+template < typename Record >
+void WriteRecordValue ( std::string &out, const Record &record ) {
+    RecordWriter< Record > writer( out, record );
+    out += '{';
+    Record::Describe( writer );
+    out += '}';
+}
+
+//Appends record to out as a JSON object, exactly as json::Serialize would have written it
+template < typename Record >
+void WriteRecord ( std::string &out, const Record &record ) {
+    WriteRecordValue( out, record );
+}
+
+/*
+ The same again for CBOR output. Maps are written with a definite length,
+ so records are counted first.
+ */
+inline void WriteRecordCBORValue ( std::string &out, const std::string &value ) { json::WriteCBORString( out, value ); }
+inline void WriteRecordCBORValue ( std::string &out, int value ) { json::WriteCBORInt( out, value ); }
+inline void WriteRecordCBORValue ( std::string &out, double value ) { json::WriteCBORDouble( out, value ); }
+
+template < typename Record >
+void WriteRecordCBORValue ( std::string &out, const Record &record );
+
+template < typename T >
+void WriteRecordCBORValue ( std::string &out, const std::vector< T > &values ) {
+    json::WriteCBORArrayHeader( out, values.size() );
+    for ( size_t i = 0; i < values.size(); i++ ) {
+        WriteRecordCBORValue( out, values[i] );
+    }
+}
+
+struct RecordFieldCounter {
+    size_t count;
+
+    RecordFieldCounter () : count( 0 ) {}
+
+    template < typename Member >
+    void Field ( const char *, Member ) { count++; }
+};
+
+template < typename Record >
+struct RecordCBORWriter {
+    std::string &out;
+    const Record &record;
+
+    RecordCBORWriter ( std::string &o, const Record &r ) : out( o ), record( r ) {}
+
+    template < typename T >
+    void Field ( const char *name, T Record::*member ) {
+        json::WriteCBORString( out, name, strlen( name ) );
+        WriteRecordCBORValue( out, record.*member );
+    }
+};
+
+template < typename Record >
+void WriteRecordCBORValue ( std::string &out, const Record &record ) {
+    RecordFieldCounter counter;
+    Record::Describe( counter );
+    json::WriteCBORMapHeader( out, counter.count );
+
+    RecordCBORWriter< Record > writer( out, record );
+    Record::Describe( writer );
+}
+
+//Appends record to out as a CBOR map, exactly as json::EncodeCBOR would have written it
+template < typename Record >
+void WriteRecordCBOR ( std::string &out, const Record &record ) {
+    WriteRecordCBORValue( out, record );
+}
+
+/*
+ Reading: each overload is handed the event that starts the value and
+ returns false if it isn't the type the field expects
+ */
+inline bool ReadRecordValue ( json::Reader &reader, json::ReaderEvent e, std::string &value ) {
+    if ( e != json::StringEvent ) {
+        return false;
+    }
+    value = reader.GetString();
+    return true;
+}
+
+inline bool ReadRecordValue ( json::Reader &reader, json::ReaderEvent e, int &value ) {
+    if ( e != json::NumberEvent || !reader.IsInt() ) {
+        return false;
+    }
+    value = reader.GetInt();
+    return true;
+}
+
+inline bool ReadRecordValue ( json::Reader &reader, json::ReaderEvent e, double &value ) {
+    if ( e != json::NumberEvent ) {
+        return false;
+    }
+    value = reader.GetDouble();
+    return true;
+}
+
+template < typename Record >
+bool ReadRecordValue ( json::Reader &reader, json::ReaderEvent e, Record &record );
+
+template < typename T >
+bool ReadRecordValue ( json::Reader &reader, json::ReaderEvent e, std::vector< T > &values ) {
+    if ( e != json::StartArrayEvent ) {
+        return false;
+    }
+    values.clear();
+    for ( e = reader.Next(); e != json::EndArrayEvent; e = reader.Next() ) {
+        values.push_back( T() );
+        if ( !ReadRecordValue( reader, e, values.back() ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template < typename Record >
+struct RecordFieldReader {
+    json::Reader &reader;
+    Record &record;
+    const std::string &key;
+    bool matched;
+    bool ok;
+
+    RecordFieldReader ( json::Reader &rd, Record &r, const std::string &k ) : reader( rd ), record( r ), key( k ), matched( false ), ok( true ) {}
+
+    template < typename T >
+    void Field ( const char *name, T Record::*member ) {
+        if ( !matched && key == name ) {
+            matched = true;
+            ok = ReadRecordValue( reader, reader.Next(), record.*member );
+        }
+    }
+};
+
+//Reads the value of the member named key into the matching field of record. Sets *matched to false
+//(and reads nothing) if the record has no such field. Returns false on a type mismatch or bad JSON.
+template < typename Record >
+bool ReadRecordField ( json::Reader &reader, const std::string &key, Record &record, bool *matched ) {
+    RecordFieldReader< Record > fieldReader( reader, record, key );
+    Record::Describe( fieldReader );
+    *matched = fieldReader.matched;
+    return fieldReader.ok;
+}
+
+template < typename Record >
+bool ReadRecordValue ( json::Reader &reader, json::ReaderEvent e, Record &record ) {
+    if ( e != json::StartObjectEvent ) {
+        return false;
+    }
+
+    //Members may come in any order; ones the record doesn't know about are skipped
+    std::string key;
+    for ( e = reader.Next(); e != json::EndObjectEvent; e = reader.Next() ) {
+        if ( e != json::KeyEvent ) {
+            return false;
+        }
+        key = reader.GetString();
+
+        bool matched = false;
+        if ( !ReadRecordField( reader, key, record, &matched ) ) {
+            return false;
+        }
+        if ( !matched && !reader.Skip() ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Reads the next value from reader into record. Returns false if it isn't an object of the right shape.
+template < typename Record >
+bool ReadRecord ( json::Reader &reader, Record &record ) {
+    return ReadRecordValue( reader, reader.Next(), record );
+}
+
+/*
+ output.json is an array of FrameRecords closed off by a {"runtime":...}
+ object. These write and read that whole document. In CBOR the array is
+ written with an indefinite length, so frames can be streamed out as they
+ finish; tools/cborConvert.cpp turns it back into the JSON document.
+ */
+enum OutputFormat {
+    JSON_OUTPUT,
+    CBOR_OUTPUT
+};
+
+class MissionWriter {
+public:
+    MissionWriter ( OutputFormat outputFormat = JSON_OUTPUT );
+
+    //Appends frame to the document being built
+    void AddFrame ( const FrameRecord &frame );
+
+    //Closes the document with the runtime object and returns its text (or bytes, for CBOR)
+    const std::string &Finish ( double runtime );
+
+    const std::string &GetText () const { return text; }
+    OutputFormat GetFormat () const { return format; }
+
+private:
+    OutputFormat format;
+    std::string text;
+    bool first;
+};
+
+bool ReadMission ( const char *data, size_t length, std::vector< FrameRecord > &frames, double *runtime );
+
+#endif /* defined(__capstone_functions__targetRecord__) */
@@ -0,0 +1,233 @@
+//
+//  tiledDetection.cpp
+//  capstone_functions
+//
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include "tiledDetection.h"
+#include "projectFunctions.h"
+
+using namespace std;
+using namespace cv;
+
+//What a component is flood filled with while it's being measured; binary images only hold 0 and 255
+static const uchar FILLED = 128;
+
+//Runs body( item, worker ) for every item in 0..count-1 on up to threads threads, the calling
+//thread being worker 0. Each worker takes the next item as it finishes one.
+static void ParallelFor ( int count, int threads, const function< void ( int, int ) > &body ) {
+    atomic< int > next( 0 );
+    auto work = [&] ( int worker ) {
+        for ( int item = next.fetch_add( 1 ); item < count; item = next.fetch_add( 1 ) ) {
+            body( item, worker );
+        }
+    };
+
+    vector< thread > workers;
+    for ( int t = 1; t < min( threads, count ); t++ ) {
+        workers.push_back( thread( work, t ) );
+    }
+    work( 0 );
+    for ( size_t i = 0; i < workers.size(); i++ ) {
+        workers[i].join();
+    }
+}
+
+Mat TiledCandidateMask ( Mat image, const map< String, bool > &colors, BufferPool *pool, int threads ) {
+    StageScope stage( STAGE_CANDIDATE_MASK );
+
+    threads = max( 1, threads );
+
+    //Per pixel: 3 bytes of image, 3 of HSV, then gray, the removal mask and inRange's scratch
+    int bandRows = max( 1, ( int )( TILE_BYTES / ( image.cols * 9 ) ) );
+    int bands = ( image.rows + bandRows - 1 ) / bandRows;
+    Size bandSize( image.cols, bandRows );
+
+    //The pool isn't thread safe, so every worker's buffers are taken from it up front
+    Mat binary;
+    vector< Mat > hsv( threads ), gray( threads ), mask( threads ), scratch( threads );
+    if ( pool != NULL ) {
+        binary = pool->Acquire( image.size(), CV_8UC1 );
+        for ( int t = 0; t < threads; t++ ) {
+            hsv[t] = pool->Acquire( bandSize, CV_8UC3 );
+            gray[t] = pool->Acquire( bandSize, CV_8UC1 );
+            mask[t] = pool->Acquire( bandSize, CV_8UC1 );
+            scratch[t] = pool->Acquire( bandSize, CV_8UC1 );
+        }
+    }
+    binary.create( image.size(), CV_8UC1 );
+
+    ParallelFor( bands, threads, [&] ( int band, int worker ) {
+        int start = band * bandRows, end = min( image.rows, start + bandRows );
+
+        hsv[worker].create( bandSize, CV_8UC3 );
+        gray[worker].create( bandSize, CV_8UC1 );
+        mask[worker].create( bandSize, CV_8UC1 );
+        scratch[worker].create( bandSize, CV_8UC1 );
+
+        Mat rows = image.rowRange( start, end ), out = binary.rowRange( start, end );
+        Mat bandHsv = hsv[worker].rowRange( 0, end - start ), bandGray = gray[worker].rowRange( 0, end - start );
+        Mat bandMask = mask[worker].rowRange( 0, end - start ), bandScratch = scratch[worker].rowRange( 0, end - start );
+
+        //RemoveColorsFromImage blacks out the removed colors and BinaryImage keeps whatever isn't
+        //black in gray, so: gray above 0, and not one of the removed colors
+        cvtColor( rows, bandHsv, CV_BGR2HSV );
+        ColorRemovalMask( bandHsv, colors, bandMask, bandScratch );
+        cvtColor( rows, bandGray, CV_BGR2GRAY );
+        threshold( bandGray, out, 0, 255, THRESH_BINARY );
+        out.setTo( Scalar::all( 0 ), bandMask );
+    } );
+
+    return binary;
+}
+
+struct BlobBand {
+    int start;                          //rows whose blobs belong to this band
+    int end;
+    int top;                            //rows the band looks at, overlap included
+    int bottom;
+    vector< KeyPoint > found;           //whole blobs, in frame coordinates
+    vector< Point > cut;                //centers of blobs cut off by the band's edge, in frame coordinates
+};
+
+//Whether a component with this bounding box runs into an edge of the rows top..bottom that isn't the frame's
+static bool IsCut ( const Rect &extent, int top, int bottom, int frameRows ) {
+    return ( extent.y <= top && top > 0 ) || ( extent.y + extent.height >= bottom && bottom < frameRows );
+}
+
+//Finds band's blobs in its rows plus overlap above and below
+static void DetectBand ( const Mat &binary, const SimpleBlobDetector::Params &params, BlobBand &band ) {
+    int top = band.top, bottom = band.bottom;
+    Mat rows = binary.rowRange( top, bottom );
+
+    SimpleBlobDetector detector( params );
+    vector< KeyPoint > keyPoints;
+    detector.detect( rows, keyPoints );
+
+    //Each blob's component is filled with its own value, so a second blob on the same component
+    //(the detector reports holes too) finds it already measured
+    Mat filled;
+    vector< pair< uchar, Rect > > components;
+
+    for ( size_t i = 0; i < keyPoints.size(); i++ ) {
+        Point center( cvRound( keyPoints[i].pt.x ), cvRound( keyPoints[i].pt.y ) );
+        if ( center.y + top < band.start || center.y + top >= band.end ) {
+            continue;
+        }
+
+        if ( filled.empty() ) {
+            filled = rows.clone();
+        }
+
+        Rect extent;
+        uchar value = filled.at< uchar >( center );
+        if ( value == 0 || value == 255 ) {
+            uchar fill = ( uchar )( 1 + components.size() % 254 );
+            floodFill( filled, center, Scalar::all( fill ), &extent, Scalar(), Scalar(), 8 );
+            components.push_back( make_pair( fill, extent ) );
+        }
+        else {
+            for ( size_t c = 0; c < components.size(); c++ ) {
+                if ( components[c].first == value && components[c].second.contains( center ) ) {
+                    extent = components[c].second;
+                }
+            }
+        }
+
+        if ( IsCut( Rect( extent.x, extent.y + top, extent.width, extent.height ), top, bottom, binary.rows ) ) {
+            band.cut.push_back( Point( center.x, center.y + top ) );
+        }
+        else {
+            keyPoints[i].pt.y += top;
+            band.found.push_back( keyPoints[i] );
+        }
+    }
+}
+
+//Grows a band of rows around seed until its component fits inside, returning the component's
+//bounding box in binary. rows holds the band with the component filled with FILLED.
+static Rect WholeComponent ( const Mat &binary, Point seed, int reach, Mat &rows, int &top ) {
+    for ( ;; reach *= 2 ) {
+        top = max( 0, seed.y - reach );
+        int bottom = min( binary.rows, seed.y + reach + 1 );
+        rows = binary.rowRange( top, bottom ).clone();
+
+        Rect extent;
+        floodFill( rows, Point( seed.x, seed.y - top ), Scalar::all( FILLED ), &extent, Scalar(), Scalar(), 8 );
+
+        extent.y += top;
+        if ( !IsCut( extent, top, bottom, binary.rows ) ) {
+            return extent;
+        }
+    }
+}
+
+void TiledDetectBlobs ( Mat binary, const SimpleBlobDetector::Params &params, int threads, vector< KeyPoint > &keyPoints ) {
+    keyPoints.clear();
+
+    int bandCount = min( max( 1, threads ), binary.rows );
+    if ( bandCount == 1 ) {
+        SimpleBlobDetector detector( params );
+        detector.detect( binary, keyPoints );
+        return;
+    }
+
+    //A square blob at the largest area allowed fits in the overlap, so only bigger or longer ones get cut
+    double largest = params.filterByArea ? params.maxArea : ( double )binary.total();
+    int overlap = min( binary.rows, ( int )ceil( sqrt( largest ) ) );
+
+    vector< BlobBand > bands( bandCount );
+    for ( int b = 0; b < bandCount; b++ ) {
+        bands[b].start = ( int )( ( long )binary.rows * b / bandCount );
+        bands[b].end = ( int )( ( long )binary.rows * ( b + 1 ) / bandCount );
+        bands[b].top = max( 0, bands[b].start - overlap );
+        bands[b].bottom = min( binary.rows, bands[b].end + overlap );
+    }
+
+    ParallelFor( bandCount, bandCount, [&] ( int band, int ) {
+        DetectBand( binary, params, bands[band] );
+    } );
+
+    //Cut blobs are rare, so they're finished here: the whole component is measured and the detector
+    //run again over just its box, keeping the blobs that land on it. A component cut in two bands
+    //is only done once, and a blob whose own band saw all of its component was found there already.
+    vector< Rect > done;
+    SimpleBlobDetector detector( params );
+
+    for ( size_t b = 0; b < bands.size(); b++ ) {
+        keyPoints.insert( keyPoints.end(), bands[b].found.begin(), bands[b].found.end() );
+
+        for ( size_t i = 0; i < bands[b].cut.size(); i++ ) {
+            Mat rows;
+            int top = 0;
+            Rect extent = WholeComponent( binary, bands[b].cut[i], 2 * overlap + 1, rows, top );
+            if ( find( done.begin(), done.end(), extent ) != done.end() ) {
+                continue;
+            }
+            done.push_back( extent );
+
+            Rect roi = Rect( extent.x - 1, extent.y - 1, extent.width + 2, extent.height + 2 ) & Rect( 0, 0, binary.cols, binary.rows );
+            vector< KeyPoint > whole;
+            detector.detect( binary( roi ), whole );
+
+            for ( size_t k = 0; k < whole.size(); k++ ) {
+                Point center( cvRound( whole[k].pt.x ) + roi.x, cvRound( whole[k].pt.y ) + roi.y );
+                bool foundByOwner = false;
+                for ( size_t o = 0; o < bands.size(); o++ ) {
+                    if ( center.y >= bands[o].start && center.y < bands[o].end ) {
+                        foundByOwner = !IsCut( extent, bands[o].top, bands[o].bottom, binary.rows );
+                    }
+                }
+
+                if ( rows.at< uchar >( center.y - top, center.x ) == FILLED && !foundByOwner ) {
+                    whole[k].pt.x += roi.x;
+                    whole[k].pt.y += roi.y;
+                    keyPoints.push_back( whole[k] );
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,38 @@
+//
+//  tiledDetection.h
+//  capstone_functions
+//
+//  The detection stages split into bands of rows and spread over threads.
+//
+//  TiledCandidateMask does what BinaryImage( RemoveColorsFromImage( image ) )
+//  does, but a few rows at a time: each band is converted to HSV and gray,
+//  masked and thresholded while it's still in L2, instead of every step
+//  making its own pass over the whole 36MB frame.
+//
+//  TiledDetectBlobs runs the blob detector on overlapping bands of the
+//  binary image. A blob belongs to the band its center falls in. A blob
+//  whose component runs into the edge of its band (one taller than the
+//  overlap) would be cut off there, so its whole component is found by
+//  flood fill and the detector run again over just that, which gives the
+//  same keypoints detecting on the whole frame would.
+//
+
+#ifndef __capstone_functions__tiledDetection__
+#define __capstone_functions__tiledDetection__
+
+#include <map>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "bufferPool.h"
+
+//Bands for TiledCandidateMask are sized so one band's image, HSV, gray and masks fit in this
+static const size_t TILE_BYTES = 256 * 1024;
+
+//BinaryImage( RemoveColorsFromImage( image, colors ) ), worked out in bands of rows on up to threads threads
+cv::Mat TiledCandidateMask ( cv::Mat image, const std::map< cv::String, bool > &colors, BufferPool *pool, int threads );
+
+//params applied to binary (a 0/255 image) in one band per thread, the bands overlapping by
+//enough rows to hold a square blob of params.maxArea
+void TiledDetectBlobs ( cv::Mat binary, const cv::SimpleBlobDetector::Params &params, int threads, std::vector< cv::KeyPoint > &keyPoints );
+
+#endif /* defined(__capstone_functions__tiledDetection__) */
@@ -0,0 +1,168 @@
+//
+//  cborConvert.cpp
+//  capstone_functions
+//
+//  Converts results files between the JSON and CBOR formats main() can
+//  write, and compares the two formats on an existing results file.
+//
+//  Build: g++ -O2 -std=c++11 -I.. cborConvert.cpp ../json.cpp -o cborConvert
+//
+//  Usage: cborConvert to-json output.cbor output.json
+//         cborConvert to-cbor output.json output.cbor
+//         cborConvert compare output.json
+//
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include "json.h"
+
+using namespace std;
+
+static bool ReadFile ( const char *path, string &data ) {
+    FILE *file = fopen( path, "rb" );
+    if ( file == NULL ) {
+        printf( "Could not open %s\n", path );
+        return false;
+    }
+
+    char buff[65536];
+    size_t n;
+    data.clear();
+    while ( ( n = fread( buff, 1, sizeof( buff ), file ) ) > 0 ) {
+        data.append( buff, n );
+    }
+    fclose( file );
+    return true;
+}
+
+static bool WriteFile ( const char *path, const string &data ) {
+    FILE *file = fopen( path, "wb" );
+    if ( file == NULL ) {
+        printf( "Could not write %s\n", path );
+        return false;
+    }
+
+    bool ok = fwrite( data.data(), 1, data.size(), file ) == data.size();
+    fclose( file );
+    return ok;
+}
+
+static double Seconds ( chrono::steady_clock::time_point start ) {
+    return chrono::duration< double >( chrono::steady_clock::now() - start ).count();
+}
+
+//main() appends to its results file, so a file can hold several documents back to back
+static int ToJSON ( const char *in, const char *out ) {
+    string data, text;
+    if ( !ReadFile( in, data ) ) {
+        return 1;
+    }
+
+    size_t offset = 0;
+    while ( offset < data.size() ) {
+        size_t consumed = 0, errorOffset = 0;
+        json::Value v = json::DecodeCBOR( data.data() + offset, data.size() - offset, &errorOffset, &consumed );
+        if ( errorOffset != string::npos ) {
+            printf( "Invalid CBOR at byte %zu of %s\n", offset + errorOffset, in );
+            return 1;
+        }
+        json::SerializeTo( v, text );
+        offset += consumed;
+    }
+
+    printf( "%s: %zu bytes CBOR -> %zu bytes JSON\n", in, data.size(), text.size() );
+    return WriteFile( out, text ) ? 0 : 1;
+}
+
+static int ToCBOR ( const char *in, const char *out ) {
+    string data, bytes;
+    if ( !ReadFile( in, data ) ) {
+        return 1;
+    }
+
+    size_t errorOffset = 0;
+    json::Value v = json::Deserialize( data, &errorOffset );
+    if ( errorOffset != string::npos ) {
+        printf( "Invalid JSON at byte %zu of %s\n", errorOffset, in );
+        return 1;
+    }
+    json::EncodeCBOR( v, bytes );
+
+    printf( "%s: %zu bytes JSON -> %zu bytes CBOR\n", in, data.size(), bytes.size() );
+    return WriteFile( out, bytes ) ? 0 : 1;
+}
+
+//Size and encode/decode speed of both formats for the same document
+static int Compare ( const char *in ) {
+    string text;
+    if ( !ReadFile( in, text ) ) {
+        return 1;
+    }
+
+    size_t errorOffset = 0;
+    json::Value v = json::Deserialize( text, &errorOffset );
+    if ( errorOffset != string::npos ) {
+        printf( "Invalid JSON at byte %zu of %s\n", errorOffset, in );
+        return 1;
+    }
+
+    //Repeat small files so the timings mean something
+    int rounds = ( int )( ( 64 * 1024 * 1024 ) / ( text.size() + 1 ) ) + 1;
+    string jsonOut, cborOut;
+
+    auto start = chrono::steady_clock::now();
+    for ( int i = 0; i < rounds; i++ ) {
+        jsonOut.clear();
+        json::SerializeTo( v, jsonOut );
+    }
+    double jsonEncode = Seconds( start ) / rounds;
+
+    start = chrono::steady_clock::now();
+    for ( int i = 0; i < rounds; i++ ) {
+        cborOut.clear();
+        json::EncodeCBOR( v, cborOut );
+    }
+    double cborEncode = Seconds( start ) / rounds;
+
+    bool same = true;
+    start = chrono::steady_clock::now();
+    for ( int i = 0; i < rounds; i++ ) {
+        same &= ( json::Deserialize( jsonOut ).GetType() != json::NULLVal );
+    }
+    double jsonDecode = Seconds( start ) / rounds;
+
+    json::Value decoded;
+    start = chrono::steady_clock::now();
+    for ( int i = 0; i < rounds; i++ ) {
+        decoded = json::DecodeCBOR( cborOut );
+    }
+    double cborDecode = Seconds( start ) / rounds;
+    same &= ( json::Serialize( decoded ) == jsonOut );
+
+    double jsonMB = jsonOut.size() / ( 1024.0 * 1024.0 );
+    printf( "%s\n", in );
+    printf( "  JSON  %10zu bytes  encode %8.1f MB/s  decode %8.1f MB/s\n", jsonOut.size(), jsonMB / jsonEncode, jsonMB / jsonDecode );
+    printf( "  CBOR  %10zu bytes  encode %8.1f MB/s  decode %8.1f MB/s  (%.0f%% of JSON size, throughput in JSON-equivalent MB)\n", cborOut.size(), jsonMB / cborEncode, jsonMB / cborDecode, 100.0 * cborOut.size() / jsonOut.size() );
+    printf( "  round trip through CBOR %s\n", same ? "identical" : "DIFFERS" );
+    return same ? 0 : 1;
+}
+
+int main ( int argc, char **argv ) {
+    string mode = ( argc > 1 ) ? argv[1] : "";
+
+    if ( mode == "to-json" && argc == 4 ) {
+        return ToJSON( argv[2], argv[3] );
+    }
+    else if ( mode == "to-cbor" && argc == 4 ) {
+        return ToCBOR( argv[2], argv[3] );
+    }
+    else if ( mode == "compare" && argc == 3 ) {
+        return Compare( argv[2] );
+    }
+
+    printf( "Usage: %s to-json in.cbor out.json\n", argv[0] );
+    printf( "       %s to-cbor in.json out.cbor\n", argv[0] );
+    printf( "       %s compare in.json\n", argv[0] );
+    return 1;
+}
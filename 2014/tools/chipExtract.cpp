@@ -0,0 +1,104 @@
+//
+//  chipExtract.cpp
+//  capstone_functions
+//
+//  Lists the chips in an archive written by main() (see chipArchive.h) or
+//  copies them back out as individual image files.
+//
+//  Build: g++ -O2 -std=c++11 -I.. chipExtract.cpp ../chipArchive.cpp -o chipExtract `pkg-config --cflags --libs opencv`
+//
+//  Usage: chipExtract list <archive>
+//         chipExtract extract <archive> <outDir> [frame]
+//
+//  <archive> is the path without the .pack/.idx extension. Extracted chips
+//  are named frame_candidate_kind[_label] with the extension they were
+//  encoded with, and are copied byte for byte (not re-encoded).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <ctype.h>
+#include "chipArchive.h"
+
+using namespace std;
+
+static const char *KindName ( uint8_t kind ) {
+    return ( kind == CHIP_TARGET ) ? "target" : "candidate";
+}
+
+//Labels come from OCR, keep only what's safe in a filename
+static string FileSafe ( const char *label ) {
+    string safe;
+    for ( const char *p = label; *p != '\0'; p++ ) {
+        safe += isalnum( ( unsigned char )*p ) ? *p : '-';
+    }
+    return safe;
+}
+
+static int List ( const ChipArchiveReader &archive ) {
+    printf( "%8s %8s %10s %20s %10s %10s  %s\n", "frame", "cand", "kind", "bbox", "offset", "bytes", "label" );
+    for ( size_t i = 0; i < archive.size(); i++ ) {
+        ChipEntry entry = archive.GetEntry( i );
+        char bbox[64];
+        snprintf( bbox, sizeof( bbox ), "%d,%d %dx%d", entry.x, entry.y, entry.width, entry.height );
+        printf( "%8u %8u %10s %20s %10llu %10u  %s\n", entry.frame, entry.candidate, KindName( entry.kind ), bbox, ( unsigned long long )entry.offset, entry.length, entry.label );
+    }
+    printf( "%zu chips\n", archive.size() );
+    return 0;
+}
+
+static int Extract ( const ChipArchiveReader &archive, const string &outDir, long frame ) {
+    size_t extracted = 0;
+
+    for ( size_t i = 0; i < archive.size(); i++ ) {
+        ChipEntry entry = archive.GetEntry( i );
+        if ( frame >= 0 && entry.frame != ( uint32_t )frame ) {
+            continue;
+        }
+
+        char name[128];
+        snprintf( name, sizeof( name ), "%u_%u_%s", entry.frame, entry.candidate, KindName( entry.kind ) );
+        string path = outDir + "/" + name;
+        if ( entry.label[0] != '\0' ) {
+            path += "_" + FileSafe( entry.label );
+        }
+        path += entry.Extension();
+
+        size_t length = 0;
+        const unsigned char *data = archive.GetData( i, &length );
+        FILE *file = fopen( path.c_str(), "wb" );
+        if ( data == NULL || file == NULL || fwrite( data, 1, length, file ) != length ) {
+            printf( "Could not write %s\n", path.c_str() );
+            if ( file != NULL ) {
+                fclose( file );
+            }
+            return 1;
+        }
+        fclose( file );
+        extracted++;
+    }
+
+    printf( "Extracted %zu chips to %s\n", extracted, outDir.c_str() );
+    return 0;
+}
+
+int main ( int argc, char **argv ) {
+    string mode = ( argc > 2 ) ? argv[1] : "";
+    ChipArchiveReader archive;
+
+    if ( ( mode == "list" && argc == 3 ) || ( mode == "extract" && ( argc == 4 || argc == 5 ) ) ) {
+        if ( !archive.Open( argv[2] ) ) {
+            printf( "Could not open archive %s\n", argv[2] );
+            return 1;
+        }
+        if ( mode == "list" ) {
+            return List( archive );
+        }
+        return Extract( archive, argv[3], ( argc == 5 ) ? atol( argv[4] ) : -1 );
+    }
+
+    printf( "Usage: %s list <archive>\n", argv[0] );
+    printf( "       %s extract <archive> <outDir> [frame]\n", argv[0] );
+    return 1;
+}
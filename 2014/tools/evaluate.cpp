@@ -0,0 +1,321 @@
+//
+//  evaluate.cpp
+//  capstone_functions
+//
+//  Scores a results file against the truth.json of the corpus it was run on
+//  (see syntheticTargets.h), so a change to the pipeline can be judged on what
+//  it does to accuracy as well as to speed. Frames are paired up in order, the
+//  way main() reads them (0.jpg, 1.jpg, ...). Within a frame, detections are
+//  matched to truth targets closest pair first, as long as they are within the
+//  radius of each other: the target's size, or -r pixels if given. From that
+//  it reports precision and recall of detection, and how often the letter,
+//  shape and colors of a matched target came out right.
+//
+//  With the stages.json main() writes next to its results (stageTimings=1),
+//  the report also has where the time went. -o appends everything as one row
+//  of a CSV file (written with a header the first time), tagged with -l, so a
+//  series of runs of different builds can be plotted as speed against accuracy.
+//
+//  Build: g++ -O2 -std=c++11 -I.. evaluate.cpp ../syntheticTargets.cpp ../stageProfiler.cpp ../perfCounters.cpp
+//         ../targetRecord.cpp ../json.cpp -o evaluate -pthread `pkg-config --cflags --libs opencv`
+//
+//  Usage: evaluate <results.json|results.cbor> <truth.json> [stages.json] [-r radius] [-l label] [-o points.csv]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "syntheticTargets.h"
+#include "stageProfiler.h"
+
+using namespace std;
+
+struct Score {
+    long frames;
+    long truths;
+    long detections;
+    long matched;
+    long letters;
+    long shapes;
+    long shapeColors;
+    long letterColors;
+    long allCorrect;
+    double imageSeconds;        //sum of image_time, each frame's whole time in main() to the second, over the frames
+    double runtime;             //minutes, from the results file
+
+    Score () : frames( 0 ), truths( 0 ), detections( 0 ), matched( 0 ), letters( 0 ), shapes( 0 ), shapeColors( 0 ), letterColors( 0 ),
+               allCorrect( 0 ), imageSeconds( 0 ), runtime( 0 ) {}
+};
+
+struct Pairing {
+    double distance;
+    int detection;
+    int truth;
+
+    bool operator< ( const Pairing &other ) const { return distance < other.distance; }
+};
+
+static bool ReadFile ( const char *path, string &data ) {
+    FILE *file = fopen( path, "rb" );
+    if ( file == NULL ) {
+        printf( "Could not open %s\n", path );
+        return false;
+    }
+
+    char buff[65536];
+    size_t n;
+    data.clear();
+    while ( ( n = fread( buff, 1, sizeof( buff ), file ) ) > 0 ) {
+        data.append( buff, n );
+    }
+    fclose( file );
+    return true;
+}
+
+//Where the last top level array in text starts. main() appends to its results
+//file, so it may hold several runs back to back and the last one is the newest.
+static size_t LastDocument ( const string &text ) {
+    size_t start = 0;
+    int depth = 0;
+    bool inString = false;
+
+    for ( size_t i = 0; i < text.size(); i++ ) {
+        char c = text[i];
+        if ( inString ) {
+            if ( c == '\\' ) {
+                i++;
+            }
+            else if ( c == '"' ) {
+                inString = false;
+            }
+        }
+        else if ( c == '"' ) {
+            inString = true;
+        }
+        else if ( c == '[' || c == '{' ) {
+            if ( depth++ == 0 ) {
+                start = i;
+            }
+        }
+        else if ( c == ']' || c == '}' ) {
+            depth--;
+        }
+    }
+    return start;
+}
+
+static bool ReadResults ( const char *path, vector< FrameRecord > &frames, double *runtime ) {
+    string data;
+    if ( !ReadFile( path, data ) ) {
+        return false;
+    }
+
+    //A CBOR results file starts with an indefinite length array (0x9f); keep the last document in it as JSON
+    if ( !data.empty() && ( unsigned char )data[0] == 0x9f ) {
+        string text;
+        size_t offset = 0;
+        while ( offset < data.size() ) {
+            size_t consumed = 0, errorOffset = 0;
+            json::Value v = json::DecodeCBOR( data.data() + offset, data.size() - offset, &errorOffset, &consumed );
+            if ( errorOffset != string::npos ) {
+                printf( "Invalid CBOR at byte %zu of %s\n", offset + errorOffset, path );
+                return false;
+            }
+            text.clear();
+            json::SerializeTo( v, text );
+            offset += consumed;
+        }
+        data.swap( text );
+    }
+
+    size_t start = LastDocument( data );
+    if ( !ReadMission( data.data() + start, data.size() - start, frames, runtime ) ) {
+        printf( "Could not read the results in %s\n", path );
+        return false;
+    }
+    return true;
+}
+
+static bool SameText ( const string &a, const string &b ) {
+    if ( a.size() != b.size() ) {
+        return false;
+    }
+    for ( size_t i = 0; i < a.size(); i++ ) {
+        if ( tolower( ( unsigned char )a[i] ) != tolower( ( unsigned char )b[i] ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Matches one frame's detections to its truth, each used at most once, closest pairs first
+static void ScoreFrame ( const FrameRecord &frame, const TruthFrame &truth, double radius, Score &score ) {
+    vector< Pairing > pairings;
+    for ( int d = 0; d < ( int )frame.targets.size(); d++ ) {
+        for ( int t = 0; t < ( int )truth.targets.size(); t++ ) {
+            const TargetRecord &found = frame.targets[d];
+            const TruthTarget &placed = truth.targets[t];
+
+            double distance = hypot( ( double )( found.x - placed.x ), ( double )( found.y - placed.y ) );
+            if ( distance <= ( ( radius > 0 ) ? radius : placed.size ) ) {
+                Pairing p = { distance, d, t };
+                pairings.push_back( p );
+            }
+        }
+    }
+    sort( pairings.begin(), pairings.end() );
+
+    vector< bool > detectionUsed( frame.targets.size(), false ), truthUsed( truth.targets.size(), false );
+    for ( size_t i = 0; i < pairings.size(); i++ ) {
+        const Pairing &p = pairings[i];
+        if ( detectionUsed[p.detection] || truthUsed[p.truth] ) {
+            continue;
+        }
+        detectionUsed[p.detection] = truthUsed[p.truth] = true;
+
+        const TargetRecord &found = frame.targets[p.detection];
+        const TruthTarget &placed = truth.targets[p.truth];
+        bool letter = SameText( found.letter, placed.letter );
+        bool shape = SameText( found.shape, placed.shape );
+        bool shapeColor = SameText( found.shape_color, placed.shape_color );
+        bool letterColor = SameText( found.letter_color, placed.letter_color );
+
+        score.matched++;
+        score.letters += letter;
+        score.shapes += shape;
+        score.shapeColors += shapeColor;
+        score.letterColors += letterColor;
+        score.allCorrect += ( letter && shape && shapeColor && letterColor );
+    }
+
+    score.frames++;
+    score.truths += truth.targets.size();
+    score.detections += frame.targets.size();
+    score.imageSeconds += atof( frame.image_time.c_str() );
+}
+
+static double Ratio ( long part, long whole ) {
+    return ( whole > 0 ) ? ( double )part / whole : 0;
+}
+
+static void PrintScore ( const Score &score, const vector< StageTimingRecord > &stages ) {
+    double precision = Ratio( score.matched, score.detections ), recall = Ratio( score.matched, score.truths );
+    double f1 = ( precision + recall > 0 ) ? 2 * precision * recall / ( precision + recall ) : 0;
+
+    printf( "%ld frames, %ld targets placed, %ld detected, %ld matched\n", score.frames, score.truths, score.detections, score.matched );
+    printf( "  precision %6.3f  recall %6.3f  F1 %6.3f\n", precision, recall, f1 );
+    printf( "Of the matched targets:\n" );
+    printf( "  letter %6.3f  shape %6.3f  shape color %6.3f  letter color %6.3f  all four %6.3f\n",
+            Ratio( score.letters, score.matched ), Ratio( score.shapes, score.matched ), Ratio( score.shapeColors, score.matched ),
+            Ratio( score.letterColors, score.matched ), Ratio( score.allCorrect, score.matched ) );
+    printf( "Runtime %.2fmin, %.3fs per frame (from image_time, which has 1s resolution)\n", score.runtime, score.imageSeconds / max( score.frames, 1L ) );
+
+    if ( !stages.empty() ) {
+        printf( "  %-22s %8s %11s %9s %9s %9s\n", "Stage", "calls", "ms/frame", "p50 ms", "p99 ms", "max ms" );
+        for ( size_t i = 0; i < stages.size(); i++ ) {
+            printf( "  %-22s %8d %11.3f %9.3f %9.3f %9.3f\n", stages[i].stage.c_str(), stages[i].calls, stages[i].total * 1e3 / max( score.frames, 1L ),
+                    stages[i].p50 * 1e3, stages[i].p99 * 1e3, stages[i].max * 1e3 );
+        }
+    }
+}
+
+//One row per run. Every stage gets a column, whether or not it ran, so rows from different builds line up.
+static bool AppendPoint ( const char *path, const char *label, const Score &score, const vector< StageTimingRecord > &stages ) {
+    FILE *existing = fopen( path, "rb" );
+    bool header = ( existing == NULL );
+    if ( existing != NULL ) {
+        fclose( existing );
+    }
+
+    FILE *file = fopen( path, "ab" );
+    if ( file == NULL ) {
+        printf( "Could not write %s\n", path );
+        return false;
+    }
+
+    if ( header ) {
+        fprintf( file, "label,frames,precision,recall,letter,shape,shape_color,letter_color,all_correct,runtime_min,frame_s_per_frame" );
+        for ( int i = 0; i < STAGE_COUNT; i++ ) {
+            fprintf( file, ",%s_ms_per_frame", StageName( ( PipelineStage )i ) );
+        }
+        fprintf( file, "\n" );
+    }
+
+    fprintf( file, "%s,%ld,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f", label, score.frames, Ratio( score.matched, score.detections ),
+             Ratio( score.matched, score.truths ), Ratio( score.letters, score.matched ), Ratio( score.shapes, score.matched ),
+             Ratio( score.shapeColors, score.matched ), Ratio( score.letterColors, score.matched ), Ratio( score.allCorrect, score.matched ),
+             score.runtime, score.imageSeconds / max( score.frames, 1L ) );
+    for ( int i = 0; i < STAGE_COUNT; i++ ) {
+        double total = 0;
+        for ( size_t s = 0; s < stages.size(); s++ ) {
+            if ( stages[s].stage == StageName( ( PipelineStage )i ) ) {
+                total = stages[s].total;
+            }
+        }
+        fprintf( file, ",%.4f", total * 1e3 / max( score.frames, 1L ) );
+    }
+    fprintf( file, "\n" );
+    return fclose( file ) == 0;
+}
+
+int main ( int argc, char **argv ) {
+    vector< const char * > files;
+    const char *label = "run", *pointsOut = NULL;
+    double radius = 0;
+
+    for ( int i = 1; i < argc; i++ ) {
+        if ( strcmp( argv[i], "-r" ) == 0 && i + 1 < argc ) {
+            radius = atof( argv[++i] );
+        }
+        else if ( strcmp( argv[i], "-l" ) == 0 && i + 1 < argc ) {
+            label = argv[++i];
+        }
+        else if ( strcmp( argv[i], "-o" ) == 0 && i + 1 < argc ) {
+            pointsOut = argv[++i];
+        }
+        else {
+            files.push_back( argv[i] );
+        }
+    }
+
+    if ( files.size() < 2 || files.size() > 3 ) {
+        printf( "Usage: %s <results.json|results.cbor> <truth.json> [stages.json] [-r radius] [-l label] [-o points.csv]\n", argv[0] );
+        return 1;
+    }
+
+    Score score;
+    vector< FrameRecord > results;
+    vector< TruthFrame > truth;
+    vector< StageTimingRecord > stages;
+
+    if ( !ReadResults( files[0], results, &score.runtime ) ) {
+        return 1;
+    }
+    if ( !ReadTruth( files[1], truth ) ) {
+        printf( "Could not read the truth in %s\n", files[1] );
+        return 1;
+    }
+    if ( files.size() == 3 && !ReadStageTimings( files[2], stages ) ) {
+        printf( "Could not read the stage timings in %s\n", files[2] );
+        return 1;
+    }
+
+    if ( results.size() != truth.size() ) {
+        printf( "Warning: %zu frames of results for %zu frames of truth, scoring the first %zu\n", results.size(), truth.size(),
+                min( results.size(), truth.size() ) );
+    }
+    for ( size_t i = 0; i < results.size() && i < truth.size(); i++ ) {
+        ScoreFrame( results[i], truth[i], radius, score );
+    }
+
+    PrintScore( score, stages );
+
+    if ( pointsOut != NULL && !AppendPoint( pointsOut, label, score, stages ) ) {
+        return 1;
+    }
+    return 0;
+}